@@ -4,6 +4,8 @@
 // that bit-blasts the model and converts it from SMT to
 // Z3's internal representation for SAT
 
+#include "llvm/ADT/APInt.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/Statistic.h"
 #include "llvm/IR/Function.h"
 #include "llvm/Pass.h"
@@ -12,15 +14,27 @@
 #include "llvm/IR/Module.h"
 #include "llvm/IR/InstIterator.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/InstVisitor.h"
+#include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/TypeBuilder.h"
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
 #include "llvm/Transforms/Utils/Local.h"
 #include "llvm/ADT/SCCIterator.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ErrorHandling.h"
 
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Instruction.h"
 #include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Bitcode/ReaderWriter.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/Timer.h"
 
 #include <vector>
 #include <queue>
@@ -29,42 +43,186 @@
 #include <queue>
 #include <stack>
 #include <string>
+#include <memory>
 #include <fstream>
 #include <algorithm>
 #include <iterator>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <thread>
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <cstdio>
+#include <cctype>
+#include <cstring>
+#include <cerrno>
+#include <signal.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <utime.h>
+#include <sys/file.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
 
 #include "llvm/Analysis/CFG.h"
 
-using namespace llvm;
+#include "CFCount.h"
+#include "counting/Tokenizer.h"
 
-#define DEBUG_TYPE "hello"
+using namespace llvm;
 
-/** Required Parameters for LLVM Pass **/
+#define DEBUG_TYPE "cfcount"
+
+STATISTIC(NumTraceBlocks, "Number of BBs read from traces");
+STATISTIC(NumLoopIterationsCompressed,
+          "Number of loop iterations compressed into runs");
+STATISTIC(NumLoopRunsSummarized,
+          "Number of loop runs generated in closed form");
+STATISTIC(NumInstsWalked, "Number of instructions walked");
+STATISTIC(NumConstraints, "Number of constraints generated");
+STATISTIC(NumBranchConstraints, "Number of branch constraints");
+STATISTIC(NumMemoryConstraints,
+          "Number of alloca/getelementptr/load/store constraints");
+STATISTIC(NumArithConstraints, "Number of binary operator constraints");
+STATISTIC(NumConstArithCircuits,
+          "Number of mul/div/rem by constants built as shift-add circuits");
+STATISTIC(NumCmpConstraints, "Number of compare constraints");
+STATISTIC(NumCastConstraints, "Number of sext/trunc constraints");
+STATISTIC(NumPHIConstraints, "Number of phi constraints");
+STATISTIC(NumCallConstraints, "Number of call/return constraints");
+STATISTIC(NumVarsCreated, "Number of Z3 variables created");
+STATISTIC(NumBoolsRegistered, "Number of Bools registered");
+STATISTIC(PeakFormulaBytes, "Size of the largest Z3Py script (bytes)");
+STATISTIC(NumCacheHits, "Number of paths found in the cache");
+STATISTIC(NumCacheMisses, "Number of paths not found in the cache");
+
+// All of the statistics, by name, for the JSON report
+#define STAT_ENTRY(VARNAME) {#VARNAME, &VARNAME}
+std::pair<const char *, Statistic *> AllStatistics[] = {
+    STAT_ENTRY(NumTraceBlocks),
+    STAT_ENTRY(NumLoopIterationsCompressed),
+    STAT_ENTRY(NumLoopRunsSummarized),
+    STAT_ENTRY(NumInstsWalked),
+    STAT_ENTRY(NumConstraints),
+    STAT_ENTRY(NumBranchConstraints),
+    STAT_ENTRY(NumMemoryConstraints),
+    STAT_ENTRY(NumArithConstraints),
+    STAT_ENTRY(NumConstArithCircuits),
+    STAT_ENTRY(NumCmpConstraints),
+    STAT_ENTRY(NumCastConstraints),
+    STAT_ENTRY(NumPHIConstraints),
+    STAT_ENTRY(NumCallConstraints),
+    STAT_ENTRY(NumVarsCreated),
+    STAT_ENTRY(NumBoolsRegistered),
+    STAT_ENTRY(PeakFormulaBytes),
+    STAT_ENTRY(NumCacheHits),
+    STAT_ENTRY(NumCacheMisses)};
+#undef STAT_ENTRY
+
+/** Files and modes of a run of CFCountPass **/
+/** (set by RunPass from the pass's options, see CFCountPass.cpp; **/
+/** -cfcount-serve and -cfcount-batch set the files of each path) **/
 
 // Trace file indicating what path in the program is being modeled
-cl::opt<std::string> TraceFilename(cl::Positional, cl::Required,
-                                   cl::desc("<trace file>"));
+std::string TraceFilename;
 // Name of the resulting Z3Py file that converts path conditions to Z3's SAT
 // format
-cl::opt<std::string> Z3Filename(cl::Positional, cl::Required,
-                                cl::desc("<z3 file>"));
+std::string Z3Filename;
 // File indicating the upper and lower bounds of input variables in the program
 // being modeled
-cl::opt<std::string> BoundsFilename(cl::Positional, cl::Required,
-                                    cl::desc("<bounds file>"));
+std::string BoundsFilename;
 // File to track the name of boolean variables created in the model
 // (needed later when converting Z3's output to standard SAT format, CNF
-cl::opt<std::string> BoolFilename(cl::Positional, cl::Required,
-                                  cl::desc("<bool file>"));
+std::string BoolFilename;
+// File to record the Bool variables that name the bits of each input
+// (used later to mark the input bits in the CNF). The input bits are
+// only declared when it is set
+std::string InputsFilename;
+
+// Modes of the pass (see cfcount::PassOptions)
+std::string ServeSocket;
+std::string BatchFilename;
+bool BatchCount = false;
+bool Online = false;
+unsigned OnlineQueueDepth = 16;
+std::string CacheDir;
+unsigned CacheSize = 1024;
+bool NoCache = false;
+std::string StatsJSONFilename;
+std::string CountCommand;
+
+/** Options of the engine (CFCountPass, and CFCount.h through **/
+/** cl::ParseCommandLineOptions) **/
+
+// Longest loop iteration (in BBs) that is detected and compressed into a
+// run of repeated iterations when reading the trace
+cl::opt<unsigned> MaxLoopPeriod(
+    "cfcount-max-loop-period", cl::init(64),
+    cl::desc("Longest loop iteration (in BBs) compressed in the trace"));
+// Skip over loop runs whose body only computes concrete values
+cl::opt<bool> SkipConcreteLoops(
+    "cfcount-skip-concrete-loops", cl::init(true),
+    cl::desc("Replace input independent loops with their concrete result"));
+
+// Generate loop runs whose variables are induction variables with the
+// iterations but the last in closed form
+cl::opt<bool> SummarizeLoops(
+    "cfcount-summarize-loops", cl::init(true),
+    cl::desc("Summarize loop runs over induction variables in closed form"));
+
+// Length of arrays whose number of elements is only known at run time
+// (the bound of the arrays of the model library)
+cl::opt<unsigned> ArrayBound(
+    "cfcount-array-bound", cl::init(35),
+    cl::desc("Number of elements of arrays of unknown length"));
+// Largest non constant exponent of a pow call that is modeled exactly
+// (the result of a larger one is unconstrained)
+cl::opt<unsigned> PowMaxExponent(
+    "cfcount-pow-max-exponent", cl::init(10),
+    cl::desc("Largest variable exponent of pow calls modeled exactly"));
+
+// Check the path for contradictions every N branches while generating it
+// (0 disables the check)
+cl::opt<unsigned> CheckEvery(
+    "cfcount-check-every", cl::init(0),
+    cl::desc("Check the path is feasible every N branches (0 disables)"));
+// Z3Py script that keeps the incremental solver used for the check. The
+// build sets the scripts directory of the source tree, so the default
+// does not depend on the directory the pass runs in
+#ifndef CFCOUNT_SCRIPTS_DIR
+#define CFCOUNT_SCRIPTS_DIR "scripts"
+#endif
+cl::opt<std::string> CheckerScript(
+    "cfcount-checker", cl::init(CFCOUNT_SCRIPTS_DIR "/incremental_check.py"),
+    cl::desc("Z3Py script used to check feasibility incrementally"));
+// Python interpreter used to run the checker
+cl::opt<std::string> PythonPath("cfcount-python", cl::init("python"),
+                                cl::desc("Python interpreter with Z3Py"));
+// Model library loaded by the checker
+cl::opt<std::string> CheckerModels(
+    "cfcount-checker-models", cl::init("models.py"),
+    cl::desc("Z3Py model library loaded by the feasibility checker"));
+
+// Leave the bounds of the inputs out of the formula. The path is then
+// counted under any bounds from one compiled d-DNNF (cfcount-ddnnf), which
+// needs the input bits (-cfcount-inputs-file)
+cl::opt<bool> NoBounds(
+    "cfcount-no-bounds", cl::init(false),
+    cl::desc("Do not constrain the inputs to the bounds file"));
 
 /***************************************/
 
 std::ofstream result_file;
 
 Module *mod_ptr;
+// MD5 of the module's bitcode, before it is renamed
+std::string moduleHash;
 
 std::vector<int> lowerBounds;
 std::vector<int> upperBounds;
@@ -97,9 +255,102 @@ typedef struct pointsTo {
   int arrayBitWidth;
 } PointsTo;
 
-std::map<std::string, PointsTo *> pointsToMap;
+// What each pointer points to. Facts are stored by value in a flat table
+// and looked up by the interned id of the pointer's Z3 variable. A
+// pointer that copies another one (PHIs, arguments) shares its fact:
+// facts never change once recorded. Facts only live for one path, so a
+// new path drops them all at once by starting a new epoch
+std::vector<PointsTo> pointsToFacts;
+// Facts of the current path, the first ones of pointsToFacts (the rest
+// are kept to reuse their storage)
+int numPointsToFacts = 0;
+// Id of each Z3 variable that was a pointer, kept across paths
+StringMap<unsigned> pointerIds;
+// Fact of each pointer id, if it was set in the current epoch
+typedef struct pointsToEntry {
+  unsigned epoch;
+  int fact;
+} PointsToEntry;
+std::vector<PointsToEntry> pointsToEntries;
+unsigned pointsToEpoch = 1;
+// Pointer ids given a fact in the current epoch, in order
+std::vector<unsigned> pointsToLog;
+
+// What a pointer points to (NULL if nothing is known). Only valid until
+// the next fact is recorded
+const PointsTo *FindPointsTo(const std::string &name) {
+  auto id = pointerIds.find(name);
+  if (id == pointerIds.end() ||
+      pointsToEntries[id->second].epoch != pointsToEpoch) {
+    return NULL;
+  }
+  return &pointsToFacts[pointsToEntries[id->second].fact];
+}
+
+// Make a pointer point to an existing fact
+void SetPointsToFact(const std::string &name, int fact) {
+  auto found = pointerIds.find(name);
+  unsigned id;
+  if (found == pointerIds.end()) {
+    id = pointsToEntries.size();
+    pointerIds[name] = id;
+    pointsToEntries.push_back(PointsToEntry());
+  } else {
+    id = found->second;
+  }
+  pointsToEntries[id].epoch = pointsToEpoch;
+  pointsToEntries[id].fact = fact;
+  pointsToLog.push_back(id);
+}
+
+// Record what a pointer points to
+void AddPointsTo(const std::string &name, const PointsTo &fact) {
+  if (numPointsToFacts == pointsToFacts.size()) {
+    pointsToFacts.push_back(fact);
+  } else {
+    pointsToFacts[numPointsToFacts] = fact;
+  }
+  SetPointsToFact(name, numPointsToFacts++);
+}
+
+// Make a pointer point to what another one points to. Returns false if
+// nothing is known about the other one
+bool AliasPointsTo(const std::string &name, const std::string &source) {
+  auto id = pointerIds.find(source);
+  if (id == pointerIds.end() ||
+      pointsToEntries[id->second].epoch != pointsToEpoch) {
+    return false;
+  }
+  SetPointsToFact(name, pointsToEntries[id->second].fact);
+  return true;
+}
+
+// Forget what every pointer points to
+void ResetPointsTo() {
+  pointsToEpoch++;
+  numPointsToFacts = 0;
+  pointsToLog.clear();
+}
 std::map<std::string, int> arrayMap;
 
+// Number of elements of the Z3 arrays (lists of BitVecs) whose length
+// is known, by Z3 variable name
+std::map<std::string, int> arrayLengths;
+// Prefix circuits over arrays already in the script (see GetNulChain)
+std::set<std::string> arrayCircuits;
+
+// Names of the Bool variables created in the model, and of the Bools
+// of the input bits (written to the bool and inputs files once the
+// path is generated)
+std::vector<std::string> boolVars;
+std::vector<std::string> inputBits;
+
+// Record a Bool variable created in the model
+void RegisterBool(std::string name) {
+  boolVars.push_back(name);
+  ++NumBoolsRegistered;
+}
+
 // Struct for tracking info about Nodes in the path's
 // Control Flow Graph
 struct CFGNode {
@@ -292,47 +543,272 @@ void rename_insts() {
 }
 
 // Read in bound information for input variables
-void get_bounds() {
+// (pairs of lower and upper bounds)
+void read_bounds(std::istream &bounds_stream) {
 
-  std::ifstream bounds_file(BoundsFilename);
   std::string holder;
 
   int ct = 0;
   int curr;
 
-  if (bounds_file.is_open()) {
-    while (bounds_file >> holder) {
-      std::stringstream ss(holder);
-      ss >> curr;
-      if (ct % 2 == 0) {
-        lowerBounds.push_back(curr);
-      } else {
-        upperBounds.push_back(curr);
-      }
-      ct++;
+  while (bounds_stream >> holder) {
+    std::stringstream ss(holder);
+    ss >> curr;
+    if (ct % 2 == 0) {
+      lowerBounds.push_back(curr);
+    } else {
+      upperBounds.push_back(curr);
     }
+    ct++;
+  }
+}
+
+// Read in bound information from the bounds file
+void get_bounds() {
+
+  std::ifstream bounds_file(BoundsFilename);
+
+  if (bounds_file.is_open()) {
+    read_bounds(bounds_file);
     bounds_file.close();
   } else {
     llvm::errs() << "Cannot open bounds file!\n";
   }
 }
 
+// Binary traces (written by programs instrumented with CFCountTracer)
+// start with TraceMagic, the format version, the number of blocks of the
+// module and the module's hash. Then come chunks of records of one thread:
+// <thread> <number of records> <records>. Every field is a little-endian
+// 32-bit word. A record is a block id, a call (tagged, with the callee's
+// function id) or a return (tagged)
+static const char TraceMagic[] = "CFCTRACE";
+static const uint32_t TraceVersion = 1;
+static const uint32_t TraceCallTag = 1u << 30;
+static const uint32_t TraceReturnTag = 2u << 30;
+static const uint32_t TraceIdMask = (1u << 30) - 1;
+
+// Name of each block by id: blocks are numbered in the order of the
+// module, after renaming, the same way in both passes
+std::vector<std::string> blockNames;
+// Id of each defined function (for call records)
+std::map<std::string, uint32_t> functionIds;
+
+void NumberBlocks() {
+  blockNames.clear();
+  functionIds.clear();
+  for (auto func = mod_ptr->begin(), func_e = mod_ptr->end(); func != func_e;
+       ++func) {
+    if (func->isDeclaration() == false) {
+      uint32_t id = functionIds.size();
+      functionIds[func->getName()] = id;
+      for (Function::iterator bb = func->begin(), bb_e = func->end();
+           bb != bb_e; ++bb) {
+        blockNames.push_back(bb->getName());
+      }
+    }
+  }
+}
+
+// Little-endian 32-bit word of a trace
+void AppendTraceWord(std::string *bytes, uint32_t word) {
+  for (int i = 0; i < 4; i++) {
+    bytes->push_back((char)((word >> (8 * i)) & 0xff));
+  }
+}
+
+uint32_t ReadTraceWord(const char *bytes) {
+  const unsigned char *b = (const unsigned char *)bytes;
+  return b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+// Read the blocks of a binary trace (after its magic), passing each one
+// to addBlock. Block ids are of names, the numbering of the module with
+// hash hash (see NumberBlocks). Only the first thread's records are part
+// of the path
+void read_binary_trace(
+    std::istream &trace_stream, const std::vector<std::string> &names,
+    const std::string &hash,
+    const std::function<void(const std::string &)> &addBlock) {
+
+  char header[8 + 32];
+  if (!trace_stream.read(header, sizeof(header))) {
+    llvm::errs() << "Truncated binary trace!\n";
+    return;
+  }
+  if (ReadTraceWord(header) != TraceVersion) {
+    llvm::errs() << "Unsupported binary trace version!\n";
+    return;
+  }
+  if (ReadTraceWord(header + 4) != names.size()) {
+    llvm::errs() << "Binary trace was recorded from a module with "
+                 << ReadTraceWord(header + 4) << " blocks, not "
+                 << names.size() << "!\n";
+    return;
+  }
+  if (hash != "" && std::string(header + 8, 32) != hash) {
+    llvm::errs() << "Warning: binary trace was recorded from a different "
+                    "build of the module\n";
+  }
+
+  bool otherThreads = false;
+  char chunkHeader[8];
+  std::vector<char> records;
+  while (trace_stream.read(chunkHeader, sizeof(chunkHeader))) {
+    uint32_t thread = ReadTraceWord(chunkHeader);
+    uint32_t count = ReadTraceWord(chunkHeader + 4);
+    records.resize(4 * (size_t)count);
+    if (!trace_stream.read(records.data(), records.size())) {
+      llvm::errs() << "Truncated binary trace!\n";
+      break;
+    }
+    if (thread != 0) {
+      otherThreads = true;
+      continue;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+      uint32_t record = ReadTraceWord(&records[4 * i]);
+      // Calls and returns are implied by the blocks
+      if ((record & ~TraceIdMask) != 0) {
+        continue;
+      }
+      if (record >= names.size()) {
+        llvm::errs() << "Binary trace has an unknown block id!\n";
+        return;
+      }
+      addBlock(names[record]);
+      ++NumTraceBlocks;
+    }
+  }
+  if (otherThreads) {
+    llvm::errs() << "Warning: only the first thread of the binary trace is "
+                    "modeled\n";
+  }
+}
+
+// Pass each block named in the text trace [begin, end) to addBlock
+void read_text_trace(
+    const char *begin, const char *end,
+    const std::function<void(const std::string &)> &addBlock) {
+
+  Tokenizer tokens(begin, end, false);
+  const char *token;
+  size_t size;
+  while (tokens.Next(&token, &size)) {
+    StringRef block(token, size);
+    if (block != "call" && block != "return") {
+      addBlock(block.str());
+      ++NumTraceBlocks;
+    }
+  }
+}
+
+// Read the blocks executed in the path being modeled, in order, passing
+// each one to addBlock. The stream is read once from the start, so it
+// can be a pipe. Binary traces are of the module numbered names
+void read_trace_blocks(
+    std::istream &trace_stream,
+    const std::function<void(const std::string &)> &addBlock,
+    const std::vector<std::string> &names = blockNames,
+    const std::string &hash = moduleHash) {
+
+  // Binary traces are recognized by their magic, text traces list
+  // block names
+  char magic[sizeof(TraceMagic) - 1];
+  trace_stream.read(magic, sizeof(magic));
+  std::string head(magic, trace_stream.gcount());
+  if (head == TraceMagic) {
+    read_binary_trace(trace_stream, names, hash, addBlock);
+    return;
+  }
+  trace_stream.clear();
+
+  // The text is read as it comes (the tracer may still be writing it)
+  // and tokenized up to its last whitespace; what follows is the start
+  // of a name finished by the next read
+  std::string text = head;
+  std::streambuf *buffer = trace_stream.rdbuf();
+  bool done = false;
+  while (!done) {
+    std::streamsize available = buffer->in_avail();
+    if (available <= 0 && buffer->sgetc() != EOF) {
+      available = buffer->in_avail();
+    }
+    if (available > 0) {
+      size_t old_size = text.size();
+      text.resize(old_size + available);
+      text.resize(old_size + buffer->sgetn(&text[old_size], available));
+    } else if (buffer->sgetc() != EOF) {
+      // Unbuffered streams (std::cin synced with stdio) a line at a time
+      std::string line;
+      std::getline(trace_stream, line);
+      text += line;
+      text += '\n';
+    } else {
+      done = true;
+    }
+
+    size_t complete = text.size();
+    if (!done) {
+      while (complete > 0 && !isspace((unsigned char)text[complete - 1])) {
+        complete--;
+      }
+    }
+    read_text_trace(text.data(), text.data() + complete, addBlock);
+    text.erase(0, complete);
+  }
+}
+
 // Read in the order of basic blocks executed
 // in the path being modeled
-std::vector<std::string> get_trace() {
+std::vector<std::string>
+read_trace(std::istream &trace_stream,
+           const std::vector<std::string> &names = blockNames,
+           const std::string &hash = moduleHash) {
 
-  std::ifstream trace_file(TraceFilename);
   std::vector<std::string> result;
-  std::string holder;
+  read_trace_blocks(trace_stream, [&result](const std::string &block) {
+    result.push_back(block);
+  }, names, hash);
 
-  if (trace_file.is_open()) {
-    while (trace_file >> holder) {
-      if (holder != "call" && holder != "return") {
-        result.push_back(holder);
-      }
+  return result;
+}
+
+// Read in a trace file. Text traces are tokenized in place in the
+// mapped file; false if it cannot be opened
+bool read_trace_file(const std::string &filename,
+                     std::vector<std::string> *result,
+                     const std::vector<std::string> &names = blockNames,
+                     const std::string &hash = moduleHash) {
+
+  ErrorOr<std::unique_ptr<MemoryBuffer> > buffer =
+      MemoryBuffer::getFile(filename);
+  if (!buffer) {
+    return false;
+  }
+  StringRef contents = (*buffer)->getBuffer();
+  if (contents.startswith(TraceMagic)) {
+    std::ifstream trace_file(filename, std::ios::binary);
+    if (!trace_file.is_open()) {
+      return false;
     }
-    trace_file.close();
-  } else {
+    *result = read_trace(trace_file, names, hash);
+    return true;
+  }
+
+  result->clear();
+  read_text_trace(contents.begin(), contents.end(),
+                  [result](const std::string &block) {
+    result->push_back(block);
+  });
+  return true;
+}
+
+// Read in the trace file
+std::vector<std::string> get_trace() {
+
+  std::vector<std::string> result;
+  if (!read_trace_file(TraceFilename, &result)) {
     llvm::errs() << "Cannot open trace file!\n";
   }
 
@@ -362,6 +838,130 @@ void BuildFunctionCFGMap(
   }
 }
 
+// Struct for tracking a run of back-to-back iterations of the same
+// loop in the trace. Only the first iteration is kept in the trace,
+// the rest are generated from the run
+struct TraceRun {
+  // Index of the run's first BB in the (compressed) trace
+  int firstBlock;
+  // BBs executed by one iteration of the loop
+  std::vector<std::string> cycle;
+  // Number of times the iteration is repeated
+  int count;
+  // Location of the first iteration in the inlined instruction order
+  int startInst;
+  int endInst;
+  // Where each BB of the cycle starts in that order. A BB can appear
+  // more than once in the cycle, so the BB of an instruction is found
+  // from these and not from the instruction's parent
+  std::vector<int> cycleStarts;
+};
+
+// Check if a call goes to a function defined in the module, whose BBs
+// are inlined from the trace. Indirect calls are not followed, as
+// CFCountTracer does not record them
+bool CallsUserFunction(CallInst *ci) {
+  Function *callee = ci->getCalledFunction();
+  return callee != NULL && !callee->isDeclaration();
+}
+
+// Check if a BB can be part of a compressed loop iteration. BBs that
+// call user functions or return change the function being executed, so
+// they have to stay in the trace as is. Neither is it known where an
+// indirect call goes
+bool IsLoopCompressible(
+    std::string bbName,
+    std::map<std::string, std::map<std::string, CFGNode *> > &FunctionCFGMap) {
+
+  std::string func_name = bbName.substr(0, bbName.find("_"));
+  if (FunctionCFGMap.find(func_name) == FunctionCFGMap.end() ||
+      FunctionCFGMap[func_name].find(bbName) ==
+          FunctionCFGMap[func_name].end()) {
+    return false;
+  }
+
+  std::vector<Instruction *> &instructions =
+      FunctionCFGMap[func_name][bbName]->instructions;
+  for (int i = 0; i < instructions.size(); i++) {
+    if (isa<ReturnInst>(instructions[i])) {
+      return false;
+    }
+    if (CallInst *ci = dyn_cast<CallInst>(instructions[i])) {
+      if (ci->getCalledFunction() == NULL || CallsUserFunction(ci)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Detect repeating cycles of BBs in the trace (loop iterations) and
+// replace each of them with a single iteration. The removed iterations
+// are recorded as runs so they can be generated without being inlined
+std::vector<TraceRun> compress_trace(
+    std::vector<std::string> &bb_trace,
+    std::map<std::string, std::map<std::string, CFGNode *> > &FunctionCFGMap) {
+
+  std::vector<TraceRun> runs;
+  std::vector<std::string> compressed;
+  // Cache of which BBs can be part of a loop iteration
+  std::map<std::string, bool> compressible;
+
+  int i = 0;
+  while (i < bb_trace.size()) {
+    int bestPeriod = 1;
+    int bestCount = 1;
+
+    // Try each iteration length starting at the current BB and keep
+    // the one that covers the most of the trace
+    for (int period = 1; period <= MaxLoopPeriod &&
+                         i + 2 * period <= bb_trace.size();
+         period++) {
+      std::string bbName = bb_trace[i + period - 1];
+      if (compressible.find(bbName) == compressible.end()) {
+        compressible[bbName] = IsLoopCompressible(bbName, FunctionCFGMap);
+      }
+      // An iteration has to stay within a single function
+      if (!compressible[bbName] ||
+          bbName.substr(0, bbName.find("_")) !=
+              bb_trace[i].substr(0, bb_trace[i].find("_"))) {
+        break;
+      }
+
+      // Count how far the iteration keeps repeating
+      int len = period;
+      while (i + len < bb_trace.size() &&
+             bb_trace[i + len] == bb_trace[i + len - period]) {
+        len++;
+      }
+      int count = len / period;
+      if (count >= 2 && count * period > bestCount * bestPeriod) {
+        bestPeriod = period;
+        bestCount = count;
+      }
+    }
+
+    if (bestCount > 1) {
+      TraceRun run;
+      run.firstBlock = compressed.size();
+      run.cycle.assign(bb_trace.begin() + i, bb_trace.begin() + i + bestPeriod);
+      run.count = bestCount;
+      NumLoopIterationsCompressed += bestCount - 1;
+      run.startInst = -1;
+      run.endInst = -1;
+      runs.push_back(run);
+      compressed.insert(compressed.end(), run.cycle.begin(), run.cycle.end());
+      i += bestCount * bestPeriod;
+    } else {
+      compressed.push_back(bb_trace[i]);
+      i++;
+    }
+  }
+
+  bb_trace = compressed;
+  return runs;
+}
+
 // TODO
 std::string model_library_name = "models.py";
 std::string model_library_prefix = "ar";
@@ -377,6 +977,81 @@ void print_error(std::string msg) {
   }
 }
 
+// Struct for tracking the time spent in a phase of the pipeline
+typedef struct phaseTime {
+  // Seconds of wall, user and system time
+  double wall;
+  double user;
+  double system;
+  unsigned calls;
+} PhaseTime;
+
+// Time spent in each phase, by phase name
+std::map<std::string, PhaseTime> phaseTimes;
+
+// Adds the time spent in its scope (or until stopped) to a phase
+class PhaseTimer {
+public:
+  PhaseTimer(std::string name)
+      : name(name), start(TimeRecord::getCurrentTime(true)), running(true) {}
+  ~PhaseTimer() { Stop(); }
+
+  void Stop() {
+    if (!running) {
+      return;
+    }
+    running = false;
+    TimeRecord elapsed = TimeRecord::getCurrentTime(false);
+    elapsed -= start;
+    PhaseTime &phase = phaseTimes[name];
+    phase.wall += elapsed.getWallTime();
+    phase.user += elapsed.getUserTime();
+    phase.system += elapsed.getSystemTime();
+    phase.calls++;
+  }
+
+private:
+  std::string name;
+  TimeRecord start;
+  bool running;
+};
+
+// Write the phase times and the statistics as JSON
+void WriteStatsJSON(std::string filename) {
+  std::string json;
+  raw_string_ostream os(json);
+
+  os << "{\n  \"phases\": {";
+  for (auto it = phaseTimes.begin(); it != phaseTimes.end(); ++it) {
+    os << (it == phaseTimes.begin() ? "\n" : ",\n") << "    \"" << it->first
+       << "\": {\"wall\": " << it->second.wall
+       << ", \"user\": " << it->second.user
+       << ", \"system\": " << it->second.system
+       << ", \"calls\": " << it->second.calls << "}";
+  }
+  os << "\n  },\n  \"counters\": {";
+  int numStatistics = sizeof(AllStatistics) / sizeof(AllStatistics[0]);
+  for (int i = 0; i < numStatistics; i++) {
+    os << (i == 0 ? "\n" : ",\n") << "    \"" << AllStatistics[i].first
+       << "\": " << AllStatistics[i].second->getValue();
+  }
+  os << "\n  }\n}\n";
+  os.flush();
+
+  std::ofstream stats_file(filename);
+  stats_file << json;
+  stats_file.close();
+}
+
+// Start a new report (a daemon request only reports its own work)
+void ResetStats() {
+  phaseTimes.clear();
+  int numStatistics = sizeof(AllStatistics) / sizeof(AllStatistics[0]);
+  for (int i = 0; i < numStatistics; i++) {
+    *AllStatistics[i].second = 0;
+  }
+}
+
 // Get the name of the Z3 variable that models
 // a specifica LLVM variable
 std::string GetVarName(std::string name) {
@@ -411,6 +1086,7 @@ std::string CreateVarName(std::string name) {
     (*vst)[name] = 0;
   }
   result = name + "_" + std::to_string((*vst)[name]);
+  ++NumVarsCreated;
 
   return result;
 }
@@ -442,6 +1118,76 @@ void GetBranchInstConstraint(BranchInst *bi, std::string nextBB,
   }
 }
 
+// Z3 condition that a switch's value is one of a set of case values.
+// Consecutive values are merged into ranges, and a range lo..hi is a
+// single unsigned check (x - lo) <= (hi - lo)
+std::string GetCaseSetCondition(std::string opName,
+                                std::vector<int64_t> values) {
+  std::sort(values.begin(), values.end());
+  std::vector<std::string> checks;
+  for (int i = 0; i < values.size();) {
+    int j = i;
+    while (j + 1 < values.size() && values[j + 1] == values[j] + 1) {
+      j++;
+    }
+    if (i == j) {
+      checks.push_back(opName + " == " + std::to_string(values[i]));
+    } else {
+      checks.push_back("ULE(" + opName + " - " + std::to_string(values[i]) +
+                       ", " +
+                       std::to_string((uint64_t)values[j] - (uint64_t)values[i]) +
+                       ")");
+    }
+    i = j + 1;
+  }
+
+  if (checks.size() == 1) {
+    return checks[0];
+  }
+  std::string result = "Or(";
+  for (int i = 0; i < checks.size(); i++) {
+    result += (i > 0 ? ", " : "") + checks[i];
+  }
+  return result + ")";
+}
+
+void GetSwitchInstConstraint(SwitchInst *si, std::string nextBB,
+                             std::string *result) {
+  print_error("GetInstConstraint: SwitchInst\n");
+  std::string opName;
+  if (ConstantInt *c = dyn_cast<ConstantInt>(si->getCondition())) {
+    // A bit-vector, as ULE only takes those
+    opName = "BitVecVal(" + std::to_string(c->getSExtValue()) + ", " +
+             std::to_string(c->getBitWidth()) + ")";
+  } else {
+    opName = GetVarName(si->getCondition()->getName().str());
+  }
+
+  // The cases that go to the next BB in the trace and the others
+  std::vector<int64_t> taken, others;
+  for (auto c : si->cases()) {
+    if (c.getCaseSuccessor()->getName().str() == nextBB) {
+      taken.push_back(c.getCaseValue()->getSExtValue());
+    } else {
+      others.push_back(c.getCaseValue()->getSExtValue());
+    }
+  }
+
+  // The default also goes to the next BB: the value is none of the
+  // cases that go elsewhere
+  if (si->getDefaultDest()->getName().str() == nextBB) {
+    if (!others.empty()) {
+      (*result) +=
+          "g.add(Not(" + GetCaseSetCondition(opName, others) + "))\n";
+    }
+  } else if (!taken.empty()) {
+    (*result) += "g.add(" + GetCaseSetCondition(opName, taken) + ")\n";
+  } else {
+    print_error("GetInstConstraint Error: Switch inst does not target the "
+                "next BB in the trace\n");
+  }
+}
+
 void GetAllocaInstConstraint(AllocaInst *ai, std::string *result) {
   print_error("GetInstConstraint: AllocaInst\n");
   auto ai_type = ai->getAllocatedType();
@@ -478,6 +1224,7 @@ void GetAllocaInstConstraint(AllocaInst *ai, std::string *result) {
         (*result) += "g.add(temp[0])\n";
         // Second item is the name of the created array
         (*result) += varName + " = temp[1]\n";
+        arrayLengths[varName] = arr_type->getArrayNumElements();
       } else {
         print_error(
             "GetInstConstraint Error: Allocating array with unknown type!\n");
@@ -509,23 +1256,23 @@ void GetGEPInstConstraint(GetElementPtrInst *gep, std::string *result) {
         if (IntegerType *int_type = dyn_cast<IntegerType>(alloc_type)) {
           // Track the information about what this GEP points
           // to (which array and location in array)
-          PointsTo *temp = new PointsTo;
-          temp->name = ai->getName();
-          temp->isArray = true;
-          temp->arrayBitWidth = int_type->getBitWidth();
+          PointsTo fact = PointsTo();
+          fact.name = ai->getName();
+          fact.isArray = true;
+          fact.arrayBitWidth = int_type->getBitWidth();
 
           // If the offset is a known constant, it's concrete
           if (ConstantInt *ci = dyn_cast<ConstantInt>(gep->getOperand(2))) {
-            temp->arrayOffsetSymb = false;
-            temp->concreteOffset = ci->getSExtValue();
+            fact.arrayOffsetSymb = false;
+            fact.concreteOffset = ci->getSExtValue();
             // If it's based on an unknown value (input), it's symbolic
           } else {
-            temp->arrayOffsetSymb = true;
-            temp->symOffsetName = gep->getOperand(2)->getName().str();
+            fact.arrayOffsetSymb = true;
+            fact.symOffsetName = gep->getOperand(2)->getName().str();
           }
           // Create the Z3 var for the gep (array pointer)
           std::string varName = CreateVarName(gep->getName().str());
-          pointsToMap[varName] = temp;
+          AddPointsTo(varName, fact);
         } else {
           print_error(
               "GetInstConstraint Error: GEP on array of non-int type!\n");
@@ -569,8 +1316,7 @@ void GetStoreInstConstraint(StoreInst *si, std::string *result) {
     // Get the name of the pointer
     std::string ptrName = GetVarName(si->getOperand(1)->getName().str());
     // Make sure it is a pointer we can handle
-    if (pointsToMap.find(ptrName) != pointsToMap.end()) {
-      pointsTo *temp = pointsToMap[ptrName];
+    if (const PointsTo *temp = FindPointsTo(ptrName)) {
       // Stores to arrays are currently not supported
       if (temp->isArray) {
         print_error("storing to an array!\n");
@@ -594,7 +1340,7 @@ void GetStoreInstConstraint(StoreInst *si, std::string *result) {
       }
     } else {
       print_error(
-          "Could not find the pointer being stored to in pointsToMap!\n");
+          "Could not find the pointer being stored to in pointsToFacts!\n");
     }
   }
 }
@@ -642,8 +1388,7 @@ void GetLoadInstConstraint(LoadInst *li, std::string *result) {
       // Get the Z3 variable for what is being loaded
       std::string loadOpName = GetVarName(load_op->getName().str());
       // Make sure the value is a pointer we can handle
-      if (pointsToMap.find(loadOpName) != pointsToMap.end()) {
-        pointsTo *temp = pointsToMap[loadOpName];
+      if (const PointsTo *temp = FindPointsTo(loadOpName)) {
         std::string pointsToName = GetVarName(temp->name);
         // Can't handle loads of pointers to arrays (arrays alloc'd
         // dynamically)
@@ -657,7 +1402,7 @@ void GetLoadInstConstraint(LoadInst *li, std::string *result) {
         }
       } else {
         print_error("Loading something that is not an allocate or pointer in "
-                    "pointsToMap!\n");
+                    "pointsToFacts!\n");
       }
     }
   } else {
@@ -666,6 +1411,181 @@ void GetLoadInstConstraint(LoadInst *li, std::string *result) {
   }
 }
 
+// Z3 expression for x times the constant c (modulo 2^width of c) as a sum
+// of shifted copies of x. The constant is recoded in non-adjacent form
+// (digits -1, 0, 1 with no two adjacent non-zero digits) so runs of ones
+// cost one subtraction instead of one addition per bit
+std::string GetConstMulExpr(std::string x, APInt c) {
+  std::string expr;
+  for (unsigned shift = 0; c != 0; shift++, c = c.lshr(1)) {
+    if (!c[0]) {
+      continue;
+    }
+    // The digit is 1 when c is 1 modulo 4, and -1 when it is 3
+    bool negative = c[1];
+    if (negative) {
+      ++c;
+    } else {
+      --c;
+    }
+    std::string term =
+        shift == 0 ? x : "(" + x + " << " + std::to_string(shift) + ")";
+    if (expr.empty()) {
+      expr = negative ? "-" + term : term;
+    } else {
+      expr += (negative ? " - " : " + ") + term;
+    }
+  }
+  if (expr.empty()) {
+    return "BitVecVal(0, " + std::to_string(c.getBitWidth()) + ")";
+  }
+  return "(" + expr + ")";
+}
+
+// Emit the quotient of the unsigned division of x by the constant d
+// (not 0) as temp_q: a logical shift for powers of two, otherwise the
+// high half of a multiplication by d's magic number
+void GetConstUDivQuotient(std::string x, APInt d, std::string *result) {
+  unsigned width = d.getBitWidth();
+  if (d.isPowerOf2()) {
+    (*result) += "temp_q = LShR(" + x + ", " + std::to_string(d.logBase2()) +
+                 ")\n";
+    return;
+  }
+
+  // An even divisor with a fix-up is first divided by its power of two,
+  // which makes the fix-up unnecessary
+  APInt::mu magics = d.magicu();
+  std::string dividend = x;
+  if (magics.a && !d[0]) {
+    unsigned shift = d.countTrailingZeros();
+    dividend = "LShR(" + x + ", " + std::to_string(shift) + ")";
+    magics = d.lshr(shift).magicu(shift);
+  }
+  (*result) += "temp_wide = ZeroExt(" + std::to_string(width) + ", " +
+               dividend + ")\n";
+  (*result) += "temp_q = Extract(" + std::to_string(2 * width - 1) + ", " +
+               std::to_string(width) + ", " +
+               GetConstMulExpr("temp_wide", magics.m.zext(2 * width)) + ")\n";
+  if (magics.a) {
+    (*result) += "temp_q = LShR(LShR(" + x + " - temp_q, 1) + temp_q, " +
+                 std::to_string(magics.s - 1) + ")\n";
+  } else if (magics.s > 0) {
+    (*result) += "temp_q = LShR(temp_q, " + std::to_string(magics.s) + ")\n";
+  }
+}
+
+// Emit the quotient (rounded toward zero) of the signed division of x by
+// the constant d (not 0) as temp_q: a biased arithmetic shift for powers
+// of two, otherwise the high half of a signed multiplication by d's magic
+// number
+void GetConstSDivQuotient(std::string x, APInt d, std::string *result) {
+  unsigned width = d.getBitWidth();
+  if (d.isAllOnesValue()) {
+    (*result) += "temp_q = -" + x + "\n";
+    return;
+  }
+  if (d == 1) {
+    (*result) += "temp_q = " + x + "\n";
+    return;
+  }
+
+  APInt absD = d.abs();
+  if (absD.isPowerOf2()) {
+    // Negative dividends are biased by d - 1 to round toward zero
+    std::string shift = std::to_string(absD.logBase2());
+    (*result) += "temp_q = (" + x + " + LShR(" + x + " >> " +
+                 std::to_string(width - 1) + ", " +
+                 std::to_string(width) + " - " + shift + ")) >> " + shift +
+                 "\n";
+  } else {
+    APInt::ms magics = d.magic();
+    (*result) += "temp_wide = SignExt(" + std::to_string(width) + ", " + x +
+                 ")\n";
+    (*result) += "temp_q = Extract(" + std::to_string(2 * width - 1) + ", " +
+                 std::to_string(width) + ", " +
+                 GetConstMulExpr("temp_wide", magics.m.sext(2 * width)) +
+                 ")\n";
+    if (d.isStrictlyPositive() && magics.m.isNegative()) {
+      (*result) += "temp_q = temp_q + " + x + "\n";
+    } else if (d.isNegative() && magics.m.isStrictlyPositive()) {
+      (*result) += "temp_q = temp_q - " + x + "\n";
+    }
+    // Round toward zero by adding the sign bit
+    (*result) += "temp_q = temp_q >> " + std::to_string(magics.s) + "\n";
+    (*result) += "temp_q = temp_q + LShR(temp_q, " +
+                 std::to_string(width - 1) + ")\n";
+    return;
+  }
+  if (d.isNegative()) {
+    (*result) += "temp_q = -temp_q\n";
+  }
+}
+
+// Encode multiplications, divisions and remainders with a constant
+// operand without a generic multiplier or divider. Returns false when
+// the operation has no constant to specialize on
+bool GetConstArithConstraint(BinaryOperator *bo, std::string varName,
+                             std::string lhs, std::string rhs,
+                             std::string *result) {
+  ConstantInt *lhsConst = dyn_cast<ConstantInt>(bo->getOperand(0));
+  ConstantInt *rhsConst = dyn_cast<ConstantInt>(bo->getOperand(1));
+  // Constant expressions are left to Z3 (they are already folded at -O0)
+  if ((rhsConst == NULL) == (lhsConst == NULL)) {
+    return false;
+  }
+
+  switch (bo->getOpcode()) {
+  case Instruction::Mul:
+    // Multiplication commutes, so the constant can be on either side
+    if (rhsConst != NULL) {
+      (*result) += "g.add(" + varName + " == " +
+                   GetConstMulExpr(lhs, rhsConst->getValue()) + ")\n";
+    } else {
+      (*result) += "g.add(" + varName + " == " +
+                   GetConstMulExpr(rhs, lhsConst->getValue()) + ")\n";
+    }
+    break;
+  case Instruction::UDiv:
+  case Instruction::URem:
+  case Instruction::SDiv:
+  case Instruction::SRem: {
+    // Division by 0 is undefined in C, so it is left to Z3
+    if (rhsConst == NULL || rhsConst->isZero()) {
+      return false;
+    }
+    APInt d = rhsConst->getValue();
+    bool isSigned = bo->getOpcode() == Instruction::SDiv ||
+                    bo->getOpcode() == Instruction::SRem;
+    bool isRem = bo->getOpcode() == Instruction::URem ||
+                 bo->getOpcode() == Instruction::SRem;
+    if (isRem && !isSigned && d.isPowerOf2()) {
+      // Only the low bits are kept
+      (*result) += "g.add(" + varName + " == (" + lhs + " & " +
+                   std::to_string((d - 1).getZExtValue()) + "))\n";
+      break;
+    }
+    if (isSigned) {
+      GetConstSDivQuotient(lhs, d, result);
+    } else {
+      GetConstUDivQuotient(lhs, d, result);
+    }
+    if (isRem) {
+      (*result) += "g.add(" + varName + " == " + lhs + " - " +
+                   GetConstMulExpr("temp_q", d) + ")\n";
+    } else {
+      (*result) += "g.add(" + varName + " == temp_q)\n";
+    }
+    break;
+  }
+  default:
+    return false;
+  }
+
+  ++NumConstArithCircuits;
+  return true;
+}
+
 void GetBinaryOperatorConstraint(BinaryOperator *bo, std::string *result) {
 
   print_error("GetInstConstraint: BinaryOperator\n");
@@ -701,6 +1621,23 @@ void GetBinaryOperatorConstraint(BinaryOperator *bo, std::string *result) {
     rhs = GetVarName(bo->getOperand(1)->getName().str());
   }
 
+  if (GetConstArithConstraint(bo, varName, lhs, rhs, result)) {
+    return;
+  }
+
+  // Unsigned division and both remainders have no Z3Py operator
+  // (% is the remainder with the sign of the divisor)
+  if (bo->getOpcode() == Instruction::UDiv) {
+    (*result) += "g.add(" + varName + " == UDiv(" + lhs + ", " + rhs + "))\n";
+    return;
+  } else if (bo->getOpcode() == Instruction::URem) {
+    (*result) += "g.add(" + varName + " == URem(" + lhs + ", " + rhs + "))\n";
+    return;
+  } else if (bo->getOpcode() == Instruction::SRem) {
+    (*result) += "g.add(" + varName + " == SRem(" + lhs + ", " + rhs + "))\n";
+    return;
+  }
+
   // The prefix of the Z3 constraint that encodes the
   // bin op
   (*result) += "g.add(" + varName + " == (" + lhs;
@@ -712,14 +1649,8 @@ void GetBinaryOperatorConstraint(BinaryOperator *bo, std::string *result) {
     (*result) += " - ";
   } else if (bo->getOpcode() == Instruction::Mul) {
     (*result) += " * ";
-  } else if (bo->getOpcode() == Instruction::UDiv) {
-    (*result) += " / ";
   } else if (bo->getOpcode() == Instruction::SDiv) {
     (*result) += " / ";
-  } else if (bo->getOpcode() == Instruction::URem) {
-    (*result) += " % ";
-  } else if (bo->getOpcode() == Instruction::SRem) {
-    (*result) += " % ";
   }
 
   // Sufix of the Z3 constraint
@@ -759,9 +1690,7 @@ void GetCmpInstConstraint(CmpInst *ci, std::string *result) {
   // bool output file (used later for conversion to
   // standard CNF format)
   (*result) = varName + " = Bool('" + varName + "')\n";
-  std::ofstream bool_file(BoolFilename, std::ofstream::app);
-  bool_file << varName << "\n";
-  bool_file.close();
+  RegisterBool(varName);
 
   // Generate the proper Z3 constraint based on the type
   // of cmp inst
@@ -840,27 +1769,19 @@ void GetPHINodeConstraint(PHINode *pn, std::string prevBB,
     llvm::errs() << "PHINode for pointer type!\n";
     // If the pointer has been seen in previous exeuctions
     // aka the pointer points to something
-    if (pointsToMap.find(incomingVal) != pointsToMap.end()) {
+    if (FindPointsTo(incomingVal)) {
       print_error("PHINode result is a pointer to a pointer!\n");
-      // Do some book keeping for the pointer info, and create
-      // pointer variable
-      PointsTo *temp = new PointsTo;
-      temp->name = pointsToMap[incomingVal]->name;
-      temp->isArray = pointsToMap[incomingVal]->isArray;
-      temp->arrayOffsetSymb = pointsToMap[incomingVal]->arrayOffsetSymb;
-      temp->symOffsetName = pointsToMap[incomingVal]->symOffsetName;
-      temp->concreteOffset = pointsToMap[incomingVal]->concreteOffset;
-      temp->arrayBitWidth = pointsToMap[incomingVal]->arrayBitWidth;
+      // The pointer variable points to the same thing
       std::string varName = CreateVarName(pn->getName().str());
-      pointsToMap[varName] = temp;
+      AliasPointsTo(varName, incomingVal);
     } else {
       // If the pointer has only been allocated but doesn't
       // point to anything. Create the struct for the pointer
       // and create a Z3 variable for it
-      PointsTo *temp = new PointsTo;
-      temp->name = incomingValName;
-      temp->isArray = false;
-      temp->arrayOffsetSymb = false;
+      PointsTo fact = PointsTo();
+      fact.name = incomingValName;
+      fact.isArray = false;
+      fact.arrayOffsetSymb = false;
 
       // NOTE: Creating a variable name here for the pointer doesn't really
       // make sense.
@@ -868,7 +1789,7 @@ void GetPHINodeConstraint(PHINode *pn, std::string prevBB,
       // likely
       // unnecessary
       std::string varName = CreateVarName(pn->getName().str());
-      pointsToMap[varName] = temp;
+      AddPointsTo(varName, fact);
     }
   } else {
     print_error("GetInstConstraint Error: PHINode returned to a non integer "
@@ -914,7 +1835,7 @@ void GetSExtInstConstraint(SExtInst *si, std::string *result) {
 
   // Generate the Z3 constraint for sign extending
   (*result) += "g.add(" + varName + " == SignExt(" + std::to_string(extend_by) +
-               ", " + opVar + "))";
+               ", " + opVar + "))\n";
 }
 
 void GetTrunInstConstraint(TruncInst *ti, std::string *result) {
@@ -988,16 +1909,134 @@ void GetReturnInstConstraint(ReturnInst *ri, std::string *result) {
   }
 }
 
+/** Library function models **/
+
+// Generates the constraints of a call to a library function
+typedef void (*LibCallHandler)(CallInst *ci, std::string *result);
+
+// Model of a library function called on the path
+typedef struct libCallModel {
+  LibCallHandler handler;
+  // The call has no impact on the state (e.g. printf)
+  bool noEffect;
+} LibCallModel;
+
+// Models of library functions, by function name
+std::map<std::string, LibCallModel> &GetLibCallModels() {
+  static std::map<std::string, LibCallModel> models;
+  return models;
+}
+
+// Add (or replace) the model of a library function. Models register
+// themselves with a RegisterLibCall object, like passes do with
+// RegisterPass
+void RegisterLibCallModel(std::string name, LibCallHandler handler,
+                          bool noEffect) {
+  LibCallModel model;
+  model.handler = handler;
+  model.noEffect = noEffect;
+  GetLibCallModels()[name] = model;
+}
+
+struct RegisterLibCall {
+  RegisterLibCall(const char *name, LibCallHandler handler,
+                  bool noEffect = false) {
+    RegisterLibCallModel(name, handler, noEffect);
+  }
+};
+
+// Models of the library functions declared in the module, resolved
+// once per module so a call only costs a pointer lookup
+DenseMap<const Function *, const LibCallModel *> libCallTable;
+
+void ResolveLibCallModels() {
+  std::map<std::string, LibCallModel> &models = GetLibCallModels();
+  libCallTable.clear();
+  for (auto func = mod_ptr->begin(), func_e = mod_ptr->end(); func != func_e;
+       ++func) {
+    if (func->isDeclaration()) {
+      auto model = models.find(func->getName().str());
+      if (model != models.end()) {
+        libCallTable[&*func] = &model->second;
+      }
+    }
+  }
+}
+
+// Number of elements of a Z3 array that the library models look at
+int GetArrayLength(std::string arrayName) {
+  auto it = arrayLengths.find(arrayName);
+  if (it != arrayLengths.end() && it->second < ArrayBound) {
+    return it->second;
+  }
+  return ArrayBound;
+}
+
+// Get the Z3 value of an integer operand of a library call
+// (a constant or the current version of a program variable)
+std::string GetLibCallOperand(Value *op) {
+  if (ConstantInt *cons_int = dyn_cast<ConstantInt>(op)) {
+    return std::to_string(cons_int->getSExtValue());
+  }
+  return GetVarName(op->getName().str());
+}
+
+// Emit the chain of Bools <array>_nul_<k> (none of the first k elements
+// of the array is NUL), once per version of an array. The position of the
+// first NUL is where the string ends for both strlen and atoi
+std::string GetNulChain(std::string arrayName, std::string *result) {
+  std::string prefix = arrayName + "_nul_";
+  if (arrayCircuits.insert(prefix).second) {
+    (*result) += prefix + "0 = BoolVal(True)\n";
+    for (int k = 0; k < GetArrayLength(arrayName); k++) {
+      (*result) += prefix + std::to_string(k + 1) + " = And(" + prefix +
+                   std::to_string(k) + ", " + arrayName + "[" +
+                   std::to_string(k) + "] != 0)\n";
+    }
+  }
+  return prefix;
+}
+
+// atoi of the characters of the string: an optional sign followed by
+// decimal digits, ending at the first other character (at the latest
+// at the string's NUL). The value is accumulated over the digits with
+// shift-and-add multiplications by 10
 void GetAtoiInstConstraint(CallInst *ci, std::string *result) {
   // Create Z3 variable for atoi result
   std::string varName = CreateVarName(ci->getName().str());
   // Get Z3 variable for atoi argument
   std::string opName =
       GetVarName(ci->getOperand(0)->getName().str() + "_array");
+  int length = GetArrayLength(opName);
+  std::string nul = GetNulChain(opName, result);
+
+  // The digits are built once per version of the array
+  std::string digits = opName + "_atoi";
+  if (arrayCircuits.insert(digits).second) {
+    (*result) += digits + "_neg = " + opName + "[0] == 45\n";
+    (*result) += digits + "_sign = Or(" + digits + "_neg, " + opName +
+                 "[0] == 43)\n";
+    (*result) += "temp_num = BitVecVal(0, 32)\n";
+    (*result) += "temp_run = BoolVal(True)\n";
+    for (int k = 0; k < length; k++) {
+      std::string c = opName + "[" + std::to_string(k) + "]";
+      // Still in the number if every character so far was a digit
+      // (the sign can only be first)
+      (*result) += "temp_run = And(" +
+                   (k == 1 ? "Or(temp_run, " + digits + "_sign)"
+                           : std::string("temp_run")) +
+                   ", " + nul + std::to_string(k + 1) + ", ULE(" + c +
+                   " - 48, 9))\n";
+      (*result) += "temp_num = If(temp_run, (temp_num << 3) + (temp_num << "
+                   "1) + ZeroExt(24, " +
+                   c + " - 48), temp_num)\n";
+    }
+    (*result) += digits + " = If(" + digits + "_neg, -temp_num, temp_num)\n";
+  }
+
   // Declare the resulting Z3 variable and encode it
-  (*result) = varName + " = BitVec('" + varName + "', 32)\n";
-  (*result) += "g.add(" + model_library_prefix + ".atoi(" + opName + ", " +
-               varName + "))\n";
+  (*result) += varName + " = BitVec('" + varName + "', 32)\n";
+  (*result) += "g.add(" + varName + " == " + digits + ")\n";
 }
 
 void GetCallocInstConstraint(CallInst *ci, std::string *result) {
@@ -1018,6 +2057,7 @@ void GetCallocInstConstraint(CallInst *ci, std::string *result) {
   // in the program
   if (ConstantInt *con = dyn_cast<ConstantInt>(ci->getOperand(0))) {
     opName0 = std::to_string(con->getSExtValue());
+    arrayLengths[varName_array] = con->getSExtValue();
   } else {
     opName0 = GetVarName(ci->getOperand(0)->getName().str());
   }
@@ -1060,27 +2100,36 @@ void GetMemsetInstConstraint(CallInst *ci, std::string *result) {
       GetVarName(ci->getOperand(0)->getName().str() + "_array_length");
   std::string opName1, opName2;
 
-  // Get the Z3 var for the value being set
+  // Get the Z3 var for the byte being set
   // (can be a constant or a program variable)
   if (ConstantInt *cons_int = dyn_cast<ConstantInt>(ci->getOperand(1))) {
-    opName1 = std::to_string(cons_int->getSExtValue());
+    opName1 =
+        "BitVecVal(" + std::to_string(cons_int->getZExtValue() & 0xff) + ", 8)";
   } else {
-    opName1 = GetVarName(ci->getOperand(1)->getName().str());
+    opName1 = "Extract(7, 0, " +
+              GetVarName(ci->getOperand(1)->getName().str()) + ")";
   }
 
-  // Get the  Z3 var for the number of bytes to set
-  // (can be a constant or a program variable)
+  int length = GetArrayLength(opName0);
+  if (arrayLengths.find(opName0) != arrayLengths.end()) {
+    arrayLengths[varName_array] = arrayLengths[opName0];
+  }
+
+  // The elements of the new array are the set byte or the old
+  // elements, so no new variables are needed
   if (ConstantInt *cons_int = dyn_cast<ConstantInt>(ci->getOperand(2))) {
-    opName2 = std::to_string(cons_int->getSExtValue());
+    // A constant number of bytes only rewires the elements
+    int num = std::min((int)cons_int->getSExtValue(), length);
+    opName2 = std::to_string(num);
+    (*result) = varName_array + " = [" + opName1 + "] * " + opName2 + " + " +
+                opName0 + "[" + opName2 + ":]\n";
   } else {
     opName2 = GetVarName(ci->getOperand(2)->getName().str());
+    (*result) = varName_array + " = [If(ULT(k, " + opName2 + "), " + opName1 +
+                ", " + opName0 + "[k]) for k in range(" +
+                std::to_string(length) + ")] + " + opName0 + "[" +
+                std::to_string(length) + ":]\n";
   }
-
-  // Use the Z3 modeling library to model the calloc call
-  (*result) = "temp = " + model_library_prefix + ".memset(" + opName0 + ", '" +
-              varName_array + "', 0, " + opName1 + ", " + opName2 + ", 8)\n";
-  (*result) += "g.add(temp[0])\n";
-  (*result) += varName_array + " = temp[1]\n";
   (*result) += varName_offset + " = BitVec('" + varName_offset + "', 64)\n";
   (*result) += "g.add(" + varName_offset + " == 0)\n";
   (*result) +=
@@ -1089,20 +2138,56 @@ void GetMemsetInstConstraint(CallInst *ci, std::string *result) {
       "g.add(" + varName_array_length + " == " + opName0_length + ")\n";
 }
 
+// pow by squaring: the base is squared once per bit of the exponent
+// and the squares of the exponent's set bits are multiplied. Only the
+// bits of a constant exponent, or those of -cfcount-pow-max-exponent,
+// are used. A variable exponent over the bound leaves the result
+// unconstrained rather than ruling the path out
 void GetPowInstConstraint(CallInst *ci, std::string *result) {
   // Create Z3 variable for result
   std::string varName = CreateVarName(ci->getName().str());
   // Get Z3 Variables for ops
-  std::string opName0 = GetVarName(ci->getOperand(0)->getName().str());
-  std::string opName1 = GetVarName(ci->getOperand(1)->getName().str());
+  std::string opName0 = GetLibCallOperand(ci->getOperand(0));
   // Declare the new Z3 variable for the result
   (*result) = varName + " = BitVec('" + varName + "', 32)\n";
-  // Use the pow model created
-  (*result) += "g.add(" + model_library_prefix + ".pow(" + opName0 + ", " +
-               opName1 + ", " + varName + "))\n";
-}
-
-void GetStrlenInstConstraint(CallInst *ci, std::string *result) {
+  (*result) += "temp_sq = " + opName0 + "\n";
+  (*result) += "temp_pow = BitVecVal(1, 32)\n";
+
+  if (ConstantInt *cons_int = dyn_cast<ConstantInt>(ci->getOperand(1))) {
+    int64_t exponent = cons_int->getSExtValue();
+    if (exponent < 0) {
+      print_error("GetInstConstraint Error: pow with a negative exponent\n");
+      return;
+    }
+    for (; exponent > 0; exponent >>= 1) {
+      if (exponent & 1) {
+        (*result) += "temp_pow = temp_pow * temp_sq\n";
+      }
+      if (exponent > 1) {
+        (*result) += "temp_sq = temp_sq * temp_sq\n";
+      }
+    }
+  } else {
+    std::string opName1 = GetVarName(ci->getOperand(1)->getName().str());
+    for (unsigned bit = 0; (PowMaxExponent >> bit) > 0; bit++) {
+      if (bit > 0) {
+        (*result) += "temp_sq = temp_sq * temp_sq\n";
+      }
+      (*result) += "temp_pow = If(Extract(" + std::to_string(bit) + ", " +
+                   std::to_string(bit) + ", " + opName1 +
+                   ") == 1, temp_pow * temp_sq, temp_pow)\n";
+    }
+    // The bits above the bound are not multiplied in, so the result is
+    // only known for exponents within it
+    (*result) += "g.add(Implies(ULE(" + opName1 + ", " +
+                 std::to_string(PowMaxExponent) + "), " + varName +
+                 " == temp_pow))\n";
+    return;
+  }
+  (*result) += "g.add(" + varName + " == temp_pow)\n";
+}
+
+void GetStrlenInstConstraint(CallInst *ci, std::string *result) {
 
   int instBitWidth;
 
@@ -1120,12 +2205,51 @@ void GetStrlenInstConstraint(CallInst *ci, std::string *result) {
   // Get the Z3 variable for the array that is strlen's argument
   std::string opName_array =
       GetVarName(ci->getOperand(0)->getName().str() + "_array");
+  // The length is the last position with no NUL before it
+  (*result) = "";
+  std::string nul = GetNulChain(opName_array, result);
+  (*result) += "temp = BitVecVal(0, " + std::to_string(instBitWidth) + ")\n";
+  for (int k = 1; k <= GetArrayLength(opName_array); k++) {
+    (*result) += "temp = If(" + nul + std::to_string(k) + ", " +
+                 std::to_string(k) + ", temp)\n";
+  }
   // Declare the Z3 variable for the result
-  (*result) = varName + " = BitVec('" + varName + "', " +
-              std::to_string(instBitWidth) + ")\n";
-  // Use the generated model for strlen
-  (*result) += "g.add(" + model_library_prefix + ".strlen(" + opName_array +
-               ", " + varName + "))\n";
+  (*result) += varName + " = BitVec('" + varName + "', " +
+               std::to_string(instBitWidth) + ")\n";
+  (*result) += "g.add(" + varName + " == temp)\n";
+}
+
+// Declare a named Z3 Bool for each bit of an input variable and record
+// it for the bool and inputs files. Bit-blasting only keeps the names of
+// Bools, so this is what identifies the input bits in the final CNF
+void DeclareInputBits(std::string varName, int bitWidth, std::string *result) {
+  if (InputsFilename == "") {
+    return;
+  }
+
+  for (int bit = 0; bit < bitWidth; bit++) {
+    // Bits are zero padded so no name is a prefix of another one
+    // (convert.py replaces the names textually)
+    std::string bitName = "input_" + std::to_string(boundCt) + "_bit_" +
+                          (bit < 10 ? "0" : "") + std::to_string(bit);
+    (*result) += bitName + " = Bool('" + bitName + "')\n";
+    (*result) += "g.add(" + bitName + " == (Extract(" + std::to_string(bit) +
+                 ", " + std::to_string(bit) + ", " + varName + ") == 1))\n";
+    RegisterBool(bitName);
+    inputBits.push_back(bitName);
+  }
+}
+
+// Keep an input within its bounds (the bounds of the current scanf'd
+// value), unless they are applied when counting
+std::string GetInputBoundsConstraint(std::string varName) {
+  if (NoBounds) {
+    return "";
+  }
+  return "g.add(And(" + model_library_prefix + ".gte(" + varName + ", " +
+         std::to_string(lowerBounds[boundCt]) + "), " + model_library_prefix +
+         ".lte(" + varName + ", " + std::to_string(upperBounds[boundCt]) +
+         ")))\n";
 }
 
 void GetScanfInstConstraint(CallInst *ci, std::string *result) {
@@ -1137,10 +2261,11 @@ void GetScanfInstConstraint(CallInst *ci, std::string *result) {
       // Get the Z3 var for the input variable
       std::string argName = GetVarName(ci->getArgOperand(i)->getName().str());
       // Place the correct bounds on the input variable
-      (*result) += "g.add(And(" + model_library_prefix + ".gte(" + argName +
-                   ", " + std::to_string(lowerBounds[boundCt]) + "), " +
-                   model_library_prefix + ".lte(" + argName + ", " +
-                   std::to_string(upperBounds[boundCt]) + ")))\n";
+      (*result) += GetInputBoundsConstraint(argName);
+      if (IntegerType *int_type =
+              dyn_cast<IntegerType>(ai->getAllocatedType())) {
+        DeclareInputBits(argName, int_type->getBitWidth(), result);
+      }
     } else {
       // If the argument is a pointer
       if (PointerType *ptr_type =
@@ -1149,10 +2274,7 @@ void GetScanfInstConstraint(CallInst *ci, std::string *result) {
         std::string argName = GetVarName(ci->getArgOperand(i)->getName().str());
         // If it's a pointer that we can handle (it points to
         // something
-        if (pointsToMap.find(argName) != pointsToMap.end()) {
-
-          // Get what it points to
-          PointsTo *temp = pointsToMap[argName];
+        if (const PointsTo *temp = FindPointsTo(argName)) {
 
           // If it points to an array
           if (temp->isArray == true) {
@@ -1170,24 +2292,21 @@ void GetScanfInstConstraint(CallInst *ci, std::string *result) {
                            temp->name + ", " +
                            std::to_string(temp->concreteOffset) + ", " +
                            readVar + "))\n";
-              (*result) += "g.add(And(" + model_library_prefix + ".gte(" +
-                           readVar + ", " +
-                           std::to_string(lowerBounds[boundCt]) + "), " +
-                           model_library_prefix + ".lte(" + readVar + ", " +
-                           std::to_string(upperBounds[boundCt]) + ")))\n";
+              (*result) += GetInputBoundsConstraint(readVar);
+              DeclareInputBits(readVar, temp->arrayBitWidth, result);
             }
           }
           // If the pointer points to something that's not an array
           else {
-            (*result) += "g.add(And(" + model_library_prefix + ".gte(" +
-                         temp->name + ", " +
-                         std::to_string(lowerBounds[boundCt]) + "), " +
-                         model_library_prefix + ".lte(" + temp->name + ", " +
-                         std::to_string(upperBounds[boundCt]) + ")))\n";
+            (*result) += GetInputBoundsConstraint(temp->name);
+            if (IntegerType *int_type =
+                    dyn_cast<IntegerType>(ptr_type->getElementType())) {
+              DeclareInputBits(temp->name, int_type->getBitWidth(), result);
+            }
           }
         } else {
           print_error("GetInstConstraint Error: Scanf Arg is a pointer "
-                      "not in pointsToMap\n");
+                      "not in pointsToFacts\n");
         }
       }
     }
@@ -1195,6 +2314,19 @@ void GetScanfInstConstraint(CallInst *ci, std::string *result) {
   }
 }
 
+// Printf has no impact on state, so ignore it
+void GetPrintfInstConstraint(CallInst *ci, std::string *result) {
+  (*result) = "";
+}
+
+static RegisterLibCall AtoiModel("atoi", GetAtoiInstConstraint);
+static RegisterLibCall CallocModel("calloc", GetCallocInstConstraint);
+static RegisterLibCall MemsetModel("memset", GetMemsetInstConstraint);
+static RegisterLibCall PowModel("pow", GetPowInstConstraint);
+static RegisterLibCall StrlenModel("strlen", GetStrlenInstConstraint);
+static RegisterLibCall ScanfModel("__isoc99_scanf", GetScanfInstConstraint);
+static RegisterLibCall PrintfModel("printf", GetPrintfInstConstraint, true);
+
 void GetUserFuncInstConstraint(CallInst *ci, std::string *result) {
 
   // Get all the Z3 variables for each argument passed to the
@@ -1259,26 +2391,15 @@ void GetUserFuncInstConstraint(CallInst *ci, std::string *result) {
     // If a pointer is passed
     else if (PointerType *ptr_ty = dyn_cast<PointerType>(arg_type)) {
       // If the pointer passed points to something
-      if (pointsToMap.find(passedArgs[arg_ct]) != pointsToMap.end()) {
-        // Do book keeping for tracking what the new pointer
-        // points to (the value passed to it)
-        // Don't need to create a new Z3 variable until
+      if (FindPointsTo(passedArgs[arg_ct])) {
+        // The new pointer points to what the value passed to it
+        // points to. Don't need to create a new Z3 variable until
         // it is dereferenced
-        std::string arg_name = passedArgs[arg_ct];
-        PointsTo *temp = new PointsTo;
-        temp->name = pointsToMap[arg_name]->name;
-        temp->isArray = pointsToMap[arg_name]->isArray;
-        temp->arrayOffsetSymb = pointsToMap[arg_name]->arrayOffsetSymb;
-        temp->symOffsetName = pointsToMap[arg_name]->symOffsetName;
-        temp->concreteOffset = pointsToMap[arg_name]->concreteOffset;
-        temp->arrayBitWidth = pointsToMap[arg_name]->arrayBitWidth;
-        // Create a new variable for new pointer and update
-        // pointsToMap
         std::string varName = CreateVarName(arg->getName().str());
-        pointsToMap[varName] = temp;
+        AliasPointsTo(varName, passedArgs[arg_ct]);
       } else {
         print_error("GetInstConstraint Error: Function passed pointer "
-                    "argument that is not in pointsToMap\n");
+                    "argument that is not in pointsToFacts\n");
       }
     } else if (AllocaInst *ai = dyn_cast<AllocaInst>(arg)) {
       print_error("GetInstConstraint Error: unhandled function argument of "
@@ -1295,24 +2416,17 @@ void GetCallInstConstraint(CallInst *ci, std::string *result) {
 
   print_error("GetInstConstraint: CallInst\n");
   Function *func = ci->getCalledFunction();
+  if (func == NULL) {
+    print_error("GetInstConstraint Error: Indirect Function Call\n");
+    ci->dump();
+    return;
+  }
   // If function is not defined in the source files
   // (likely included from a library)
   if (func->isDeclaration()) {
-    if (func->getName().str() == "atoi") {
-      GetAtoiInstConstraint(ci, result);
-    } else if (func->getName().str() == "calloc") {
-      GetCallocInstConstraint(ci, result);
-    } else if (func->getName().str() == "memset") {
-      GetMemsetInstConstraint(ci, result);
-    } else if (func->getName().str() == "pow") {
-      GetPowInstConstraint(ci, result);
-    } else if (func->getName().str() == "strlen") {
-      GetStrlenInstConstraint(ci, result);
-    } else if (func->getName().str() == "__isoc99_scanf") {
-      GetScanfInstConstraint(ci, result);
-    } else if (func->getName().str() == "printf") {
-      // Printf has no impact on state, so ignore it
-      (*result) = "";
+    auto model = libCallTable.find(func);
+    if (model != libCallTable.end()) {
+      model->second->handler(ci, result);
     } else {
       print_error("GetInstConstraint Error: Unknown Function Call\n");
       ci->dump();
@@ -1324,277 +2438,3340 @@ void GetCallInstConstraint(CallInst *ci, std::string *result) {
   }
 }
 
-std::string GetInstConstraint(Instruction *inst, std::string prevBB,
-                              std::string nextBB) {
-  std::string result = "";
+// Dispatches an instruction to the function that generates its
+// constraints with a single switch on its opcode
+struct ConstraintVisitor : public InstVisitor<ConstraintVisitor> {
+  const std::string &prevBB;
+  const std::string &nextBB;
+  std::string result;
 
-  if (BranchInst *bi = dyn_cast<BranchInst>(inst)) {
-    GetBranchInstConstraint(bi, nextBB, &result);
-  } else if (AllocaInst *ai = dyn_cast<AllocaInst>(inst)) {
-    GetAllocaInstConstraint(ai, &result);
-  } else if (GetElementPtrInst *gep = dyn_cast<GetElementPtrInst>(inst)) {
-    GetGEPInstConstraint(gep, &result);
-  } else if (StoreInst *si = dyn_cast<StoreInst>(inst)) {
-    GetStoreInstConstraint(si, &result);
-  } else if (LoadInst *li = dyn_cast<LoadInst>(inst)) {
-    GetLoadInstConstraint(li, &result);
-  } else if (BinaryOperator *bo = dyn_cast<BinaryOperator>(inst)) {
-    GetBinaryOperatorConstraint(bo, &result);
-  } else if (CmpInst *ci = dyn_cast<CmpInst>(inst)) {
-    GetCmpInstConstraint(ci, &result);
-  } else if (PHINode *pn = dyn_cast<PHINode>(inst)) {
-    GetPHINodeConstraint(pn, prevBB, &result);
-  } else if (SExtInst *si = dyn_cast<SExtInst>(inst)) {
-    GetSExtInstConstraint(si, &result);
-  } else if (TruncInst *ti = dyn_cast<TruncInst>(inst)) {
-    GetTrunInstConstraint(ti, &result);
-  } else if (ReturnInst *ri = dyn_cast<ReturnInst>(inst)) {
-    GetReturnInstConstraint(ri, &result);
-  } else if (CallInst *ci = dyn_cast<CallInst>(inst)) {
-    GetCallInstConstraint(ci, &result);
-  } else {
+  ConstraintVisitor(const std::string &prevBB, const std::string &nextBB)
+      : prevBB(prevBB), nextBB(nextBB) {}
+
+  void visitBranchInst(BranchInst &bi) {
+    GetBranchInstConstraint(&bi, nextBB, &result);
+  }
+  void visitSwitchInst(SwitchInst &si) {
+    GetSwitchInstConstraint(&si, nextBB, &result);
+  }
+  void visitAllocaInst(AllocaInst &ai) { GetAllocaInstConstraint(&ai, &result); }
+  void visitGetElementPtrInst(GetElementPtrInst &gep) {
+    GetGEPInstConstraint(&gep, &result);
+  }
+  void visitStoreInst(StoreInst &si) { GetStoreInstConstraint(&si, &result); }
+  void visitLoadInst(LoadInst &li) { GetLoadInstConstraint(&li, &result); }
+  void visitBinaryOperator(BinaryOperator &bo) {
+    GetBinaryOperatorConstraint(&bo, &result);
+  }
+  void visitCmpInst(CmpInst &ci) { GetCmpInstConstraint(&ci, &result); }
+  void visitPHINode(PHINode &pn) {
+    GetPHINodeConstraint(&pn, prevBB, &result);
+  }
+  void visitSExtInst(SExtInst &si) { GetSExtInstConstraint(&si, &result); }
+  void visitTruncInst(TruncInst &ti) { GetTrunInstConstraint(&ti, &result); }
+  void visitReturnInst(ReturnInst &ri) {
+    GetReturnInstConstraint(&ri, &result);
+  }
+  void visitCallInst(CallInst &ci) { GetCallInstConstraint(&ci, &result); }
+  void visitInstruction(Instruction &inst) {
     print_error("GetInstConstraint Error: Unknown Instruction Type!\n");
-    inst->dump();
+    inst.dump();
   }
+};
 
-  return result;
+std::string GetInstConstraint(Instruction *inst, std::string prevBB,
+                              std::string nextBB) {
+  ConstraintVisitor visitor(prevBB, nextBB);
+  visitor.visit(inst);
+  return visitor.result;
 }
 
-// Get the Z3 constraints the encode the behavior of the
-// program path being modeled
-std::vector<std::string> GetTraceConstraints(
-    std::map<std::string, std::map<std::string, CFGNode *> > *FunctionCFGMap,
-    std::vector<Instruction *> trace) {
-
-  // vector to return constraints
-  std::vector<std::string> result;
-
-  // Symbol table for looking up current version of a variable (similar to SSA
-  // form but LLVM doesn't always work well
-  // with loops for this). This is mostly to deal with the presence of loops
-  // std::map<std::string, int> VarSymbolTable;
-
-  // push the main state on the stateStack
-  stateStack.push(new State);
-
-  // Start of python z3 python script
-  result.push_back("from z3 import *\n");
-  result.push_back("import " + model_library_name + " as " +
-                   model_library_prefix + "\n");
-  result.push_back("g = Goal()\n\n");
-
-  std::string currBB, prevBB, nextBB, currFunc;
-
-  int pythonStmtCt = 0;
-
-  // For each instruction in inlined trace
-  for (int i = 0; i < trace.size(); i++) {
+// Struct for tracking the incremental solver that checks
+// the path for contradictions while it is being generated
+typedef struct checker {
+  pid_t pid;
+  // Pipes to and from the checker process
+  FILE *to;
+  FILE *from;
+  // Number of conditional branches sent to the checker
+  int branchCt;
+} Checker;
+
+Checker feasibilityChecker = {-1, NULL, NULL, 0};
+
+// Why the path being generated cannot be modeled (e.g. the checker
+// found it infeasible), "" while it can. Generation stops at the first
+// error and the caller reports it
+std::string pathError;
+
+// Start the checker process (see scripts/incremental_check.py). A
+// missing checker script is a path error: the check was asked for
+void StartChecker() {
+  if (access(CheckerScript.c_str(), R_OK) != 0) {
+    pathError = "Cannot find the feasibility checker " +
+                std::string(CheckerScript) + " (see -cfcount-checker)";
+    return;
+  }
+  int toChild[2], fromChild[2];
+  if (pipe(toChild) != 0 || pipe(fromChild) != 0) {
+    print_error("StartChecker Error: Cannot create pipes\n");
+    return;
+  }
 
-    currBB = trace[i]->getParent()->getName().str();
-    currFunc = trace[i]->getParent()->getParent()->getName().str();
+  pid_t pid = fork();
+  if (pid == 0) {
+    dup2(toChild[0], 0);
+    dup2(fromChild[1], 1);
+    close(toChild[1]);
+    close(fromChild[0]);
+    execlp(PythonPath.c_str(), PythonPath.c_str(), CheckerScript.c_str(),
+           CheckerModels.c_str(), (char *)NULL);
+    _exit(127);
+  }
+  close(toChild[0]);
+  close(fromChild[1]);
+  if (pid < 0) {
+    print_error("StartChecker Error: Cannot start checker\n");
+    close(toChild[1]);
+    close(fromChild[0]);
+    return;
+  }
 
-    // Find the prev bb in trace
-    for (int j = i; j >= 0; j--) {
-      std::string bbName = trace[j]->getParent()->getName().str();
-      std::string funcName =
-          trace[j]->getParent()->getParent()->getName().str();
-      if (bbName != currBB && currFunc == funcName) {
-        prevBB = bbName;
-        break;
-      }
-    }
+  feasibilityChecker.pid = pid;
+  feasibilityChecker.to = fdopen(toChild[1], "w");
+  feasibilityChecker.from = fdopen(fromChild[0], "r");
+  feasibilityChecker.branchCt = 0;
+}
 
-    // Find the next BB in trace
-    for (int j = i; j < trace.size(); j++) {
-      std::string bbName = trace[j]->getParent()->getName().str();
-      std::string funcName =
-          trace[j]->getParent()->getParent()->getName().str();
-      if (bbName != currBB && currFunc == funcName) {
-        nextBB = bbName;
-        break;
+// Block SIGPIPE in this thread while writing to the checker, so a write
+// to a checker that died fails with EPIPE instead of killing the process.
+// A SIGPIPE raised by such a write is discarded when the block ends,
+// unless the thread had SIGPIPE blocked already
+class CheckerPipeGuard {
+public:
+  CheckerPipeGuard() {
+    sigemptyset(&pipeSet);
+    sigaddset(&pipeSet, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipeSet, &oldSet);
+  }
+  ~CheckerPipeGuard() {
+    if (!sigismember(&oldSet, SIGPIPE)) {
+      sigset_t pending;
+      sigpending(&pending);
+      if (sigismember(&pending, SIGPIPE)) {
+        int sig;
+        sigwait(&pipeSet, &sig);
       }
     }
+    pthread_sigmask(SIG_SETMASK, &oldSet, NULL);
+  }
 
-    // Get the current instructions constraints
-    std::string instConst = GetInstConstraint(trace[i], prevBB, nextBB);
+private:
+  sigset_t pipeSet, oldSet;
+};
 
-    if (instConst != "") {
-      llvm::errs() << "'''\n";
-      trace[i]->dump();
-      llvm::errs() << "'''\n";
-      llvm::errs() << instConst << "\n\n";
-      result.push_back(instConst);
-    }
+// Stop the checker process
+void StopChecker() {
+  if (feasibilityChecker.pid == -1) {
+    return;
   }
-
-  return result;
+  {
+    CheckerPipeGuard guard;
+    fclose(feasibilityChecker.to);
+  }
+  fclose(feasibilityChecker.from);
+  waitpid(feasibilityChecker.pid, NULL, 0);
+  feasibilityChecker.pid = -1;
 }
 
-// Get a vector of the instructions executed on the path being
-// modeled (in the order they are executed)
-std::vector<Instruction *> GetInlinedInstructionOrder(
-    std::vector<std::string> &bb_trace,
-    std::map<std::string, std::map<std::string, CFGNode *> > &FunctionCFGMap) {
-
-  std::vector<Instruction *> result;
-
-  int curr_bb_idx = 0;
+// Write to the checker, flushing with flush. A checker that died is
+// reported and stopped: the rest of the path is generated unchecked
+bool WriteChecker(const std::string &text, bool flush) {
+  bool written;
+  int writeError;
+  {
+    CheckerPipeGuard guard;
+    written = fputs(text.c_str(), feasibilityChecker.to) != EOF &&
+              (!flush || fflush(feasibilityChecker.to) == 0);
+    writeError = errno;
+  }
+  if (!written) {
+    print_error("Checker Error: Checker died (" +
+                std::string(strerror(writeError)) + ")\n");
+    StopChecker();
+  }
+  return written;
+}
 
-  // Stack used for tracking w
-  std::stack<std::pair<std::string, int> > bb_stack;
+// Ask the checker if the constraints sent so far are satisfiable.
+// Sets pathError to the first contradicting branch if they are not
+void CheckFeasibility() {
+  if (feasibilityChecker.pid == -1) {
+    return;
+  }
+  if (!WriteChecker("%%check\n", true)) {
+    return;
+  }
 
-  // push the first bb on the stack
-  bb_stack.push(std::pair<std::string, int>(bb_trace[curr_bb_idx], 0));
+  char reply[4096];
+  if (fgets(reply, sizeof(reply), feasibilityChecker.from) == NULL) {
+    print_error("CheckFeasibility Error: Checker died\n");
+    StopChecker();
+    return;
+  }
+  std::string answer(reply);
+  if (answer.find("unsat") == 0) {
+    StopChecker();
+    pathError = "Path is infeasible under the bounds file, first "
+                "contradicting branch: " +
+                answer.substr(6, answer.find("\n") - 6);
+  }
+}
 
-  // Build a list containt the order of BB's executed
-  std::vector<std::string> temp;
-  for (int i = 0; i < bb_trace.size(); i++) {
-    temp.push_back(bb_trace[i] + "*" + std::to_string(i));
+// Send the constraints of an instruction to the checker. Branches are
+// labeled so the checker can report them, and trigger a check every
+// CheckEvery branches
+void FeedChecker(std::string constraints, Instruction *inst,
+                 std::string nextBB) {
+  if (feasibilityChecker.pid == -1) {
+    return;
+  }
+  if (!WriteChecker(constraints, false)) {
+    return;
   }
-  bb_trace = temp;
 
-  // Keep track of what BBs have already started execution
-  // (used to handle function calls)
-  std::map<std::string, bool> AlreadyStartedMap;
-  for (int i = 0; i < bb_trace.size(); i++) {
-    AlreadyStartedMap[bb_trace[i]] = false;
+  BranchInst *bi = inst ? dyn_cast<BranchInst>(inst) : NULL;
+  if ((bi && bi->getNumSuccessors() == 2) || (inst && isa<SwitchInst>(inst))) {
+    feasibilityChecker.branchCt++;
+    std::string desc = "#" + std::to_string(feasibilityChecker.branchCt) +
+                       " " + inst->getParent()->getName().str() + " -> " +
+                       nextBB;
+    if (!WriteChecker("\n%%branch " + desc + "\n", false)) {
+      return;
+    }
+    if (feasibilityChecker.branchCt % CheckEvery == 0) {
+      CheckFeasibility();
+    }
+  } else {
+    WriteChecker("\n%%exec\n", false);
   }
+}
 
-  while (!bb_stack.empty()) {
+// Struct for tracking the known value of a Z3 variable
+// that does not depend on any input
+typedef struct concreteVal {
+  APInt val;
+  // If the variable was declared as a Z3 Bool
+  bool isBool;
+} ConcreteVal;
+
+// Concrete values of Z3 variables, indexed by Z3 variable name
+std::map<std::string, ConcreteVal> concreteVals;
+
+// Get the concrete value of an operand (constant or Z3 variable with
+// a known value). Unlike GetVarName, a missing variable is not an error
+bool GetConcreteOperand(Value *op, APInt *val) {
+  if (ConstantInt *ci = dyn_cast<ConstantInt>(op)) {
+    *val = ci->getValue();
+    return true;
+  }
 
-    // Get the instruction set of the basic block currently
-    // being executed in the trace and find the next
-    // instruction that was executed in the trace
-    std::string curr_bb = bb_stack.top().first;
-    int inst_loc = bb_stack.top().second;
-    size_t funcNameEnds = curr_bb.find("_");
-    std::string func_name = curr_bb.substr(0, funcNameEnds);
-    std::vector<Instruction *> instructions =
-        FunctionCFGMap[func_name][curr_bb.substr(0, curr_bb.find("*"))]
-            ->instructions;
+  std::map<std::string, int> *vst = &(stateStack.top()->locals);
+  std::string name = op->getName().str();
+  if (vst->find(name) == vst->end()) {
+    return false;
+  }
+  auto found = concreteVals.find(name + "_" + std::to_string((*vst)[name]));
+  if (found == concreteVals.end()) {
+    return false;
+  }
+  *val = found->second.val;
+  return true;
+}
 
-    // If starting at the beginning of a BB increment
-    // the BB counter
-    if (!AlreadyStartedMap[bb_stack.top().first]) {
-      curr_bb_idx++;
+// Record the concrete value of the Z3 variable just created for an
+// instruction, if all of the values it uses are concrete. Returns if
+// a value was recorded
+bool RecordConcreteValue(Instruction *inst, std::string prevBB) {
+
+  APInt lhs, rhs;
+  ConcreteVal result;
+  result.isBool = false;
+  std::string varName;
+
+  if (StoreInst *si = dyn_cast<StoreInst>(inst)) {
+    // Only stores to allocated integers are tracked
+    if (!isa<AllocaInst>(si->getOperand(1)) ||
+        !si->getOperand(0)->getType()->isIntegerTy() ||
+        !GetConcreteOperand(si->getOperand(0), &lhs)) {
+      return false;
     }
-
-    Instruction *inst;
-    // Increment till the end of the BB's instructions
-    // or till a function call or return occurs
-    for (; inst_loc < instructions.size(); inst_loc++) {
-      inst = instructions[inst_loc];
-      if (CallInst *ci = dyn_cast<CallInst>(inst)) {
-        if (ci->getCalledFunction()->isDeclaration()) {
-          result.push_back(inst);
-        } else {
-          result.push_back(inst);
-          break;
-        }
+    varName = GetVarName(si->getOperand(1)->getName().str());
+    result.val = lhs;
+  } else if (LoadInst *li = dyn_cast<LoadInst>(inst)) {
+    if (!isa<AllocaInst>(li->getOperand(0)) || !li->getType()->isIntegerTy() ||
+        !GetConcreteOperand(li->getOperand(0), &lhs)) {
+      return false;
+    }
+    varName = GetVarName(li->getName().str());
+    result.val = lhs;
+  } else if (BinaryOperator *bo = dyn_cast<BinaryOperator>(inst)) {
+    if (!GetConcreteOperand(bo->getOperand(0), &lhs) ||
+        !GetConcreteOperand(bo->getOperand(1), &rhs)) {
+      return false;
+    }
+    switch (bo->getOpcode()) {
+    case Instruction::Add:
+      result.val = lhs + rhs;
+      break;
+    case Instruction::Sub:
+      result.val = lhs - rhs;
+      break;
+    case Instruction::Mul:
+      result.val = lhs * rhs;
+      break;
+    case Instruction::UDiv:
+    case Instruction::SDiv:
+    case Instruction::URem:
+    case Instruction::SRem:
+      if (rhs == 0) {
+        return false;
+      }
+      if (bo->getOpcode() == Instruction::UDiv) {
+        result.val = lhs.udiv(rhs);
+      } else if (bo->getOpcode() == Instruction::SDiv) {
+        result.val = lhs.sdiv(rhs);
+      } else if (bo->getOpcode() == Instruction::URem) {
+        result.val = lhs.urem(rhs);
       } else {
-        result.push_back(inst);
+        result.val = lhs.srem(rhs);
       }
+      break;
+    default:
+      return false;
     }
-
-    // If a call inst occurs remember where we left
-    // off in the BB that makes the call and push the
-    // new BB on the stack
-    if (CallInst *ci = dyn_cast<CallInst>(inst)) {
-      bb_stack.top().second = inst_loc + 1;
-      bb_stack.push(std::pair<std::string, int>(bb_trace[curr_bb_idx], 0));
+    varName = GetVarName(bo->getName().str());
+  } else if (ICmpInst *ci = dyn_cast<ICmpInst>(inst)) {
+    if (!GetConcreteOperand(ci->getOperand(0), &lhs) ||
+        !GetConcreteOperand(ci->getOperand(1), &rhs)) {
+      return false;
     }
-    // If a return occurs pop off the last BB of current function
-    // being executed in the trace
-    else if (ReturnInst *ri = dyn_cast<ReturnInst>(inst)) {
-      bb_stack.pop();
+    bool cmp;
+    switch (ci->getPredicate()) {
+    case CmpInst::ICMP_EQ:
+      cmp = lhs == rhs;
+      break;
+    case CmpInst::ICMP_NE:
+      cmp = lhs != rhs;
+      break;
+    case CmpInst::ICMP_SGT:
+      cmp = lhs.sgt(rhs);
+      break;
+    case CmpInst::ICMP_SGE:
+      cmp = lhs.sge(rhs);
+      break;
+    case CmpInst::ICMP_SLT:
+      cmp = lhs.slt(rhs);
+      break;
+    case CmpInst::ICMP_SLE:
+      cmp = lhs.sle(rhs);
+      break;
+    default:
+      return false;
     }
-    // If the BB compeletes
-    else {
-      bb_stack.pop();
-      bb_stack.push(std::pair<std::string, int>(bb_trace[curr_bb_idx], 0));
+    varName = GetVarName(ci->getName().str());
+    result.val = APInt(1, cmp);
+    result.isBool = true;
+  } else if (PHINode *pn = dyn_cast<PHINode>(inst)) {
+    if (!pn->getType()->isIntegerTy()) {
+      return false;
     }
-
-    // mark the current BB as being started
-    AlreadyStartedMap[curr_bb] = true;
+    bool found = false;
+    for (int i = 0; i < pn->getNumIncomingValues(); i++) {
+      if (pn->getIncomingBlock(i)->getName().str() == prevBB) {
+        found = GetConcreteOperand(pn->getIncomingValue(i), &lhs);
+      }
+    }
+    if (!found) {
+      return false;
+    }
+    varName = GetVarName(pn->getName().str());
+    result.val = lhs;
+  } else if (SExtInst *si = dyn_cast<SExtInst>(inst)) {
+    if (!si->getType()->isIntegerTy() ||
+        !GetConcreteOperand(si->getOperand(0), &lhs)) {
+      return false;
+    }
+    varName = GetVarName(si->getName().str());
+    result.val = lhs.sext(si->getType()->getIntegerBitWidth());
+  } else if (TruncInst *ti = dyn_cast<TruncInst>(inst)) {
+    if (!ti->getType()->isIntegerTy() ||
+        !GetConcreteOperand(ti->getOperand(0), &lhs)) {
+      return false;
+    }
+    varName = GetVarName(ti->getName().str());
+    result.val = lhs.trunc(ti->getType()->getIntegerBitWidth());
+  } else {
+    return false;
   }
 
-  return result;
+  concreteVals[varName] = result;
+  return true;
 }
 
-// Create the Z3Py file that generates a SAT formula
-// (in Z3's format) of the path in the program's
-// execution
-void CreateZ3PyFile(std::vector<std::string> result) {
+// Execute an instruction with concrete values only, creating its Z3
+// variable the same way GetInstConstraint would but without generating
+// any constraints. Returns false if the instruction depends on a
+// non-concrete value or does not follow the trace
+bool SimulateConcreteInst(Instruction *inst, std::string prevBB,
+                          std::string nextBB,
+                          std::vector<std::string> *created) {
 
-  std::ofstream z3_file(Z3Filename);
+  ++NumInstsWalked;
 
-  // Write each constraint to the file that
-  // encodes the behavior of the path
-  // being modeled
-  for (int i = 0; i < result.size(); i++) {
-    z3_file << result[i];
+  if (BranchInst *bi = dyn_cast<BranchInst>(inst)) {
+    if (bi->getNumSuccessors() == 1) {
+      return true;
+    }
+    APInt cond;
+    if (!GetConcreteOperand(bi->getOperand(0), &cond)) {
+      return false;
+    }
+    // The concrete branch has to go where the trace goes
+    return cond.getBoolValue() ==
+           (bi->getOperand(2)->getName().str() == nextBB);
   }
-  z3_file << "\n";
-
-  // Add code to the Z3Py file that bit-blasts the SMT formula,
-  // and then prints its corresponding SAT formula (in Z3's
-  // internal SAT format)
-  z3_file << "t = Then('simplify', 'bit-blast', 'tseitin-cnf')\n";
-  z3_file << "subgoal = t(g)\n";
-  z3_file << "assert len(subgoal) == 1\n";
-  z3_file << "print subgoal[0].sexpr()\n";
 
-  z3_file.close();
-}
-
-namespace {
-struct Hello2 : public ModulePass {
-  static char ID; // Pass identification, replacement for typeid
-  Hello2() : ModulePass(ID) {}
-
-  bool runOnModule(Module &m) override {
+  if (SwitchInst *si = dyn_cast<SwitchInst>(inst)) {
+    APInt cond;
+    if (!GetConcreteOperand(si->getCondition(), &cond)) {
+      return false;
+    }
+    BasicBlock *dest = si->getDefaultDest();
+    for (auto c : si->cases()) {
+      if (c.getCaseValue()->getValue() == cond) {
+        dest = c.getCaseSuccessor();
+        break;
+      }
+    }
+    return dest->getName().str() == nextBB;
+  }
 
-    std::map<std::string, std::map<std::string, CFGNode *> > FunctionCFGMap;
+  if (CallInst *ci = dyn_cast<CallInst>(inst)) {
+    // Library calls with no impact on state (e.g. printf)
+    auto model = libCallTable.find(ci->getCalledFunction());
+    return model != libCallTable.end() && model->second->noEffect;
+  }
 
-    // Create global pointer to the module to avoid
-    // expenseive parameter passing
-    mod_ptr = &m;
+  // Name of the LLVM variable that gets a new Z3 variable
+  std::string name;
+  if (StoreInst *si = dyn_cast<StoreInst>(inst)) {
+    if (!isa<AllocaInst>(si->getOperand(1))) {
+      return false;
+    }
+    name = si->getOperand(1)->getName().str();
+  } else if (isa<LoadInst>(inst) || isa<BinaryOperator>(inst) ||
+             isa<ICmpInst>(inst) || isa<PHINode>(inst) ||
+             isa<SExtInst>(inst) || isa<TruncInst>(inst)) {
+    name = inst->getName().str();
+  } else {
+    return false;
+  }
 
-    // Get the trace being modeled
-    std::vector<std::string> bb_trace = get_trace();
+  created->push_back(CreateVarName(name));
+  return RecordConcreteValue(inst, prevBB);
+}
 
-    // Change names of bbs, instructions and parameters
-    // (makes debugging easier)
-    rename_bbs();
-    rename_insts();
-    rename_func_params();
-    get_bounds();
+// Get the constraints of an instruction and add them
+// to the constraints of the trace
+void EmitInstConstraint(Instruction *inst, std::string prevBB,
+                        std::string nextBB, std::vector<std::string> *result) {
+
+  // Get the current instructions constraints
+  std::string instConst = GetInstConstraint(inst, prevBB, nextBB);
+  RecordConcreteValue(inst, prevBB);
+  ++NumInstsWalked;
+
+  if (instConst != "") {
+    ++NumConstraints;
+    if (isa<BranchInst>(inst) || isa<SwitchInst>(inst)) {
+      ++NumBranchConstraints;
+    } else if (isa<AllocaInst>(inst) || isa<GetElementPtrInst>(inst) ||
+               isa<LoadInst>(inst) || isa<StoreInst>(inst)) {
+      ++NumMemoryConstraints;
+    } else if (isa<BinaryOperator>(inst)) {
+      ++NumArithConstraints;
+    } else if (isa<CmpInst>(inst)) {
+      ++NumCmpConstraints;
+    } else if (isa<SExtInst>(inst) || isa<TruncInst>(inst)) {
+      ++NumCastConstraints;
+    } else if (isa<PHINode>(inst)) {
+      ++NumPHIConstraints;
+    } else if (isa<CallInst>(inst) || isa<ReturnInst>(inst)) {
+      ++NumCallConstraints;
+    }
+    llvm::errs() << "'''\n";
+    inst->dump();
+    llvm::errs() << "'''\n";
+    llvm::errs() << instConst << "\n\n";
+    result->push_back(instConst);
+    FeedChecker(instConst, inst, nextBB);
+  }
+}
 
-    // Build a nested map for looking up BB's corresponding CFGNode
-    // For ex. to find the CFG for bb1 in func1 use: FunctionCFGMap[func1][bb1]
-    BuildFunctionCFGMap(&FunctionCFGMap);
+// A value of a loop iteration as a constant plus a linear combination of
+// Z3 variables that are set before the loop. "@<name>" stands for the
+// value of an allocated variable at the start of the iteration
+typedef struct linearForm {
+  APInt constant;
+  std::map<std::string, APInt> terms;
+} LinearForm;
+
+LinearForm ConstantForm(const APInt &val) {
+  LinearForm result;
+  result.constant = val;
+  return result;
+}
 
-    // Get a vector of the instructions executed on the path being
-    // modeled (in the order they are executed)
-    std::vector<Instruction *> instructionOrder =
-        GetInlinedInstructionOrder(bb_trace, FunctionCFGMap);
+LinearForm AddForms(const LinearForm &a, const LinearForm &b,
+                    const APInt &scale) {
+  LinearForm result = a;
+  result.constant += b.constant * scale;
+  for (auto it = b.terms.begin(); it != b.terms.end(); ++it) {
+    auto found = result.terms.find(it->first);
+    if (found == result.terms.end()) {
+      result.terms[it->first] = it->second * scale;
+    } else if ((found->second += it->second * scale) == 0) {
+      result.terms.erase(found);
+    }
+  }
+  return result;
+}
 
-    // Get the Z3 constraints the encode the behavior of the
-    // program path being modeled
-    std::vector<std::string> result =
-        GetTraceConstraints(&FunctionCFGMap, instructionOrder);
+bool IsConstantForm(const LinearForm &form) { return form.terms.empty(); }
 
+// Z3 expression of a form
+std::string FormToZ3(const LinearForm &form) {
+  std::string result;
+  for (auto it = form.terms.begin(); it != form.terms.end(); ++it) {
+    if (result != "") {
+      result += " + ";
+    }
+    if (it->second == 1) {
+      result += it->first;
+    } else {
+      result += std::to_string(it->second.getSExtValue()) + " * " + it->first;
+    }
+  }
+  if (result == "") {
+    return std::to_string(form.constant.getSExtValue());
+  }
+  if (form.constant != 0) {
+    result += " + " + std::to_string(form.constant.getSExtValue());
+  }
+  if (form.terms.size() == 1 && form.constant == 0 &&
+      form.terms.begin()->second == 1) {
+    return result;
+  }
+  return "(" + result + ")";
+}
+
+// Form of a Z3 variable set before the loop, a constant if its value is
+// concrete
+LinearForm EntryForm(const std::string &z3Name, unsigned width) {
+  auto found = concreteVals.find(z3Name);
+  if (found != concreteVals.end()) {
+    return ConstantForm(found->second.val);
+  }
+  LinearForm result = ConstantForm(APInt(width, 0));
+  result.terms[z3Name] = APInt(width, 1);
+  return result;
+}
+
+// Signed or equality compare of two constants
+bool CompareConstants(CmpInst::Predicate pred, const APInt &lhs,
+                      const APInt &rhs) {
+  switch (pred) {
+  case CmpInst::ICMP_EQ:
+    return lhs == rhs;
+  case CmpInst::ICMP_NE:
+    return lhs != rhs;
+  case CmpInst::ICMP_SGT:
+    return lhs.sgt(rhs);
+  case CmpInst::ICMP_SGE:
+    return lhs.sge(rhs);
+  case CmpInst::ICMP_SLT:
+    return lhs.slt(rhs);
+  default:
+    return lhs.sle(rhs);
+  }
+}
+
+// Constraint that pred(lhs_k, rhs_k) holds for every iteration k < iters,
+// where each side is base + k * step. Only shapes with an exact constant
+// size encoding are handled: a side that does not change against a
+// side of concrete values (their extreme or their range), or two sides
+// that do not change. Returns false for others
+bool SummarizeCmp(CmpInst::Predicate pred, LinearForm lhs, LinearForm lhsStep,
+                  LinearForm rhs, LinearForm rhsStep, uint64_t iters,
+                  std::string *result) {
+  unsigned width = lhs.constant.getBitWidth();
+  bool lhsFixed = IsConstantForm(lhsStep) && lhsStep.constant == 0;
+  bool rhsFixed = IsConstantForm(rhsStep) && rhsStep.constant == 0;
+
+  // Keep the changing side on the left
+  if (lhsFixed && !rhsFixed) {
+    std::swap(lhs, rhs);
+    std::swap(lhsStep, rhsStep);
+    std::swap(lhsFixed, rhsFixed);
+    pred = CmpInst::getSwappedPredicate(pred);
+  }
+
+  std::string op;
+  switch (pred) {
+  case CmpInst::ICMP_EQ:
+    op = "==";
+    break;
+  case CmpInst::ICMP_NE:
+    op = "!=";
+    break;
+  case CmpInst::ICMP_SGT:
+    op = ">";
+    break;
+  case CmpInst::ICMP_SGE:
+    op = ">=";
+    break;
+  case CmpInst::ICMP_SLT:
+    op = "<";
+    break;
+  case CmpInst::ICMP_SLE:
+    op = "<=";
+    break;
+  default:
+    return false;
+  }
+
+  // The same comparison in every iteration
+  if (lhsFixed && rhsFixed) {
+    if (IsConstantForm(lhs) && IsConstantForm(rhs)) {
+      return CompareConstants(pred, lhs.constant, rhs.constant);
+    }
+    *result = "g.add(" + FormToZ3(lhs) + " " + op + " " + FormToZ3(rhs) + ")\n";
+    return true;
+  }
+  if (!rhsFixed || !IsConstantForm(lhs) || !IsConstantForm(lhsStep)) {
+    return false;
+  }
+
+  // Concrete values on the left: they must not wrap around, so their
+  // extremes are the first and the last one
+  APInt first = lhs.constant, step = lhsStep.constant;
+  APInt wideFirst = first.sext(width + 64);
+  APInt wideLast =
+      wideFirst + step.sext(width + 64) * APInt(width + 64, iters - 1);
+  APInt last = wideLast.trunc(width);
+  if (last.sext(width + 64) != wideLast) {
+    return false;
+  }
+  APInt min = first.slt(last) ? first : last;
+  APInt max = first.slt(last) ? last : first;
+
+  if (IsConstantForm(rhs)) {
+    for (uint64_t k = 0; k < iters; k++) {
+      if (!CompareConstants(pred, first + step * APInt(width, k),
+                            rhs.constant)) {
+        return false;
+      }
+    }
+    *result = "";
+    return true;
+  }
+
+  std::string rhsZ3 = FormToZ3(rhs);
+  std::string bound;
+  switch (pred) {
+  case CmpInst::ICMP_SLT:
+  case CmpInst::ICMP_SLE:
+    bound = std::to_string(max.getSExtValue());
+    break;
+  case CmpInst::ICMP_SGT:
+  case CmpInst::ICMP_SGE:
+    bound = std::to_string(min.getSExtValue());
+    break;
+  case CmpInst::ICMP_NE:
+    // Consecutive values are a range, checked as in switches
+    if (step != 1 && !step.isAllOnesValue()) {
+      return false;
+    }
+    *result = "g.add(Not(ULE(" + rhsZ3 + " - " +
+              std::to_string(min.getSExtValue()) + ", " +
+              std::to_string(iters - 1) + ")))\n";
+    return true;
+  default:
+    // Changing values are never all equal to the same value
+    return false;
+  }
+  *result = "g.add(" + bound + " " + op + " " + rhsZ3 + ")\n";
+  return true;
+}
+
+// Generate the iterations of a loop run but the last one in closed form.
+// The allocated variables the body changes must be induction variables
+// (each iteration adds the same loop invariant value, as the add
+// recurrences of ScalarEvolution) or be set to a loop invariant value,
+// so their value after k iterations is known. Each compare a branch of
+// the body depends on is then summarized over all of these iterations
+// (see SummarizeCmp) and the variables are set to their value before the
+// last iteration, which is generated as usual. Returns false, having
+// generated nothing, if the body does anything else
+bool SummarizeLoopRun(TraceRun &run, std::vector<Instruction *> &planInsts,
+                      std::vector<int> &planBlocks,
+                      std::vector<std::string> *result) {
+  if (run.count < 3) {
+    return false;
+  }
+  uint64_t iters = run.count - 1;
+  int lastIdx = run.cycle.size() - 1;
+  Function *func = planInsts[0]->getParent()->getParent();
+
+  // Variables stored to by the body
+  std::set<AllocaInst *> stored;
+  for (int k = 0; k < planInsts.size(); k++) {
+    if (StoreInst *si = dyn_cast<StoreInst>(planInsts[k])) {
+      if (AllocaInst *ai = dyn_cast<AllocaInst>(si->getOperand(1))) {
+        stored.insert(ai);
+      }
+    }
+  }
+
+  // Run one iteration over forms
+  std::map<Value *, LinearForm> values;
+  std::map<AllocaInst *, LinearForm> current;
+  std::set<AllocaInst *> readAtStart;
+  // Each branch of the body with the direction it took and the forms of
+  // its compare there. A BB can appear more than once in the body, so
+  // the forms are taken at the branch and not looked up at the end
+  struct BodyBranch {
+    ICmpInst *cmp;
+    bool taken;
+    LinearForm lhs, rhs;
+  };
+  std::vector<BodyBranch> branches;
+  // Compares of the body. Their results are only known to branches, a
+  // compare used as a value gives up on the summary
+  std::set<ICmpInst *> compares;
+  std::map<std::string, int> *vst = &(stateStack.top()->locals);
+  auto formOf = [&](Value *v, LinearForm *form) {
+    if (ConstantInt *c = dyn_cast<ConstantInt>(v)) {
+      *form = ConstantForm(c->getValue());
+      return true;
+    }
+    auto found = values.find(v);
+    if (found != values.end()) {
+      *form = found->second;
+      return true;
+    }
+    std::string name = v->getName().str();
+    if (isa<Instruction>(v) || vst->find(name) == vst->end() ||
+        !v->getType()->isIntegerTy()) {
+      return false;
+    }
+    *form = EntryForm(GetVarName(name), v->getType()->getIntegerBitWidth());
+    return true;
+  };
+
+  for (int k = 0; k < planInsts.size(); k++) {
+    Instruction *inst = planInsts[k];
+    if (inst->getParent()->getParent() != func) {
+      return false;
+    }
+    if (inst->getType()->isIntegerTy() &&
+        inst->getType()->getIntegerBitWidth() > 64) {
+      return false;
+    }
+    LinearForm lhs, rhs;
+
+    if (LoadInst *li = dyn_cast<LoadInst>(inst)) {
+      AllocaInst *ai = dyn_cast<AllocaInst>(li->getOperand(0));
+      if (!ai || !li->getType()->isIntegerTy()) {
+        return false;
+      }
+      unsigned width = li->getType()->getIntegerBitWidth();
+      if (current.count(ai)) {
+        values[li] = current[ai];
+      } else if (stored.count(ai)) {
+        readAtStart.insert(ai);
+        values[li] = ConstantForm(APInt(width, 0));
+        values[li].terms["@" + ai->getName().str()] = APInt(width, 1);
+      } else if (vst->find(ai->getName().str()) != vst->end()) {
+        values[li] = EntryForm(GetVarName(ai->getName().str()), width);
+      } else {
+        return false;
+      }
+    } else if (StoreInst *si = dyn_cast<StoreInst>(inst)) {
+      AllocaInst *ai = dyn_cast<AllocaInst>(si->getOperand(1));
+      if (!ai || !formOf(si->getOperand(0), &lhs)) {
+        return false;
+      }
+      current[ai] = lhs;
+    } else if (BinaryOperator *bo = dyn_cast<BinaryOperator>(inst)) {
+      if (!formOf(bo->getOperand(0), &lhs) || !formOf(bo->getOperand(1), &rhs)) {
+        return false;
+      }
+      unsigned width = bo->getType()->getIntegerBitWidth();
+      switch (bo->getOpcode()) {
+      case Instruction::Add:
+        values[bo] = AddForms(lhs, rhs, APInt(width, 1));
+        break;
+      case Instruction::Sub:
+        values[bo] = AddForms(lhs, rhs, APInt::getAllOnesValue(width));
+        break;
+      case Instruction::Mul:
+        if (IsConstantForm(rhs)) {
+          values[bo] = AddForms(ConstantForm(APInt(width, 0)), lhs, rhs.constant);
+        } else if (IsConstantForm(lhs)) {
+          values[bo] = AddForms(ConstantForm(APInt(width, 0)), rhs, lhs.constant);
+        } else {
+          return false;
+        }
+        break;
+      case Instruction::Shl:
+        if (!IsConstantForm(rhs) || rhs.constant.uge(width)) {
+          return false;
+        }
+        values[bo] =
+            AddForms(ConstantForm(APInt(width, 0)), lhs,
+                     APInt(width, 1).shl(rhs.constant.getZExtValue()));
+        break;
+      default:
+        return false;
+      }
+    } else if (ICmpInst *ci = dyn_cast<ICmpInst>(inst)) {
+      if (!formOf(ci->getOperand(0), &lhs) || !formOf(ci->getOperand(1), &rhs)) {
+        return false;
+      }
+      compares.insert(ci);
+    } else if (BranchInst *bi = dyn_cast<BranchInst>(inst)) {
+      if (bi->getNumSuccessors() == 1) {
+        continue;
+      }
+      ICmpInst *ci = dyn_cast<ICmpInst>(bi->getOperand(0));
+      if (!ci || !compares.count(ci)) {
+        return false;
+      }
+      int b = planBlocks[k];
+      std::string nextBB = b < lastIdx ? run.cycle[b + 1] : run.cycle[0];
+      BodyBranch branch;
+      branch.cmp = ci;
+      branch.taken = bi->getOperand(2)->getName().str() == nextBB;
+      formOf(ci->getOperand(0), &branch.lhs);
+      formOf(ci->getOperand(1), &branch.rhs);
+      branches.push_back(branch);
+    } else if (CallInst *ci = dyn_cast<CallInst>(inst)) {
+      auto model = libCallTable.find(ci->getCalledFunction());
+      if (model == libCallTable.end() || !model->second->noEffect) {
+        return false;
+      }
+    } else {
+      return false;
+    }
+  }
+
+  // Each changed variable starts at its value before the loop and grows
+  // by its step, or keeps the value the body sets (then it must not be
+  // read before it is set)
+  std::map<std::string, LinearForm> starts, steps;
+  for (auto it = current.begin(); it != current.end(); ++it) {
+    std::string name = it->first->getName().str();
+    const LinearForm &form = it->second;
+    unsigned width = form.constant.getBitWidth();
+    if (vst->find(name) == vst->end()) {
+      return false;
+    }
+    starts["@" + name] = EntryForm(GetVarName(name), width);
+    LinearForm step = form;
+    auto self = step.terms.find("@" + name);
+    if (self != step.terms.end() && self->second == 1) {
+      step.terms.erase(self);
+    } else if (self == step.terms.end() && !readAtStart.count(it->first)) {
+      // The value set must be loop invariant: not read from a variable
+      // the body changes
+      for (auto t = form.terms.begin(); t != form.terms.end(); ++t) {
+        if (t->first[0] == '@') {
+          return false;
+        }
+      }
+      step = ConstantForm(APInt(width, 0));
+      starts["@" + name] = form;
+    } else {
+      return false;
+    }
+    for (auto t = step.terms.begin(); t != step.terms.end(); ++t) {
+      if (t->first[0] == '@') {
+        return false;
+      }
+    }
+    steps["@" + name] = step;
+  }
+
+  // Split a form of the body into its value in the first iteration and
+  // its step
+  auto expand = [&](const LinearForm &form, LinearForm *base,
+                    LinearForm *step) {
+    unsigned width = form.constant.getBitWidth();
+    *base = ConstantForm(form.constant);
+    *step = ConstantForm(APInt(width, 0));
+    for (auto t = form.terms.begin(); t != form.terms.end(); ++t) {
+      if (t->first[0] != '@') {
+        LinearForm term = ConstantForm(APInt(width, 0));
+        term.terms[t->first] = t->second;
+        *base = AddForms(*base, term, APInt(width, 1));
+      } else {
+        *base = AddForms(*base, starts[t->first], t->second);
+        *step = AddForms(*step, steps[t->first], t->second);
+      }
+    }
+  };
+
+  std::vector<std::string> summary;
+  for (int i = 0; i < branches.size(); i++) {
+    ICmpInst *ci = branches[i].cmp;
+    LinearForm lhsBase, lhsStep, rhsBase, rhsStep;
+    expand(branches[i].lhs, &lhsBase, &lhsStep);
+    expand(branches[i].rhs, &rhsBase, &rhsStep);
+    CmpInst::Predicate pred = branches[i].taken
+                                  ? ci->getPredicate()
+                                  : ci->getInversePredicate();
+    std::string constraint;
+    if (!SummarizeCmp(pred, lhsBase, lhsStep, rhsBase, rhsStep, iters,
+                      &constraint)) {
+      return false;
+    }
+    if (constraint != "") {
+      summary.push_back(constraint);
+    }
+  }
+
+  print_error("Summarizing " + std::to_string(iters) +
+              " iterations of a loop run\n");
+  ++NumLoopRunsSummarized;
+
+  // The changed variables before the last iteration
+  for (auto it = current.begin(); it != current.end(); ++it) {
+    std::string name = it->first->getName().str();
+    const LinearForm &start = starts["@" + name];
+    const LinearForm &step = steps["@" + name];
+    unsigned width = start.constant.getBitWidth();
+    LinearForm value = AddForms(start, step, APInt(width, iters));
+    std::string varName = CreateVarName(name);
+    summary.push_back(varName + " = BitVec('" + varName + "', " +
+                      std::to_string(width) + ")\ng.add(" + varName + " == " +
+                      FormToZ3(value) + ")\n");
+    if (IsConstantForm(value)) {
+      ConcreteVal cv;
+      cv.val = value.constant;
+      cv.isBool = false;
+      concreteVals[varName] = cv;
+    }
+  }
+
+  for (int i = 0; i < summary.size(); i++) {
+    ++NumConstraints;
+    result->push_back(summary[i]);
+    FeedChecker(summary[i], NULL, "");
+  }
+  return true;
+}
+
+// Generate all iterations of a loop run, entered from entryBB and left
+// to exitBB. The instructions of one iteration and the BBs around them
+// are resolved once, each iteration then only creates new versions of
+// the Z3 variables
+void EmitLoopRun(TraceRun &run, std::vector<Instruction *> &trace,
+                 std::string entryBB, std::string exitBB,
+                 std::vector<std::string> *result) {
+
+  // Resolve the plan for a single iteration: the prev and next BB
+  // of each instruction inside the loop
+  std::vector<Instruction *> planInsts;
+  std::vector<int> planBlocks;
+  int cycleIdx = 0;
+  for (int i = run.startInst; i < run.endInst; i++) {
+    while (cycleIdx + 1 < run.cycleStarts.size() &&
+           i >= run.cycleStarts[cycleIdx + 1]) {
+      cycleIdx++;
+    }
+    planInsts.push_back(trace[i]);
+    planBlocks.push_back(cycleIdx);
+  }
+  int lastIdx = run.cycle.size() - 1;
+
+  // Try to run the whole loop concretely first. If it works, only
+  // the final values of the loop's variables are needed
+  if (SkipConcreteLoops) {
+    std::map<std::string, int> savedLocals = stateStack.top()->locals;
+    std::vector<std::string> created;
+    bool concrete = true;
+
+    for (int it = 0; it < run.count && concrete; it++) {
+      for (int k = 0; k < planInsts.size() && concrete; k++) {
+        int b = planBlocks[k];
+        std::string prevBB = b > 0 ? run.cycle[b - 1]
+                                   : (it == 0 ? entryBB : run.cycle[lastIdx]);
+        std::string nextBB =
+            b < lastIdx ? run.cycle[b + 1]
+                        : (it == run.count - 1 ? exitBB : run.cycle[0]);
+        concrete = SimulateConcreteInst(planInsts[k], prevBB, nextBB, &created);
+      }
+    }
+
+    if (concrete) {
+      print_error("Skipping concrete loop run of " +
+                  std::to_string(run.count) + " iterations\n");
+      // Declare the latest version of each variable the loop changed
+      std::set<std::string> declared;
+      for (int i = created.size() - 1; i >= 0; i--) {
+        std::string name = created[i].substr(0, created[i].rfind("_"));
+        if (declared.count(name)) {
+          continue;
+        }
+        declared.insert(name);
+        ConcreteVal &cv = concreteVals[created[i]];
+        std::string instConst;
+        if (cv.isBool) {
+          instConst = created[i] + " = Bool('" + created[i] + "')\n";
+          instConst += "g.add(" + created[i] + " == " +
+                       (cv.val.getBoolValue() ? "True" : "False") + ")\n";
+          RegisterBool(created[i]);
+        } else {
+          instConst = created[i] + " = BitVec('" + created[i] + "', " +
+                      std::to_string(cv.val.getBitWidth()) + ")\n";
+          instConst += "g.add(" + created[i] + " == " +
+                       std::to_string(cv.val.getSExtValue()) + ")\n";
+        }
+        result->push_back(instConst);
+        FeedChecker(instConst, NULL, "");
+      }
+      return;
+    }
+
+    // Undo the simulation and generate the loop symbolically
+    stateStack.top()->locals = savedLocals;
+    for (int i = 0; i < created.size(); i++) {
+      concreteVals.erase(created[i]);
+    }
+  }
+
+  // Only generate the last iteration if the others have a closed form
+  int firstIt = 0;
+  if (SummarizeLoops && SummarizeLoopRun(run, planInsts, planBlocks, result)) {
+    firstIt = run.count - 1;
+  }
+
+  for (int it = firstIt; it < run.count; it++) {
+    for (int k = 0; k < planInsts.size(); k++) {
+      int b = planBlocks[k];
+      std::string prevBB = b > 0 ? run.cycle[b - 1]
+                                 : (it == 0 ? entryBB : run.cycle[lastIdx]);
+      std::string nextBB = b < lastIdx
+                               ? run.cycle[b + 1]
+                               : (it == run.count - 1 ? exitBB : run.cycle[0]);
+      EmitInstConstraint(planInsts[k], prevBB, nextBB, result);
+    }
+  }
+}
+
+// A unit of constraint generation: a single instruction or a whole
+// loop run, with the BBs executed around it resolved. The constraints
+// of a step only depend on the step and the steps before it
+typedef struct traceStep {
+  Instruction *inst;
+  // BB executed before and after the step (in the same function)
+  std::string prevBB;
+  std::string nextBB;
+  // Index of the loop run the step generates (-1 for an instruction)
+  int run;
+} TraceStep;
+
+// Resolve the steps that generate the constraints of a trace
+std::vector<TraceStep> GetTraceSteps(std::vector<Instruction *> &trace,
+                                     std::vector<TraceRun> &runs) {
+
+  std::vector<TraceStep> result;
+
+  std::string currBB, prevBB, nextBB, currFunc;
+
+  // Next loop run in the trace
+  int runIdx = 0;
+
+  // For each instruction in inlined trace
+  for (int i = 0; i < trace.size(); i++) {
+
+    // Generate all iterations of a loop run at once and
+    // continue after its first iteration
+    if (runIdx < runs.size() && runs[runIdx].startInst == i) {
+      TraceRun &run = runs[runIdx];
+      currFunc = trace[i]->getParent()->getParent()->getName().str();
+
+      // BB executed before the run and BB executed after it
+      TraceStep step = {trace[i], "", "", runIdx};
+      for (int j = run.startInst - 1; j >= 0; j--) {
+        if (trace[j]->getParent()->getParent()->getName().str() == currFunc) {
+          step.prevBB = trace[j]->getParent()->getName().str();
+          break;
+        }
+      }
+      for (int j = run.endInst; j < trace.size(); j++) {
+        if (trace[j]->getParent()->getParent()->getName().str() == currFunc) {
+          step.nextBB = trace[j]->getParent()->getName().str();
+          break;
+        }
+      }
+      result.push_back(step);
+
+      i = run.endInst - 1;
+      runIdx++;
+      continue;
+    }
+
+    currBB = trace[i]->getParent()->getName().str();
+    currFunc = trace[i]->getParent()->getParent()->getName().str();
+
+    // Find the prev bb in trace
+    for (int j = i; j >= 0; j--) {
+      std::string bbName = trace[j]->getParent()->getName().str();
+      std::string funcName =
+          trace[j]->getParent()->getParent()->getName().str();
+      if (bbName != currBB && currFunc == funcName) {
+        prevBB = bbName;
+        break;
+      }
+    }
+
+    // Find the next BB in trace
+    for (int j = i; j < trace.size(); j++) {
+      std::string bbName = trace[j]->getParent()->getName().str();
+      std::string funcName =
+          trace[j]->getParent()->getParent()->getName().str();
+      if (bbName != currBB && currFunc == funcName) {
+        nextBB = bbName;
+        break;
+      }
+    }
+
+    TraceStep step = {trace[i], prevBB, nextBB, -1};
+    result.push_back(step);
+  }
+
+  return result;
+}
+
+// Generate the constraints of a step of a trace
+void EmitTraceStep(TraceStep &step, std::vector<Instruction *> &trace,
+                   std::vector<TraceRun> &runs,
+                   std::vector<std::string> *result) {
+  if (step.run >= 0) {
+    EmitLoopRun(runs[step.run], trace, step.prevBB, step.nextBB, result);
+  } else {
+    EmitInstConstraint(step.inst, step.prevBB, step.nextBB, result);
+  }
+}
+
+// Start the constraints of a path: the main state and the
+// start of the Z3Py script
+void BeginTraceConstraints(std::vector<std::string> *result) {
+
+  // push the main state on the stateStack
+  stateStack.push(new State);
+  pathError = "";
+
+  // Start of python z3 python script
+  result->push_back("from z3 import *\n");
+  result->push_back("import " + model_library_name + " as " +
+                    model_library_prefix + "\n");
+  result->push_back("g = Goal()\n\n");
+}
+
+// Get the Z3 constraints the encode the behavior of the
+// program path being modeled
+std::vector<std::string> GetTraceConstraints(
+    std::map<std::string, std::map<std::string, CFGNode *> > *FunctionCFGMap,
+    std::vector<Instruction *> trace, std::vector<TraceRun> &runs) {
+
+  // vector to return constraints
+  std::vector<std::string> result;
+
+  // Symbol table for looking up current version of a variable (similar to SSA
+  // form but LLVM doesn't always work well
+  // with loops for this). This is mostly to deal with the presence of loops
+  // std::map<std::string, int> VarSymbolTable;
+
+  BeginTraceConstraints(&result);
+
+  // Keep an incremental solver alive to detect infeasible paths early
+  if (CheckEvery > 0) {
+    StartChecker();
+  }
+
+  std::vector<TraceStep> steps = GetTraceSteps(trace, runs);
+  for (int i = 0; i < steps.size() && pathError == ""; i++) {
+    EmitTraceStep(steps[i], trace, runs, &result);
+  }
+
+  // Check whatever was added since the last check
+  CheckFeasibility();
+  StopChecker();
+
+  return result;
+}
+
+// Get a vector of the instructions executed on the path being
+// modeled (in the order they are executed)
+std::vector<Instruction *> GetInlinedInstructionOrder(
+    std::vector<std::string> &bb_trace,
+    std::map<std::string, std::map<std::string, CFGNode *> > &FunctionCFGMap,
+    std::vector<TraceRun> &runs) {
+
+  std::vector<Instruction *> result;
+
+  // Location in result where each BB of the trace starts
+  std::vector<int> blockStarts(bb_trace.size() + 1, -1);
+
+  int curr_bb_idx = 0;
+
+  // Stack used for tracking w
+  std::stack<std::pair<std::string, int> > bb_stack;
+
+  // push the first bb on the stack
+  bb_stack.push(std::pair<std::string, int>(bb_trace[curr_bb_idx], 0));
+
+  // Build a list containt the order of BB's executed
+  std::vector<std::string> temp;
+  for (int i = 0; i < bb_trace.size(); i++) {
+    temp.push_back(bb_trace[i] + "*" + std::to_string(i));
+  }
+  bb_trace = temp;
+
+  // Keep track of what BBs have already started execution
+  // (used to handle function calls)
+  std::map<std::string, bool> AlreadyStartedMap;
+  for (int i = 0; i < bb_trace.size(); i++) {
+    AlreadyStartedMap[bb_trace[i]] = false;
+  }
+
+  while (!bb_stack.empty()) {
+
+    // Get the instruction set of the basic block currently
+    // being executed in the trace and find the next
+    // instruction that was executed in the trace
+    std::string curr_bb = bb_stack.top().first;
+    int inst_loc = bb_stack.top().second;
+    size_t funcNameEnds = curr_bb.find("_");
+    std::string func_name = curr_bb.substr(0, funcNameEnds);
+    std::vector<Instruction *> instructions =
+        FunctionCFGMap[func_name][curr_bb.substr(0, curr_bb.find("*"))]
+            ->instructions;
+
+    // If starting at the beginning of a BB increment
+    // the BB counter
+    if (!AlreadyStartedMap[bb_stack.top().first]) {
+      blockStarts[curr_bb_idx] = result.size();
+      curr_bb_idx++;
+    }
+
+    Instruction *inst;
+    // Increment till the end of the BB's instructions
+    // or till a function call or return occurs
+    for (; inst_loc < instructions.size(); inst_loc++) {
+      inst = instructions[inst_loc];
+      if (CallInst *ci = dyn_cast<CallInst>(inst)) {
+        if (!CallsUserFunction(ci)) {
+          result.push_back(inst);
+        } else {
+          result.push_back(inst);
+          break;
+        }
+      } else {
+        result.push_back(inst);
+      }
+    }
+
+    // If a call inst occurs remember where we left
+    // off in the BB that makes the call and push the
+    // new BB on the stack
+    if (CallInst *ci = dyn_cast<CallInst>(inst)) {
+      bb_stack.top().second = inst_loc + 1;
+      bb_stack.push(std::pair<std::string, int>(bb_trace[curr_bb_idx], 0));
+    }
+    // If a return occurs pop off the last BB of current function
+    // being executed in the trace
+    else if (ReturnInst *ri = dyn_cast<ReturnInst>(inst)) {
+      bb_stack.pop();
+    }
+    // If the BB compeletes
+    else {
+      bb_stack.pop();
+      bb_stack.push(std::pair<std::string, int>(bb_trace[curr_bb_idx], 0));
+    }
+
+    // mark the current BB as being started
+    AlreadyStartedMap[curr_bb] = true;
+  }
+
+  // Locate the first iteration of each loop run. It ends where
+  // the BB following the iteration starts
+  for (int i = 0; i < runs.size(); i++) {
+    int endBlock = runs[i].firstBlock + runs[i].cycle.size();
+    runs[i].startInst = blockStarts[runs[i].firstBlock];
+    runs[i].endInst =
+        blockStarts[endBlock] != -1 ? blockStarts[endBlock] : result.size();
+    runs[i].cycleStarts.assign(blockStarts.begin() + runs[i].firstBlock,
+                               blockStarts.begin() + endBlock);
+  }
+
+  return result;
+}
+
+// End of the Z3Py script, after the constraints: code that bit-blasts
+// the SMT formula and then prints its corresponding SAT formula (in Z3's
+// internal SAT format)
+std::string GetZ3PyScriptEnd() {
+
+  std::string script = "\n";
+  script += "t = Then('simplify', 'bit-blast', 'tseitin-cnf')\n";
+  script += "subgoal = t(g)\n";
+  script += "assert len(subgoal) == 1\n";
+  script += "print subgoal[0].sexpr()\n";
+
+  return script;
+}
+
+// Get the Z3Py script that generates a SAT formula
+// (in Z3's format) of the path in the program's
+// execution
+std::string GetZ3PyScript(std::vector<std::string> &result) {
+
+  std::string script;
+
+  // Each constraint that encodes the behavior
+  // of the path being modeled
+  for (int i = 0; i < result.size(); i++) {
+    script += result[i];
+  }
+  script += GetZ3PyScriptEnd();
+
+  if (script.size() > PeakFormulaBytes) {
+    PeakFormulaBytes = script.size();
+  }
+
+  return script;
+}
+
+// Create the Z3Py file that generates a SAT formula
+// (in Z3's format) of the path in the program's
+// execution
+void CreateZ3PyFile(std::vector<std::string> result) {
+
+  std::ofstream z3_file(Z3Filename);
+  z3_file << GetZ3PyScript(result);
+  z3_file.close();
+}
+
+// Add the Bools created in the model to the bool file, and the
+// Bools of the input bits to the inputs file
+void WriteBoolFiles(std::string boolFilename, std::string inputsFilename) {
+
+  std::ofstream bool_file(boolFilename, std::ofstream::app);
+  for (int i = 0; i < boolVars.size(); i++) {
+    bool_file << boolVars[i] << "\n";
+  }
+  bool_file.close();
+
+  if (inputsFilename != "") {
+    std::ofstream inputs_file(inputsFilename, std::ofstream::app);
+    for (int i = 0; i < inputBits.size(); i++) {
+      inputs_file << inputBits[i] << "\n";
+    }
+    inputs_file.close();
+  }
+}
+
+// Generate the Z3 constraints of the path taken by a trace
+std::vector<std::string> ModelPath(
+    std::map<std::string, std::map<std::string, CFGNode *> > &FunctionCFGMap,
+    std::vector<std::string> bb_trace) {
+
+  // Compress repeated loop iterations in the trace into runs
+  std::vector<TraceRun> runs;
+  {
+    PhaseTimer timer("compress loops");
+    runs = compress_trace(bb_trace, FunctionCFGMap);
+  }
+
+  // Get a vector of the instructions executed on the path being
+  // modeled (in the order they are executed)
+  std::vector<Instruction *> instructionOrder;
+  {
+    PhaseTimer timer("inline");
+    instructionOrder =
+        GetInlinedInstructionOrder(bb_trace, FunctionCFGMap, runs);
+  }
+
+  // Get the Z3 constraints the encode the behavior of the
+  // program path being modeled
+  std::vector<std::string> result;
+  {
+    PhaseTimer timer("generate constraints");
+    result = GetTraceConstraints(&FunctionCFGMap, instructionOrder, runs);
+  }
+
+  return result;
+}
+
+/** Online mode (-cfcount-online) **/
+
+// The trace is read, compressed and inlined, and the constraints of its
+// path generated, by three stages running at the same time: a trace
+// read from a pipe is modeled while the traced program is still writing
+// it. The stages pass batches through bounded queues, so the memory
+// used does not grow with the length of the trace, and the constraints
+// are written to the Z3Py file as they are generated
+
+// Blocks (and steps) passed between the stages at a time
+const unsigned OnlineBatchSize = 1024;
+
+// Queue of at most depth items between two threads. Push waits while
+// it is full and Pop while it is empty
+template <typename T> class BoundedQueue {
+public:
+  BoundedQueue(unsigned depth) : depth(depth > 0 ? depth : 1), closed(false) {}
+
+  // Items pushed after the queue is closed are dropped
+  void Push(T item) {
+    std::unique_lock<std::mutex> lock(mutex);
+    notFull.wait(lock, [this] { return items.size() < depth || closed; });
+    if (closed) {
+      return;
+    }
+    items.push_back(std::move(item));
+    notEmpty.notify_one();
+  }
+
+  // Returns false once the queue is closed and empty
+  bool Pop(T *item) {
+    std::unique_lock<std::mutex> lock(mutex);
+    notEmpty.wait(lock, [this] { return !items.empty() || closed; });
+    if (items.empty()) {
+      return false;
+    }
+    *item = std::move(items.front());
+    items.pop_front();
+    notFull.notify_one();
+    return true;
+  }
+
+  void Close() {
+    std::unique_lock<std::mutex> lock(mutex);
+    closed = true;
+    notEmpty.notify_all();
+    notFull.notify_all();
+  }
+
+private:
+  std::deque<T> items;
+  unsigned depth;
+  bool closed;
+  std::mutex mutex;
+  std::condition_variable notEmpty;
+  std::condition_variable notFull;
+};
+
+// A step of the path with what it needs to be generated on its own:
+// a loop run step has its run, and the instructions of the run's first
+// iteration (between run.startInst and run.endInst)
+typedef struct onlineStep {
+  TraceStep step;
+  TraceRun run;
+  std::vector<Instruction *> runInsts;
+} OnlineStep;
+
+// First stage: read the blocks of the trace file (or stdin for "-")
+void ReadTraceOnline(BoundedQueue<std::vector<std::string> > *blocks) {
+
+  std::ifstream trace_file;
+  std::istream *trace_stream = &std::cin;
+  if (TraceFilename != "-") {
+    trace_file.open(TraceFilename, std::ios::binary);
+    trace_stream = &trace_file;
+    if (!trace_file.is_open()) {
+      llvm::errs() << "Cannot open trace file!\n";
+      blocks->Close();
+      return;
+    }
+  }
+
+  std::vector<std::string> batch;
+  read_trace_blocks(*trace_stream, [&](const std::string &block) {
+    batch.push_back(block);
+    if (batch.size() == OnlineBatchSize) {
+      blocks->Push(std::move(batch));
+      batch.clear();
+    }
+  });
+  if (!batch.empty()) {
+    blocks->Push(std::move(batch));
+  }
+  blocks->Close();
+}
+
+// Second stage: compress the blocks into loop runs and inline them into
+// steps, producing the same steps as compress_trace,
+// GetInlinedInstructionOrder and GetTraceSteps do for the whole trace.
+// Only the blocks of the loop iterations being compared and of the
+// current calls are kept
+class OnlineInliner {
+public:
+  OnlineInliner(
+      std::map<std::string, std::map<std::string, CFGNode *> > &FunctionCFGMap,
+      BoundedQueue<std::vector<std::string> > *blocks,
+      BoundedQueue<std::vector<OnlineStep> > *steps)
+      : FunctionCFGMap(FunctionCFGMap), blocks(blocks), steps(steps),
+        batchPos(0), aheadBase(0), traceEnded(false), unresolved(0) {}
+
+  // Why the stage stopped early ("" if it did not)
+  std::string error;
+
+  void Run() {
+    // Stack of the BBs being executed and where each one continues
+    std::stack<std::pair<std::string, int> > bb_stack;
+
+    std::string block;
+    if (!NextBlock(&block)) {
+      error = "empty trace";
+    } else {
+      bb_stack.push(std::pair<std::string, int>(block, 0));
+    }
+
+    while (!bb_stack.empty()) {
+      std::string curr_bb = bb_stack.top().first;
+      int inst_loc = bb_stack.top().second;
+      std::vector<Instruction *> *instructions = GetInstructions(curr_bb);
+      if (instructions == NULL) {
+        error = "unknown block in the trace: " + curr_bb;
+        break;
+      }
+
+      // Until the end of the BB or a call of a user function
+      Instruction *inst = NULL;
+      for (; inst_loc < instructions->size(); inst_loc++) {
+        inst = (*instructions)[inst_loc];
+        AddInstStep(inst);
+        if (CallInst *ci = dyn_cast<CallInst>(inst)) {
+          if (CallsUserFunction(ci)) {
+            break;
+          }
+        }
+      }
+
+      if (inst != NULL && isa<CallInst>(inst)) {
+        bb_stack.top().second = inst_loc + 1;
+        if (!NextBlock(&block)) {
+          break;
+        }
+        bb_stack.push(std::pair<std::string, int>(block, 0));
+      } else if (inst != NULL && isa<ReturnInst>(inst)) {
+        bb_stack.pop();
+      } else {
+        bb_stack.pop();
+        if (!NextBlock(&block)) {
+          break;
+        }
+        bb_stack.push(std::pair<std::string, int>(block, 0));
+      }
+    }
+
+    // Steps still waiting for the BB after them are at the end of the
+    // trace, where there is none
+    for (auto it = pending.begin(); it != pending.end(); ++it) {
+      it->resolved = true;
+    }
+    FlushSteps();
+    if (!outBatch.empty()) {
+      steps->Push(outBatch);
+    }
+    steps->Close();
+    // Let the reader finish if we stopped early
+    blocks->Close();
+  }
+
+private:
+  std::map<std::string, std::map<std::string, CFGNode *> > &FunctionCFGMap;
+  BoundedQueue<std::vector<std::string> > *blocks;
+  BoundedQueue<std::vector<OnlineStep> > *steps;
+
+  // Blocks of the trace not compressed yet: ahead[0] is the block at
+  // offset aheadBase from the current position
+  std::vector<std::string> inBatch;
+  size_t batchPos;
+  std::deque<std::string> ahead;
+  size_t aheadBase;
+  bool traceEnded;
+  std::map<std::string, bool> compressible;
+
+  // Last BB of each function and the one before it, for the prev BB of
+  // the steps (prevBB is the last one found, as in GetTraceSteps)
+  std::map<std::string, std::string> lastBBs;
+  std::map<std::string, std::string> prevBBs;
+  std::string prevBB;
+
+  // Steps in order, the first ones waiting for the BB executed after
+  // them (branches and loop runs)
+  typedef struct pendingStep {
+    OnlineStep step;
+    std::string func;
+    std::string bb;
+    bool resolved;
+    // The next BB is the next one of the function, even if it is the
+    // same BB (loop runs)
+    bool anyBB;
+  } PendingStep;
+  std::deque<PendingStep> pending;
+  unsigned unresolved;
+  std::vector<OnlineStep> outBatch;
+
+  std::vector<Instruction *> *GetInstructions(const std::string &bbName) {
+    auto func = FunctionCFGMap.find(bbName.substr(0, bbName.find("_")));
+    if (func == FunctionCFGMap.end()) {
+      return NULL;
+    }
+    auto bb = func->second.find(bbName);
+    return bb == func->second.end() ? NULL : &bb->second->instructions;
+  }
+
+  bool PullBlock(std::string *block) {
+    while (batchPos == inBatch.size()) {
+      if (!blocks->Pop(&inBatch)) {
+        return false;
+      }
+      batchPos = 0;
+    }
+    *block = inBatch[batchPos++];
+    return true;
+  }
+
+  // Make the block at offset k from the current position available.
+  // Returns false if the trace ends before it
+  bool Have(size_t k) {
+    while (aheadBase + ahead.size() <= k) {
+      std::string block;
+      if (traceEnded || !PullBlock(&block)) {
+        traceEnded = true;
+        return false;
+      }
+      ahead.push_back(block);
+    }
+    return true;
+  }
+
+  const std::string &At(size_t k) { return ahead[k - aheadBase]; }
+
+  // The next block of the compressed trace. The loop runs before it
+  // are turned into steps
+  bool NextBlock(std::string *block) {
+    TraceRun run;
+    while (NextItem(block, &run)) {
+      if (run.count == 1) {
+        return true;
+      }
+      AddRunStep(run);
+    }
+    return false;
+  }
+
+  // The next block of the trace or, if it starts a loop run, the run
+  // (run->count > 1), chosen as compress_trace would. Every period
+  // that can start a run is compared with the trace at once, looking
+  // ahead only until all of them stop repeating
+  bool NextItem(std::string *block, TraceRun *run) {
+    run->count = 1;
+    if (!Have(0)) {
+      return false;
+    }
+    Have(2 * MaxLoopPeriod - 1);
+
+    std::vector<unsigned> periods;
+    std::string func = At(0).substr(0, At(0).find("_"));
+    for (unsigned period = 1;
+         period <= MaxLoopPeriod && 2 * period <= ahead.size(); period++) {
+      const std::string &bbName = At(period - 1);
+      if (compressible.find(bbName) == compressible.end()) {
+        compressible[bbName] = IsLoopCompressible(bbName, FunctionCFGMap);
+      }
+      if (!compressible[bbName] || bbName.substr(0, bbName.find("_")) != func) {
+        break;
+      }
+      periods.push_back(period);
+    }
+
+    // Length of the repetition of each period (0 while it repeats)
+    std::vector<size_t> lens(periods.size(), 0);
+    std::vector<std::string> firstBlocks;
+    size_t repeating = periods.size();
+    for (size_t k = 1; repeating > 0; k++) {
+      bool have = Have(k);
+      for (int p = 0; p < periods.size(); p++) {
+        if (lens[p] != 0 || periods[p] > k) {
+          continue;
+        }
+        if (!have || At(k) != At(k - periods[p])) {
+          lens[p] = k;
+          repeating--;
+        }
+      }
+      // Keep the blocks of the first iteration and the last ones a
+      // period can be compared with
+      if (repeating > 0 && k >= 4 * MaxLoopPeriod) {
+        if (firstBlocks.empty()) {
+          firstBlocks.assign(ahead.begin(), ahead.begin() + MaxLoopPeriod);
+        }
+        while (aheadBase + MaxLoopPeriod < k) {
+          ahead.pop_front();
+          aheadBase++;
+        }
+      }
+    }
+
+    unsigned bestPeriod = 1;
+    size_t bestCount = 1;
+    for (int p = 0; p < periods.size(); p++) {
+      size_t count = lens[p] / periods[p];
+      if (count >= 2 && count * periods[p] > bestCount * bestPeriod) {
+        bestPeriod = periods[p];
+        bestCount = count;
+      }
+    }
+
+    if (bestCount == 1) {
+      *block = ahead.front();
+      ahead.pop_front();
+      return true;
+    }
+
+    if (firstBlocks.empty()) {
+      run->cycle.assign(ahead.begin(), ahead.begin() + bestPeriod);
+    } else {
+      run->cycle.assign(firstBlocks.begin(), firstBlocks.begin() + bestPeriod);
+    }
+    run->count = bestCount;
+    run->firstBlock = -1;
+    NumLoopIterationsCompressed += bestCount - 1;
+    for (size_t i = aheadBase; i < bestCount * bestPeriod; i++) {
+      ahead.pop_front();
+    }
+    aheadBase = 0;
+    return true;
+  }
+
+  // Account for an instruction being executed: it gives the BB after
+  // the waiting steps of its function, and becomes the last BB of it
+  void WalkInst(Instruction *inst, const std::string &func,
+                const std::string &bb) {
+    for (auto it = pending.begin(); unresolved > 0 && it != pending.end();
+         ++it) {
+      if (!it->resolved && it->func == func && (it->anyBB || it->bb != bb)) {
+        it->step.step.nextBB = bb;
+        it->resolved = true;
+        unresolved--;
+      }
+    }
+
+    auto last = lastBBs.find(func);
+    if (last == lastBBs.end()) {
+      lastBBs[func] = bb;
+    } else if (last->second != bb) {
+      prevBBs[func] = last->second;
+      last->second = bb;
+    }
+  }
+
+  void AddInstStep(Instruction *inst) {
+    std::string func = inst->getParent()->getParent()->getName().str();
+    std::string bb = inst->getParent()->getName().str();
+    WalkInst(inst, func, bb);
+    auto prev = prevBBs.find(func);
+    if (prev != prevBBs.end()) {
+      prevBB = prev->second;
+    }
+
+    PendingStep ps;
+    ps.step.step.inst = inst;
+    ps.step.step.prevBB = prevBB;
+    ps.step.step.run = -1;
+    ps.func = func;
+    ps.bb = bb;
+    // Only branches and switches use the BB after them
+    ps.resolved = !isa<BranchInst>(inst) && !isa<SwitchInst>(inst);
+    ps.anyBB = false;
+    AddStep(ps);
+  }
+
+  void AddRunStep(TraceRun &run) {
+    PendingStep ps;
+    run.cycleStarts.clear();
+    for (int i = 0; i < run.cycle.size(); i++) {
+      std::vector<Instruction *> *instructions = GetInstructions(run.cycle[i]);
+      run.cycleStarts.push_back(ps.step.runInsts.size());
+      ps.step.runInsts.insert(ps.step.runInsts.end(), instructions->begin(),
+                              instructions->end());
+    }
+    ps.func = run.cycle[0].substr(0, run.cycle[0].find("_"));
+    auto last = lastBBs.find(ps.func);
+    ps.step.step.inst = ps.step.runInsts[0];
+    ps.step.step.prevBB = last != lastBBs.end() ? last->second : "";
+    ps.step.step.run = 0;
+    ps.step.run = run;
+    ps.step.run.startInst = 0;
+    ps.step.run.endInst = ps.step.runInsts.size();
+
+    // The first iteration is part of the trace
+    for (int i = 0; i < ps.step.runInsts.size(); i++) {
+      Instruction *inst = ps.step.runInsts[i];
+      WalkInst(inst, ps.func, inst->getParent()->getName().str());
+    }
+    ps.resolved = false;
+    ps.anyBB = true;
+    AddStep(ps);
+  }
+
+  void AddStep(PendingStep &ps) {
+    if (!ps.resolved) {
+      unresolved++;
+    }
+    pending.push_back(std::move(ps));
+    FlushSteps();
+  }
+
+  // Pass on the steps that are not waiting any more, in order
+  void FlushSteps() {
+    while (!pending.empty() && pending.front().resolved) {
+      outBatch.push_back(std::move(pending.front().step));
+      pending.pop_front();
+      if (outBatch.size() == OnlineBatchSize) {
+        steps->Push(std::move(outBatch));
+        outBatch.clear();
+      }
+    }
+  }
+};
+
+// Generate the constraints of the path of a trace that is still being
+// written, writing them to the Z3Py file as they are generated. The files
+// are incomplete if pathError is set
+void ModelPathOnline(
+    std::map<std::string, std::map<std::string, CFGNode *> > &FunctionCFGMap) {
+
+  BoundedQueue<std::vector<std::string> > blocks(OnlineQueueDepth);
+  BoundedQueue<std::vector<OnlineStep> > steps(OnlineQueueDepth);
+  OnlineInliner inliner(FunctionCFGMap, &blocks, &steps);
+  std::thread reader(ReadTraceOnline, &blocks);
+  std::thread inlining(&OnlineInliner::Run, &inliner);
+
+  // Last stage: generate the constraints of the steps
+  std::ofstream z3_file(Z3Filename);
+  uint64_t scriptBytes = 0;
+  std::vector<std::string> result;
+  BeginTraceConstraints(&result);
+  if (CheckEvery > 0) {
+    StartChecker();
+  }
+
+  std::vector<OnlineStep> batch;
+  while (steps.Pop(&batch)) {
+    // The other stages run until the end of the trace
+    if (pathError != "") {
+      continue;
+    }
+    for (int i = 0; i < batch.size() && pathError == ""; i++) {
+      TraceStep &step = batch[i].step;
+      if (step.run >= 0) {
+        EmitLoopRun(batch[i].run, batch[i].runInsts, step.prevBB, step.nextBB,
+                    &result);
+      } else {
+        EmitInstConstraint(step.inst, step.prevBB, step.nextBB, &result);
+      }
+    }
+    for (int i = 0; i < result.size(); i++) {
+      z3_file << result[i];
+      scriptBytes += result[i].size();
+    }
+    result.clear();
+  }
+
+  reader.join();
+  inlining.join();
+  if (inliner.error != "" && pathError == "") {
+    pathError = "Online Error: " + inliner.error;
+  }
+
+  CheckFeasibility();
+  StopChecker();
+  if (pathError != "") {
+    return;
+  }
+
+  PhaseTimer timer("write outputs");
+  std::string end = GetZ3PyScriptEnd();
+  z3_file << end;
+  z3_file.close();
+  scriptBytes += end.size();
+  if (scriptBytes > PeakFormulaBytes) {
+    PeakFormulaBytes = scriptBytes;
+  }
+  WriteBoolFiles(BoolFilename, InputsFilename);
+}
+
+/** Cache of generated paths (-cfcount-cache-dir) **/
+
+// Each entry of the cache is a directory named by the hash of what the
+// path's constraints depend on, holding the Z3Py script ("z3.py"), the
+// bool and inputs files ("bools", "inputs") and, once the path has been
+// counted, the CNF and the count ("cnf-<counter>", "count-<counter>") of
+// each counter setup it was counted with (see GetCounterKey). Entries
+// are created by renaming a complete temporary directory, so
+// readers never see partial entries
+
+std::string HashString(StringRef str) {
+  MD5 hash;
+  hash.update(str);
+  MD5::MD5Result digest;
+  hash.final(digest);
+  SmallString<32> result;
+  MD5::stringifyResult(digest, result);
+  return std::string(result.begin(), result.end());
+}
+
+void HashModule(Module &m) {
+  std::string bitcode;
+  raw_string_ostream os(bitcode);
+  WriteBitcodeToFile(&m, os);
+  os.flush();
+  moduleHash = HashString(bitcode);
+}
+
+// Directory of the cache ("" if it is not used)
+std::string GetCacheDir() {
+  if (NoCache) {
+    return "";
+  }
+  if (CacheDir != "") {
+    return CacheDir;
+  }
+  const char *home = getenv("HOME");
+  return home ? std::string(home) + "/.cache/cfcount" : "";
+}
+
+// Key of the path of a trace: everything its constraints depend on
+std::string GetCacheKey(std::vector<std::string> &bb_trace) {
+  std::string key = "cfcount-cache-3\n" + moduleHash + "\n";
+  for (int i = 0; i < bb_trace.size(); i++) {
+    key += bb_trace[i] + " ";
+  }
+  key += "\n";
+  // Without the bounds in the formula every bounds file shares the entry
+  for (int i = 0; i < lowerBounds.size() && !NoBounds; i++) {
+    key += std::to_string(lowerBounds[i]) + " " +
+           (i < upperBounds.size() ? std::to_string(upperBounds[i]) : "") +
+           " ";
+  }
+  key += "\n" + std::to_string(InputsFilename != "") + " " +
+         std::to_string(MaxLoopPeriod) + " " +
+         std::to_string(SkipConcreteLoops) + " " +
+         std::to_string(SummarizeLoops) + " " + std::to_string(ArrayBound) +
+         " " + std::to_string(PowMaxExponent) + " " +
+         std::to_string(NoBounds) + "\n";
+  return HashString(key);
+}
+
+bool ReadWholeFile(std::string filename, std::string *contents) {
+  std::ifstream file(filename, std::ios::binary);
+  if (!file.is_open()) {
+    return false;
+  }
+  std::stringstream ss;
+  ss << file.rdbuf();
+  *contents = ss.str();
+  return true;
+}
+
+bool WriteWholeFile(std::string filename, const std::string &contents,
+                    bool append = false) {
+  std::ofstream file(filename, append ? std::ios::binary | std::ios::app
+                                      : std::ios::binary | std::ios::trunc);
+  if (!file.is_open()) {
+    return false;
+  }
+  file << contents;
+  return true;
+}
+
+// Remove a cache entry (or temporary entry) directory
+void RemoveCacheEntry(std::string entry) {
+  DIR *dir = opendir(entry.c_str());
+  if (dir != NULL) {
+    while (struct dirent *ent = readdir(dir)) {
+      std::string name = ent->d_name;
+      if (name != "." && name != "..") {
+        unlink((entry + "/" + name).c_str());
+      }
+    }
+    closedir(dir);
+  }
+  rmdir(entry.c_str());
+}
+
+// Evict the least recently used entries until the cache is down to 90%
+// of -cfcount-cache-size, so that the next stores do not evict again.
+// Returns the size of the cache left
+off_t EvictCache(std::string cacheDir) {
+  DIR *dir = opendir(cacheDir.c_str());
+  if (dir == NULL) {
+    return 0;
+  }
+
+  // (last use, size, entry) of each entry
+  std::vector<std::pair<std::pair<time_t, off_t>, std::string> > entries;
+  off_t total = 0;
+  while (struct dirent *ent = readdir(dir)) {
+    std::string name = ent->d_name;
+    if (name == "." || name == "..") {
+      continue;
+    }
+    std::string entry = cacheDir + "/" + name;
+    struct stat st;
+    if (stat(entry.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+      continue;
+    }
+    time_t used = st.st_mtime;
+    off_t size = 0;
+    if (DIR *files = opendir(entry.c_str())) {
+      while (struct dirent *file = readdir(files)) {
+        struct stat fst;
+        if (stat((entry + "/" + file->d_name).c_str(), &fst) == 0 &&
+            S_ISREG(fst.st_mode)) {
+          size += fst.st_size;
+        }
+      }
+      closedir(files);
+    }
+    entries.push_back(std::make_pair(std::make_pair(used, size), entry));
+    total += size;
+  }
+  closedir(dir);
+
+  off_t limit = (off_t)CacheSize * 1024 * 1024;
+  if (total <= limit) {
+    return total;
+  }
+  std::sort(entries.begin(), entries.end());
+  for (int i = 0; i < entries.size() && total > limit / 10 * 9; i++) {
+    RemoveCacheEntry(entries[i].second);
+    total -= entries[i].first.second;
+  }
+  return total;
+}
+
+// Account for bytes added to the cache. The size of the cache is kept
+// in its ".size" file (stores of the daemon each run in their own
+// process), so a store only reads and writes it. The entries are only
+// walked when the size is not known yet or goes over the limit; the
+// lock of the file keeps processes from evicting at the same time
+void AddCacheSize(std::string cacheDir, off_t added) {
+  int fd = open((cacheDir + "/.size").c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd < 0) {
+    EvictCache(cacheDir);
+    return;
+  }
+  flock(fd, LOCK_EX);
+  char buf[32];
+  ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+  off_t total = -1;
+  if (n > 0) {
+    buf[n] = '\0';
+    total = strtoll(buf, NULL, 10);
+  }
+  if (total < 0 || total + added > (off_t)CacheSize * 1024 * 1024) {
+    total = EvictCache(cacheDir);
+  } else {
+    total += added;
+  }
+  std::string size = std::to_string((long long)total) + "\n";
+  if (ftruncate(fd, 0) == 0) {
+    pwrite(fd, size.data(), size.size(), 0);
+  }
+  flock(fd, LOCK_UN);
+  close(fd);
+}
+
+// Write the files of a cached path to the outputs (the script is
+// returned instead if there is no z3 file). Returns false on a miss
+bool LoadCachedPath(std::string key, std::string z3Filename,
+                    std::string boolFilename, std::string inputsFilename,
+                    std::string *script) {
+  std::string cacheDir = GetCacheDir();
+  if (cacheDir == "") {
+    return false;
+  }
+  std::string entry = cacheDir + "/" + key;
+  std::string z3, bools, inputs;
+  if (!ReadWholeFile(entry + "/z3.py", &z3) ||
+      !ReadWholeFile(entry + "/bools", &bools) ||
+      !ReadWholeFile(entry + "/inputs", &inputs)) {
+    ++NumCacheMisses;
+    return false;
+  }
+
+  if (z3Filename != "") {
+    WriteWholeFile(z3Filename, z3);
+  } else {
+    *script = z3;
+  }
+  // The bool and inputs files are appended to, as when generating
+  WriteWholeFile(boolFilename, bools, true);
+  if (inputsFilename != "") {
+    WriteWholeFile(inputsFilename, inputs, true);
+  }
+
+  // Mark the entry as recently used
+  utime(entry.c_str(), NULL);
+  ++NumCacheHits;
+  return true;
+}
+
+// Add a generated path to the cache
+void StoreCachedPath(std::string key, std::string script) {
+  std::string cacheDir = GetCacheDir();
+  if (cacheDir == "") {
+    return;
+  }
+  std::string parent = cacheDir.substr(0, cacheDir.rfind("/"));
+  if (parent != "" && parent != cacheDir) {
+    mkdir(parent.c_str(), 0755);
+  }
+  mkdir(cacheDir.c_str(), 0755);
+
+  std::string bools, inputs;
+  for (int i = 0; i < boolVars.size(); i++) {
+    bools += boolVars[i] + "\n";
+  }
+  for (int i = 0; i < inputBits.size(); i++) {
+    inputs += inputBits[i] + "\n";
+  }
+
+  std::string temp =
+      cacheDir + "/.tmp-" + key + "-" + std::to_string(getpid());
+  if (mkdir(temp.c_str(), 0755) != 0 ||
+      !WriteWholeFile(temp + "/z3.py", script) ||
+      !WriteWholeFile(temp + "/bools", bools) ||
+      !WriteWholeFile(temp + "/inputs", inputs) ||
+      rename(temp.c_str(), (cacheDir + "/" + key).c_str()) != 0) {
+    // Another process stored the path first (or the cache is not writable)
+    RemoveCacheEntry(temp);
+    return;
+  }
+
+  AddCacheSize(cacheDir, script.size() + bools.size() + inputs.size());
+}
+
+// Key of what a count depends on besides the path: the count command
+// and the environment count_path.sh picks the converter, the
+// preprocessor and the counter from. A path counted with another counter
+// is counted again
+std::string GetCounterKey() {
+  std::string key = std::string(CountCommand) + "\n";
+  const char *vars[] = {"COUNTER", "CONVERT", "PREPROCESS", "PYTHON"};
+  for (int i = 0; i < 4; i++) {
+    const char *value = getenv(vars[i]);
+    key += std::string(vars[i]) + "=" + (value ? value : "") + "\n";
+  }
+  return HashString(key);
+}
+
+// Get the count of a cached path (and restore its CNF next to the
+// z3 file, where the count command leaves it)
+bool LoadCachedCount(std::string key, std::string z3Filename,
+                     std::string *count) {
+  std::string cacheDir = GetCacheDir();
+  if (cacheDir == "") {
+    return false;
+  }
+  std::string entry = cacheDir + "/" + key;
+  std::string counter = GetCounterKey();
+  if (!ReadWholeFile(entry + "/count-" + counter, count)) {
+    return false;
+  }
+  std::string cnf;
+  if (ReadWholeFile(entry + "/cnf-" + counter, &cnf)) {
+    WriteWholeFile(z3Filename + ".cnf", cnf);
+  }
+  return true;
+}
+
+// Add the count of a path (and the CNF it was counted from)
+// to the path's cache entry
+void StoreCachedCount(std::string key, std::string z3Filename,
+                      std::string count) {
+  std::string cacheDir = GetCacheDir();
+  if (cacheDir == "") {
+    return;
+  }
+  std::string entry = cacheDir + "/" + key;
+  std::string counter = GetCounterKey();
+  std::string suffix = ".tmp-" + std::to_string(getpid());
+  std::string cnf;
+  if (ReadWholeFile(z3Filename + ".cnf", &cnf) &&
+      WriteWholeFile(entry + "/cnf-" + counter + suffix, cnf)) {
+    rename((entry + "/cnf-" + counter + suffix).c_str(),
+           (entry + "/cnf-" + counter).c_str());
+  }
+  // The count is stored after the CNF it was counted from
+  if (WriteWholeFile(entry + "/count-" + counter + suffix, count)) {
+    rename((entry + "/count-" + counter + suffix).c_str(),
+           (entry + "/count-" + counter).c_str());
+  }
+  AddCacheSize(cacheDir, cnf.size() + count.size());
+}
+
+// Rename the module (see rename_bbs) and build its CFG, then number its
+// blocks and resolve the models of the library functions it calls.
+// Everything after this only reads the module
+void PrepareModule(
+    Module &m,
+    std::map<std::string, std::map<std::string, CFGNode *> > *FunctionCFGMap) {
+
+  // Create global pointer to the module to avoid
+  // expenseive parameter passing
+  mod_ptr = &m;
+
+  // Identify the module in the keys of the cache
+  if (GetCacheDir() != "") {
+    PhaseTimer timer("hash module");
+    HashModule(m);
+  }
+
+  // Change names of bbs, instructions and parameters
+  // (makes debugging easier)
+  {
+    PhaseTimer timer("rename");
+    rename_bbs();
+    rename_insts();
+    rename_func_params();
+  }
+
+  // Build a nested map for looking up BB's corresponding CFGNode
+  // For ex. to find the CFG for bb1 in func1 use:
+  // FunctionCFGMap[func1][bb1]
+  {
+    PhaseTimer timer("build CFG");
+    BuildFunctionCFGMap(FunctionCFGMap);
+  }
+  NumberBlocks();
+
+  // Look up the models of the library functions the module calls
+  ResolveLibCallModels();
+}
+
+// Add the stage times reported by the count command, one
+// "<stage> <seconds>" line per stage, to the phase times
+void ReadStageTimes(std::string timesFilename) {
+  std::ifstream times_file(timesFilename);
+  std::string stage;
+  double seconds;
+  while (times_file >> stage >> seconds) {
+    PhaseTime &phase = phaseTimes["count: " + stage];
+    phase.wall += seconds;
+    phase.calls++;
+  }
+  times_file.close();
+  remove(timesFilename.c_str());
+}
+
+// Run a program (looked up in PATH) with its arguments, without a
+// shell, and collect its output. env holds "NAME=value" variables added
+// to the program's environment. Returns false if it cannot be started
+// or exits with an error
+bool RunProgram(const std::vector<std::string> &args, std::string *output,
+                const std::vector<std::string> &env =
+                    std::vector<std::string>()) {
+  std::vector<char *> argv;
+  for (int i = 0; i < args.size(); i++) {
+    argv.push_back(const_cast<char *>(args[i].c_str()));
+  }
+  argv.push_back(NULL);
+  // The environment is built before forking: the child of a threaded
+  // process may only make async-signal-safe calls
+  std::vector<char *> envp;
+  for (int i = 0; i < env.size(); i++) {
+    envp.push_back(const_cast<char *>(env[i].c_str()));
+  }
+  for (char **var = environ; *var != NULL; var++) {
+    envp.push_back(*var);
+  }
+  envp.push_back(NULL);
+
+  int fromChild[2];
+  if (pipe(fromChild) != 0) {
+    return false;
+  }
+  // Programs started by other threads must not keep the pipe open
+  fcntl(fromChild[0], F_SETFD, FD_CLOEXEC);
+  fcntl(fromChild[1], F_SETFD, FD_CLOEXEC);
+  pid_t pid = fork();
+  if (pid == 0) {
+    dup2(fromChild[1], 1);
+    environ = &envp[0];
+    execvp(argv[0], &argv[0]);
+    _exit(127);
+  }
+  close(fromChild[1]);
+  if (pid < 0) {
+    close(fromChild[0]);
+    return false;
+  }
+
+  char buf[4096];
+  ssize_t n;
+  while ((n = read(fromChild[0], buf, sizeof(buf))) != 0) {
+    if (n > 0) {
+      output->append(buf, n);
+    } else if (errno != EINTR) {
+      break;
+    }
+  }
+  close(fromChild[0]);
+  int status;
+  while (waitpid(pid, &status, 0) < 0) {
+    if (errno != EINTR) {
+      return false;
+    }
+  }
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// Run the count command on the generated files of a path
+// and return its output
+bool RunCountCommand(std::string z3Filename, std::string boolFilename,
+                     std::string inputsFilename, std::string *output) {
+  PhaseTimer timer("count command");
+
+  // The command reports the time of its stages in this file. The
+  // filenames come from requests too, so no shell sees them
+  std::string timesFilename = z3Filename + ".times";
+  std::vector<std::string> args;
+  args.push_back(CountCommand);
+  args.push_back(z3Filename);
+  args.push_back(boolFilename);
+  if (inputsFilename != "") {
+    args.push_back(inputsFilename);
+  }
+  bool success = RunProgram(args, output,
+                            std::vector<std::string>(
+                                1, "CFCOUNT_TIMES=" + timesFilename));
+  ReadStageTimes(timesFilename);
+  return success;
+}
+
+/** Batch mode (-cfcount-batch) **/
+
+// Snapshot of everything constraint generation changes, so generation
+// can go back to a point of the path and continue differently
+typedef struct genState {
+  // States of the stateStack, bottom first
+  std::vector<State> states;
+  // Facts of the path and the pointer ids given one, with their fact
+  std::vector<PointsTo> pointsToFacts;
+  std::vector<std::pair<unsigned, int> > pointsToEntries;
+  std::map<std::string, int> arrays;
+  std::map<std::string, int> arrayLengths;
+  std::set<std::string> arrayCircuits;
+  int boundCt;
+  std::map<std::string, ConcreteVal> concreteVals;
+  // Number of constraints and Bools generated so far
+  int resultCt;
+  int boolCt;
+  int inputBitCt;
+} GenState;
+
+GenState SaveGenState(std::vector<std::string> &result) {
+  GenState snapshot;
+
+  std::stack<State *> stack = stateStack;
+  while (!stack.empty()) {
+    snapshot.states.insert(snapshot.states.begin(), *stack.top());
+    stack.pop();
+  }
+  snapshot.pointsToFacts.assign(pointsToFacts.begin(),
+                                pointsToFacts.begin() + numPointsToFacts);
+  for (int i = 0; i < pointsToLog.size(); i++) {
+    unsigned id = pointsToLog[i];
+    snapshot.pointsToEntries.push_back(
+        std::make_pair(id, pointsToEntries[id].fact));
+  }
+  snapshot.arrays = arrayMap;
+  snapshot.arrayLengths = arrayLengths;
+  snapshot.arrayCircuits = arrayCircuits;
+  snapshot.boundCt = boundCt;
+  snapshot.concreteVals = concreteVals;
+  snapshot.resultCt = result.size();
+  snapshot.boolCt = boolVars.size();
+  snapshot.inputBitCt = inputBits.size();
+
+  return snapshot;
+}
+
+void RestoreGenState(GenState &snapshot, std::vector<std::string> *result) {
+
+  while (!stateStack.empty()) {
+    delete stateStack.top();
+    stateStack.pop();
+  }
+  for (int i = 0; i < snapshot.states.size(); i++) {
+    stateStack.push(new State(snapshot.states[i]));
+  }
+  // Ids are never forgotten, so the snapshot's still name its pointers
+  ResetPointsTo();
+  for (int i = 0; i < snapshot.pointsToFacts.size(); i++) {
+    if (i == pointsToFacts.size()) {
+      pointsToFacts.push_back(snapshot.pointsToFacts[i]);
+    } else {
+      pointsToFacts[i] = snapshot.pointsToFacts[i];
+    }
+  }
+  numPointsToFacts = snapshot.pointsToFacts.size();
+  for (int i = 0; i < snapshot.pointsToEntries.size(); i++) {
+    unsigned id = snapshot.pointsToEntries[i].first;
+    pointsToEntries[id].epoch = pointsToEpoch;
+    pointsToEntries[id].fact = snapshot.pointsToEntries[i].second;
+    pointsToLog.push_back(id);
+  }
+  arrayMap = snapshot.arrays;
+  arrayLengths = snapshot.arrayLengths;
+  arrayCircuits = snapshot.arrayCircuits;
+  boundCt = snapshot.boundCt;
+  concreteVals = snapshot.concreteVals;
+  result->resize(snapshot.resultCt);
+  boolVars.resize(snapshot.boolCt);
+  inputBits.resize(snapshot.inputBitCt);
+}
+
+// A trace of the batch and the files its path is generated to
+typedef struct batchTrace {
+  // Later traces of the batch that take the same path
+  std::vector<int> duplicates;
+  std::string cacheKey;
+  std::string traceFilename;
+  std::string z3Filename;
+  std::string boolFilename;
+  std::string inputsFilename;
+  std::vector<Instruction *> instructionOrder;
+  std::vector<TraceRun> runs;
+  std::vector<TraceStep> steps;
+} BatchTrace;
+
+// Node of the trie of the batch's traces. Each node is a step, and
+// traces that start with the same steps share the same nodes
+struct StepTrieNode {
+  // Trace and step the node was created from (-1 for the root)
+  int trace;
+  int step;
+  // Children by step key
+  std::map<std::string, StepTrieNode *> children;
+  // Traces whose last step is this node
+  std::vector<int> ends;
+};
+
+// Key identifying what a step generates. Instructions are identified
+// by their address, loop runs also by their iterations
+std::string GetStepKey(TraceStep &step, BatchTrace &trace) {
+  std::string key = std::to_string((uintptr_t)step.inst) + " " + step.prevBB +
+                    " " + step.nextBB;
+  if (step.run >= 0) {
+    TraceRun &run = trace.runs[step.run];
+    key += " run " + std::to_string(run.count);
+    for (int i = 0; i < run.cycle.size(); i++) {
+      key += " " + run.cycle[i];
+    }
+  }
+  return key;
+}
+
+// Write the files of a trace whose path has been generated
+// (and of the traces that take the same path)
+void WriteBatchTrace(std::vector<BatchTrace> &traces, int t,
+                     std::vector<std::string> &result) {
+  PhaseTimer timer("write outputs");
+  std::string script = GetZ3PyScript(result);
+  WriteWholeFile(traces[t].z3Filename, script);
+  WriteBoolFiles(traces[t].boolFilename, traces[t].inputsFilename);
+  for (int i = 0; i < traces[t].duplicates.size(); i++) {
+    BatchTrace &dup = traces[traces[t].duplicates[i]];
+    WriteWholeFile(dup.z3Filename, script);
+    WriteBoolFiles(dup.boolFilename, dup.inputsFilename);
+  }
+  StoreCachedPath(traces[t].cacheKey, script);
+}
+
+// Count the path of a trace with -cfcount-count-command and write the
+// count to "<z3 file>.count" for it and the traces that take the
+// same path
+void CountBatchTrace(std::vector<BatchTrace> &traces, int t) {
+  BatchTrace &trace = traces[t];
+  std::string output;
+  if (!LoadCachedCount(trace.cacheKey, trace.z3Filename, &output)) {
+    if (!RunCountCommand(trace.z3Filename, trace.boolFilename,
+                         trace.inputsFilename, &output)) {
+      print_error("CountBatchTrace Error: count command failed for " +
+                  trace.traceFilename + "\n");
+      return;
+    }
+    StoreCachedCount(trace.cacheKey, trace.z3Filename, output);
+  }
+  WriteWholeFile(trace.z3Filename + ".count", output);
+  for (int i = 0; i < trace.duplicates.size(); i++) {
+    WriteWholeFile(traces[trace.duplicates[i]].z3Filename + ".count", output);
+  }
+}
+
+// Generate the paths of traces that use the same bounds. The traces
+// are put in a trie of their steps and each node of the trie is
+// generated once: the generator state is saved where traces diverge
+// and restored for each of the branches
+void GenerateBatch(
+    std::map<std::string, std::map<std::string, CFGNode *> > &FunctionCFGMap,
+    std::vector<BatchTrace> &traces) {
+
+  // Group the traces that take the same path (e.g. fuzzer inputs that
+  // only differ in their concrete values). A rolling hash of the BB
+  // sequence finds the earlier traces a trace may be the same as, and
+  // only the first trace of each path is generated
+  std::vector<std::vector<std::string> > bbTraces(traces.size());
+  std::vector<int> unique;
+  std::map<uint64_t, std::vector<int> > byPathHash;
+  PhaseTimer parseTimer("parse trace");
+  for (int t = 0; t < traces.size(); t++) {
+    if (!read_trace_file(traces[t].traceFilename, &bbTraces[t])) {
+      print_error("GenerateBatch Error: Cannot open trace file " +
+                  traces[t].traceFilename + "\n");
+      continue;
+    }
+    if (bbTraces[t].empty()) {
+      print_error("GenerateBatch Error: Empty trace file " +
+                  traces[t].traceFilename + "\n");
+      continue;
+    }
+
+    uint64_t pathHash = 0;
+    for (int i = 0; i < bbTraces[t].size(); i++) {
+      pathHash = pathHash * 1000003 + std::hash<std::string>()(bbTraces[t][i]);
+    }
+    std::vector<int> &candidates = byPathHash[pathHash];
+    bool duplicate = false;
+    for (int i = 0; i < candidates.size() && !duplicate; i++) {
+      if (bbTraces[candidates[i]] == bbTraces[t]) {
+        traces[candidates[i]].duplicates.push_back(t);
+        duplicate = true;
+      }
+    }
+    if (!duplicate) {
+      candidates.push_back(t);
+      unique.push_back(t);
+    }
+  }
+
+  parseTimer.Stop();
+
+  // Resolve the steps of each path and insert them in the trie
+  PhaseTimer trieTimer("build trie");
+  StepTrieNode *root = new StepTrieNode;
+  root->trace = -1;
+  root->step = -1;
+  int nodeCt = 0, stepCt = 0, cachedCt = 0;
+  for (int u = 0; u < unique.size(); u++) {
+    int t = unique[u];
+    std::vector<std::string> &bb_trace = bbTraces[t];
+
+    traces[t].cacheKey = GetCacheKey(bb_trace);
+    if (LoadCachedPath(traces[t].cacheKey, traces[t].z3Filename,
+                       traces[t].boolFilename, traces[t].inputsFilename,
+                       NULL)) {
+      for (int i = 0; i < traces[t].duplicates.size(); i++) {
+        BatchTrace &dup = traces[traces[t].duplicates[i]];
+        LoadCachedPath(traces[t].cacheKey, dup.z3Filename, dup.boolFilename,
+                       dup.inputsFilename, NULL);
+      }
+      cachedCt++;
+      continue;
+    }
+
+    {
+      PhaseTimer timer("compress loops");
+      traces[t].runs = compress_trace(bb_trace, FunctionCFGMap);
+    }
+    {
+      PhaseTimer timer("inline");
+      traces[t].instructionOrder =
+          GetInlinedInstructionOrder(bb_trace, FunctionCFGMap, traces[t].runs);
+    }
+    traces[t].steps =
+        GetTraceSteps(traces[t].instructionOrder, traces[t].runs);
+
+    StepTrieNode *node = root;
+    for (int i = 0; i < traces[t].steps.size(); i++) {
+      std::string key = GetStepKey(traces[t].steps[i], traces[t]);
+      auto found = node->children.find(key);
+      if (found != node->children.end()) {
+        node = found->second;
+      } else {
+        StepTrieNode *child = new StepTrieNode;
+        child->trace = t;
+        child->step = i;
+        node->children[key] = child;
+        node = child;
+        nodeCt++;
+      }
+    }
+    node->ends.push_back(t);
+    stepCt += traces[t].steps.size();
+  }
+
+  llvm::errs() << "GenerateBatch: " << traces.size() << " traces, "
+               << unique.size() << " paths (" << cachedCt
+               << " cached), generating " << nodeCt << " of " << stepCt
+               << " steps\n";
+  trieTimer.Stop();
+
+  // Walk the trie depth first, generating each node once. Branches
+  // that are not followed right away start from a snapshot of the
+  // state at the node they branch from
+  PhaseTimer walkTimer("walk trie");
+  std::vector<std::string> result;
+  BeginTraceConstraints(&result);
+
+  std::vector<std::pair<StepTrieNode *, std::shared_ptr<GenState> > > pending;
+  pending.push_back(std::make_pair(root, std::shared_ptr<GenState>()));
+  while (!pending.empty()) {
+    StepTrieNode *node = pending.back().first;
+    std::shared_ptr<GenState> snapshot = pending.back().second;
+    pending.pop_back();
+    if (snapshot) {
+      RestoreGenState(*snapshot, &result);
+    }
+
+    while (node != NULL) {
+      if (node->trace >= 0) {
+        BatchTrace &trace = traces[node->trace];
+        EmitTraceStep(trace.steps[node->step], trace.instructionOrder,
+                      trace.runs, &result);
+      }
+      for (int i = 0; i < node->ends.size(); i++) {
+        WriteBatchTrace(traces, node->ends[i], result);
+      }
+
+      StepTrieNode *next = NULL;
+      if (node->children.size() == 1) {
+        next = node->children.begin()->second;
+      } else if (node->children.size() > 1) {
+        // Continue with the first branch, save the rest for later
+        snapshot = std::make_shared<GenState>(SaveGenState(result));
+        for (auto it = node->children.rbegin();
+             std::next(it) != node->children.rend(); ++it) {
+          pending.push_back(std::make_pair(it->second, snapshot));
+        }
+        next = node->children.begin()->second;
+      }
+      delete node;
+      node = next;
+    }
+  }
+  walkTimer.Stop();
+
+  // Count each path once
+  if (BatchCount) {
+    for (int u = 0; u < unique.size(); u++) {
+      CountBatchTrace(traces, unique[u]);
+    }
+  }
+}
+
+// Generate the paths of the traces listed in the batch file. Lines
+// are "<trace file> <z3 file> <bounds file> <bool file> [<inputs file>]"
+// (the arguments of a single run). Traces with the same bounds file
+// share the generation of their common prefixes. Returns false, with
+// the reason in *error, if the batch file cannot be read
+bool RunBatch(
+    std::map<std::string, std::map<std::string, CFGNode *> > &FunctionCFGMap,
+    std::string *error) {
+
+  std::ifstream batch_file(BatchFilename);
+  if (!batch_file.is_open()) {
+    *error = "Cannot open batch file!";
     return false;
   }
 
-  // We don't modify the program, so we preserve all analyses.
-  void getAnalysisUsage(AnalysisUsage &AU) const override {
-    // AU.setPreservesAll();
+  // The feasibility checker's solver cannot go back to a saved state
+  if (CheckEvery > 0) {
+    print_error("RunBatch: -cfcount-check-every is not used in batch mode\n");
+    CheckEvery = 0;
+  }
+
+  std::map<std::string, std::vector<BatchTrace> > byBounds;
+  std::string line;
+  while (std::getline(batch_file, line)) {
+    std::stringstream ss(line);
+    BatchTrace trace;
+    std::string boundsFilename;
+    if (!(ss >> trace.traceFilename >> trace.z3Filename >> boundsFilename >>
+          trace.boolFilename)) {
+      continue;
+    }
+    ss >> trace.inputsFilename;
+    // Input bits are declared for every trace if any of them needs them
+    if (InputsFilename == "" && trace.inputsFilename != "") {
+      InputsFilename = trace.inputsFilename;
+    }
+    byBounds[boundsFilename].push_back(trace);
+  }
+  batch_file.close();
+
+  std::vector<std::string> empty;
+  GenState initial = SaveGenState(empty);
+  for (auto it = byBounds.begin(); it != byBounds.end(); ++it) {
+    RestoreGenState(initial, &empty);
+    lowerBounds.clear();
+    upperBounds.clear();
+    BoundsFilename = it->first;
+    get_bounds();
+    GenerateBatch(FunctionCFGMap, it->second);
   }
+  return true;
+}
+
+/** Library interface (CFCount.h) **/
+
+namespace cfcount {
+
+// Calls of engines that use the module and the generator's globals
+static std::mutex engineMutex;
+
+struct Engine::Impl {
+  // The module, when the engine loaded it
+  std::unique_ptr<LLVMContext> context;
+  std::unique_ptr<Module> owned;
+  Module *module;
+  std::map<std::string, std::map<std::string, CFGNode *> > FunctionCFGMap;
+  // Globals of the module (see PrepareModule), set again when another
+  // engine used them last
+  std::string moduleHash;
+  std::vector<std::string> blockNames;
+  std::map<std::string, uint32_t> functionIds;
+  // The generator before any path
+  GenState initial;
+
+  // Engine whose module the globals are of
+  static Impl *active;
+
+  ~Impl();
+  void Activate();
 };
+
+Engine::Impl *Engine::Impl::active = NULL;
+
+Engine::Impl::~Impl() {
+  for (auto func = FunctionCFGMap.begin(); func != FunctionCFGMap.end();
+       ++func) {
+    for (auto bb = func->second.begin(); bb != func->second.end(); ++bb) {
+      delete bb->second;
+    }
+  }
+  if (active == this) {
+    active = NULL;
+  }
+}
+
+void Engine::Impl::Activate() {
+  if (active != this) {
+    mod_ptr = module;
+    ::moduleHash = moduleHash;
+    ::blockNames = blockNames;
+    ::functionIds = functionIds;
+    ResolveLibCallModels();
+    active = this;
+  }
+  std::vector<std::string> empty;
+  RestoreGenState(initial, &empty);
+}
+
+Engine::Engine(Module &m) : impl(new Impl) {
+  std::lock_guard<std::mutex> lock(engineMutex);
+  impl->module = &m;
+  PrepareModule(m, &impl->FunctionCFGMap);
+  impl->moduleHash = ::moduleHash;
+  impl->blockNames = ::blockNames;
+  impl->functionIds = ::functionIds;
+  std::vector<std::string> empty;
+  impl->initial = SaveGenState(empty);
+  Impl::active = impl.get();
+}
+
+Engine::~Engine() {
+  std::lock_guard<std::mutex> lock(engineMutex);
+  impl.reset();
+}
+
+std::unique_ptr<Engine> Engine::LoadModule(const std::string &filename,
+                                           std::string *error) {
+  std::unique_ptr<LLVMContext> context(new LLVMContext);
+  SMDiagnostic err;
+  std::unique_ptr<Module> m = parseIRFile(filename, err, *context);
+  if (!m) {
+    *error = err.getMessage().str();
+    return std::unique_ptr<Engine>();
+  }
+  std::unique_ptr<Engine> engine(new Engine(*m));
+  engine->impl->context = std::move(context);
+  engine->impl->owned = std::move(m);
+  return engine;
+}
+
+bool Engine::ReadTrace(const std::string &filename,
+                       std::vector<std::string> *trace) {
+  // Binary traces name blocks by their number in the module, which the
+  // engine keeps its own copy of; no generation state is used
+  return read_trace_file(filename, trace, impl->blockNames,
+                         impl->moduleHash);
+}
+
+std::shared_ptr<const Formula>
+Engine::ModelTrace(const std::vector<std::string> &trace, const Bounds &bounds,
+                   std::string *error, bool inputBits) {
+  if (trace.empty()) {
+    *error = "empty trace";
+    return std::shared_ptr<const Formula>();
+  }
+  std::lock_guard<std::mutex> lock(engineMutex);
+  impl->Activate();
+
+  lowerBounds.clear();
+  upperBounds.clear();
+  for (int i = 0; i < bounds.size(); i++) {
+    lowerBounds.push_back(bounds[i].first);
+    upperBounds.push_back(bounds[i].second);
+  }
+  // Input bits are declared when there is an inputs file to record
+  // them in
+  std::string inputsFilename = InputsFilename;
+  InputsFilename = inputBits ? "<formula>" : "";
+
+  std::vector<std::string> result = ModelPath(impl->FunctionCFGMap, trace);
+  InputsFilename = inputsFilename;
+  if (pathError != "") {
+    *error = pathError;
+    return std::shared_ptr<const Formula>();
+  }
+
+  std::shared_ptr<Formula> formula(new Formula);
+  formula->script = GetZ3PyScript(result);
+  formula->bools = boolVars;
+  formula->inputBits = ::inputBits;
+  return formula;
+}
+
+bool Engine::ReadBounds(const std::string &filename, Bounds *bounds) {
+  std::ifstream bounds_file(filename);
+  if (!bounds_file.is_open()) {
+    return false;
+  }
+  bounds->clear();
+  int lower, upper;
+  while (bounds_file >> lower >> upper) {
+    bounds->push_back(std::make_pair(lower, upper));
+  }
+  return true;
+}
+
+std::string Engine::Emit(const Formula &formula, FormulaFormat format) {
+  if (format == Z3PyScript) {
+    return formula.script;
+  }
+  const std::vector<std::string> &names =
+      format == BoolNames ? formula.bools : formula.inputBits;
+  std::string result;
+  for (int i = 0; i < names.size(); i++) {
+    result += names[i] + "\n";
+  }
+  return result;
+}
+
+bool Engine::Emit(const Formula &formula, FormulaFormat format,
+                  const std::string &filename) {
+  return WriteWholeFile(filename, Emit(formula, format));
+}
+
+bool Engine::Count(const Formula &formula,
+                   const std::vector<std::string> &command,
+                   std::string *output) {
+  if (command.empty()) {
+    return false;
+  }
+  SmallString<128> path;
+  if (sys::fs::createUniqueDirectory("cfcount", path)) {
+    return false;
+  }
+  std::string dir = path.str().str();
+  std::vector<std::string> args = command;
+  args.push_back(dir + "/z3.py");
+  args.push_back(dir + "/bools");
+  bool written = Emit(formula, Z3PyScript, dir + "/z3.py") &&
+                 Emit(formula, BoolNames, dir + "/bools");
+  if (!formula.inputBits.empty()) {
+    written = written && Emit(formula, InputBitNames, dir + "/inputs");
+    args.push_back(dir + "/inputs");
+  }
+  // The count command leaves its intermediate files next to the script
+  bool success = written && RunProgram(args, output);
+  RemoveCacheEntry(dir);
+  return success;
+}
+
+} // namespace cfcount
+
+/** Daemon mode (-cfcount-serve) **/
+
+// Connection of the request being served, for reporting fatal errors
+int requestConn = -1;
+
+// Send a whole reply over a connection
+void SendReply(int conn, std::string reply) {
+  const char *data = reply.data();
+  size_t left = reply.size();
+  while (left > 0) {
+    ssize_t sent = write(conn, data, left);
+    if (sent < 0 && errno == EINTR) {
+      continue;
+    }
+    if (sent <= 0) {
+      return;
+    }
+    data += sent;
+    left -= sent;
+  }
+}
+
+// Report fatal errors of LLVM while serving a request to the client
+// instead of only to the daemon's stderr
+void RequestFatalError(void *user_data, const std::string &reason,
+                       bool gen_crash_diag) {
+  SendReply(requestConn, "error " + reason + "\n");
+}
+
+// Serve a single request. Runs in its own process (forked from the
+// daemon), so all of the per-path state starts out empty and nothing
+// leaks into the next request.
+//
+// A request is a list of "key value" lines ending with an empty line
+// (or the end of the connection):
+//   trace <file> | trace-inline <bb> <bb> ...
+//   bounds <file> | bounds-inline <lower> <upper> ...
+//   bool <file>       (required) as <bool file>
+//   inputs <file>     as -cfcount-inputs-file
+//   z3 <file>         write the Z3Py script to <file> instead of
+//                     replying with it
+//   count             reply with the output of -cfcount-count-command
+//                     (needs z3)
+//   no-cache          do not use the cache for this request
+// The reply is "ok" followed by the script or count, or "error <reason>"
+// (e.g. for an infeasible path)
+void ServeRequest(
+    int conn,
+    std::map<std::string, std::map<std::string, CFGNode *> > &FunctionCFGMap) {
+
+  requestConn = conn;
+  install_fatal_error_handler(RequestFatalError, NULL);
+
+  // Only report the work of this request
+  ResetStats();
+
+  FILE *in = fdopen(dup(conn), "r");
+  std::stringstream traceInline, boundsInline;
+  bool count = false;
+  TraceFilename = "";
+  BoundsFilename = "";
+  Z3Filename = "";
+  BoolFilename = "";
+  InputsFilename = "";
+
+  char *line = NULL;
+  size_t cap = 0;
+  ssize_t len;
+  while (in && (len = getline(&line, &cap, in)) > 0) {
+    std::string req(line, len);
+    req.erase(req.find_last_not_of("\r\n") + 1);
+    if (req == "") {
+      break;
+    }
+    std::string key = req.substr(0, req.find(" "));
+    std::string value =
+        req.find(" ") == std::string::npos ? "" : req.substr(req.find(" ") + 1);
+    if (key == "trace") {
+      TraceFilename = value;
+    } else if (key == "trace-inline") {
+      traceInline << value << "\n";
+    } else if (key == "bounds") {
+      BoundsFilename = value;
+    } else if (key == "bounds-inline") {
+      boundsInline << value << "\n";
+    } else if (key == "bool") {
+      BoolFilename = value;
+    } else if (key == "inputs") {
+      InputsFilename = value;
+    } else if (key == "z3") {
+      Z3Filename = value;
+    } else if (key == "count") {
+      count = true;
+    } else if (key == "no-cache") {
+      NoCache = true;
+    } else if (key == "stats") {
+      StatsJSONFilename = value;
+    } else {
+      SendReply(conn, "error unknown request line: " + req + "\n");
+      free(line);
+      fclose(in);
+      return;
+    }
+  }
+  free(line);
+  if (in) {
+    fclose(in);
+  }
+
+  if (BoolFilename == "") {
+    SendReply(conn, "error request needs a bool file\n");
+    return;
+  }
+  if (count && Z3Filename == "") {
+    SendReply(conn, "error count request needs a z3 file\n");
+    return;
+  }
+
+  // Both files are appended to while the path is generated
+  std::ofstream(std::string(BoolFilename)).close();
+  if (InputsFilename != "") {
+    std::ofstream(std::string(InputsFilename)).close();
+  }
+
+  PhaseTimer parseTimer("parse trace");
+  std::vector<std::string> bb_trace;
+  if (TraceFilename != "") {
+    bb_trace = get_trace();
+  } else {
+    bb_trace = read_trace(traceInline);
+  }
+  if (bb_trace.empty()) {
+    SendReply(conn, "error empty trace\n");
+    return;
+  }
+  if (BoundsFilename != "") {
+    get_bounds();
+  } else {
+    read_bounds(boundsInline);
+  }
+  parseTimer.Stop();
+
+  std::string cacheKey = GetCacheKey(bb_trace);
+  std::string script;
+  bool cached = LoadCachedPath(cacheKey, Z3Filename, BoolFilename,
+                               InputsFilename, &script);
+  if (!cached) {
+    std::vector<std::string> result = ModelPath(FunctionCFGMap, bb_trace);
+    if (pathError != "") {
+      SendReply(conn, "error " + pathError + "\n");
+      return;
+    }
+    PhaseTimer timer("write outputs");
+    WriteBoolFiles(BoolFilename, InputsFilename);
+    script = GetZ3PyScript(result);
+    if (Z3Filename != "") {
+      WriteWholeFile(Z3Filename, script);
+    }
+    StoreCachedPath(cacheKey, script);
+  }
+
+  std::string reply = "ok\n";
+  if (Z3Filename == "") {
+    reply += script;
+  } else if (count) {
+    std::string output;
+    if (!cached || !LoadCachedCount(cacheKey, Z3Filename, &output)) {
+      if (!RunCountCommand(Z3Filename, BoolFilename, InputsFilename,
+                           &output)) {
+        SendReply(conn, "error count command failed: " + output + "\n");
+        return;
+      }
+      StoreCachedCount(cacheKey, Z3Filename, output);
+    }
+    reply += output;
+  }
+
+  // The report is complete once the reply arrives
+  if (StatsJSONFilename != "") {
+    WriteStatsJSON(StatsJSONFilename);
+  }
+  SendReply(conn, reply);
+}
+
+// Accept requests on the daemon's socket until it is killed. Each
+// request is served by a child process, so requests can run at the
+// same time and never see each other's state. Returns false, with the
+// reason in *error, if the socket cannot be served on
+bool Serve(
+    std::map<std::string, std::map<std::string, CFGNode *> > &FunctionCFGMap,
+    std::string *error) {
+
+  int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (ServeSocket.size() >= sizeof(addr.sun_path)) {
+    *error = "Serve Error: socket path is too long";
+    return false;
+  }
+  strcpy(addr.sun_path, ServeSocket.c_str());
+
+  // Replace the socket of a previous daemon
+  unlink(addr.sun_path);
+  if (sock < 0 || bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      listen(sock, 64) != 0) {
+    *error = "Serve Error: cannot listen on " + ServeSocket + ": " +
+             strerror(errno);
+    return false;
+  }
+  llvm::errs() << "Serving requests on " << ServeSocket << "\n";
+
+  // Children are reaped automatically
+  signal(SIGCHLD, SIG_IGN);
+
+  while (true) {
+    int conn = accept(sock, NULL, NULL);
+    if (conn < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      *error = std::string("Serve Error: accept failed: ") + strerror(errno);
+      break;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+      close(sock);
+      // The checker and count command are waited for
+      signal(SIGCHLD, SIG_DFL);
+      ServeRequest(conn, FunctionCFGMap);
+      close(conn);
+      _exit(0);
+    }
+    if (pid < 0) {
+      SendReply(conn, "error cannot fork\n");
+    }
+    close(conn);
+  }
+
+  close(sock);
+  return false;
+}
+
+/** The passes (CFCountPass.cpp) **/
+
+namespace cfcount {
+
+bool RunPass(Module &m, const PassOptions &options, std::string *error) {
+
+  TraceFilename = options.traceFile;
+  Z3Filename = options.z3File;
+  BoundsFilename = options.boundsFile;
+  BoolFilename = options.boolFile;
+  InputsFilename = options.inputsFile;
+  ServeSocket = options.serveSocket;
+  BatchFilename = options.batchFile;
+  BatchCount = options.batchCount;
+  Online = options.online;
+  OnlineQueueDepth = options.onlineQueueDepth;
+  CacheDir = options.cacheDir;
+  CacheSize = options.cacheSize;
+  NoCache = options.noCache;
+  StatsJSONFilename = options.statsJSONFile;
+  CountCommand = options.countCommand;
+
+  std::map<std::string, std::map<std::string, CFGNode *> > FunctionCFGMap;
+
+  // Rename the module and build its CFG (or load them from the index)
+  PrepareModule(m, &FunctionCFGMap);
+
+  // Keep the module resident and model the paths of requests
+  if (ServeSocket != "") {
+    return Serve(FunctionCFGMap, error);
+  }
+
+  // Model the paths of a batch of traces that share prefixes
+  if (BatchFilename != "") {
+    if (!RunBatch(FunctionCFGMap, error)) {
+      return false;
+    }
+    if (StatsJSONFilename != "") {
+      WriteStatsJSON(StatsJSONFilename);
+    }
+    return true;
+  }
+
+  if (TraceFilename == "" || Z3Filename == "" || BoundsFilename == "" ||
+      BoolFilename == "") {
+    *error = "CFCountPass needs <trace file> <z3 file> <bounds file> "
+             "<bool file>";
+    return false;
+  }
+  if (NoBounds && InputsFilename == "") {
+    *error = "-cfcount-no-bounds needs -cfcount-inputs-file";
+    return false;
+  }
+
+  // Model the trace while it is being written. The whole trace is
+  // never in memory, so there is no cache key for it
+  if (Online) {
+    get_bounds();
+    {
+      PhaseTimer timer("online pipeline");
+      ModelPathOnline(FunctionCFGMap);
+    }
+    if (pathError != "") {
+      *error = pathError;
+      return false;
+    }
+    if (StatsJSONFilename != "") {
+      WriteStatsJSON(StatsJSONFilename);
+    }
+    return true;
+  }
+
+  // Get the trace being modeled
+  std::vector<std::string> bb_trace;
+  {
+    PhaseTimer timer("parse trace");
+    bb_trace = get_trace();
+    get_bounds();
+  }
+
+  // The path may have been generated before
+  std::string cacheKey = GetCacheKey(bb_trace);
+  if (LoadCachedPath(cacheKey, Z3Filename, BoolFilename, InputsFilename,
+                     NULL)) {
+    llvm::errs() << "Path loaded from the cache\n";
+  } else {
+    // Get the Z3 constraints the encode the behavior of the
+    // program path being modeled
+    std::vector<std::string> result = ModelPath(FunctionCFGMap, bb_trace);
+    if (pathError != "") {
+      *error = pathError;
+      return false;
+    }
+    PhaseTimer timer("write outputs");
+    CreateZ3PyFile(result);
+    WriteBoolFiles(BoolFilename, InputsFilename);
+    StoreCachedPath(cacheKey, GetZ3PyScript(result));
+  }
+
+  if (StatsJSONFilename != "") {
+    WriteStatsJSON(StatsJSONFilename);
+  }
+
+  return true;
+}
+
+void InstrumentModule(Module &m) {
+
+  mod_ptr = &m;
+
+  // The blocks are numbered as CFCountPass numbers them, which is
+  // after the same hashing and renaming
+  HashModule(m);
+  rename_bbs();
+  NumberBlocks();
+
+  LLVMContext &context = m.getContext();
+  Type *int32Ty = Type::getInt32Ty(context);
+  Type *voidTy = Type::getVoidTy(context);
+  Constant *blockHook = m.getOrInsertFunction(
+      "__cfcount_trace_block",
+      FunctionType::get(voidTy, std::vector<Type *>(1, int32Ty), false));
+  Constant *callHook = m.getOrInsertFunction(
+      "__cfcount_trace_call",
+      FunctionType::get(voidTy, std::vector<Type *>(1, int32Ty), false));
+  Constant *returnHook = m.getOrInsertFunction(
+      "__cfcount_trace_return", FunctionType::get(voidTy, false));
+
+  // Collect the instrumentation points before adding any call
+  std::vector<Instruction *> blockStarts;
+  std::vector<std::pair<CallInst *, uint32_t> > calls;
+  std::vector<ReturnInst *> returns;
+  for (auto func = m.begin(), func_e = m.end(); func != func_e; ++func) {
+    if (func->isDeclaration()) {
+      continue;
+    }
+    for (Function::iterator bb = func->begin(), bb_e = func->end();
+         bb != bb_e; ++bb) {
+      blockStarts.push_back(&*bb->getFirstInsertionPt());
+      for (BasicBlock::iterator inst = bb->begin(), inst_e = bb->end();
+           inst != inst_e; ++inst) {
+        if (CallInst *ci = dyn_cast<CallInst>(&*inst)) {
+          Function *callee = ci->getCalledFunction();
+          if (callee != NULL && !callee->isDeclaration()) {
+            calls.push_back(
+                std::make_pair(ci, functionIds[callee->getName()]));
+          }
+        } else if (ReturnInst *ri = dyn_cast<ReturnInst>(&*inst)) {
+          returns.push_back(ri);
+        }
+      }
+    }
+  }
+
+  for (uint32_t id = 0; id < blockStarts.size(); id++) {
+    IRBuilder<> builder(blockStarts[id]);
+    builder.CreateCall(blockHook, ConstantInt::get(int32Ty, id));
+  }
+  for (int i = 0; i < calls.size(); i++) {
+    IRBuilder<> builder(calls[i].first);
+    builder.CreateCall(callHook, ConstantInt::get(int32Ty, calls[i].second));
+  }
+  for (int i = 0; i < returns.size(); i++) {
+    IRBuilder<> builder(returns[i]);
+    builder.CreateCall(returnHook, std::vector<Value *>());
+  }
+
+  // The runtime writes the header to the trace as is
+  std::string header(TraceMagic, sizeof(TraceMagic) - 1);
+  AppendTraceWord(&header, TraceVersion);
+  AppendTraceWord(&header, blockNames.size());
+  header += moduleHash;
+  new GlobalVariable(m, ArrayType::get(Type::getInt8Ty(context),
+                                       header.size()),
+                     true, GlobalValue::ExternalLinkage,
+                     ConstantDataArray::getString(context, header, false),
+                     "__cfcount_trace_header");
+  new GlobalVariable(m, int32Ty, true, GlobalValue::ExternalLinkage,
+                     ConstantInt::get(int32Ty, header.size()),
+                     "__cfcount_trace_header_size");
+
+  llvm::errs() << "CFCountTracer: " << blockStarts.size() << " blocks, "
+               << calls.size() << " calls, " << returns.size()
+               << " returns instrumented\n";
 }
 
-char Hello2::ID = 0;
-static RegisterPass<Hello2>
-Y("CFCountPass",
-  "Pass for generating a Z3 SAT representation of a program's execution path");
+} // namespace cfcount
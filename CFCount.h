@@ -0,0 +1,131 @@
+// CFCount.h
+// Library interface of CFCount (LLVMCFCountEngine): loads a module once
+// and models the paths of its traces in process, as CFCountPass does for
+// the one trace of each run of opt. The options of the engine (e.g.
+// -cfcount-summarize-loops) apply to the library too, through
+// cl::ParseCommandLineOptions; the files and modes of the pass are its
+// own (see PassOptions). The passes themselves (CFCountPass.cpp) are
+// built on RunPass and InstrumentModule.
+//
+// Constraint generation keeps its state in globals (see CFCount.cpp), so
+// the ModelTrace calls of every Engine of the process run one at a time,
+// from any thread. Reading traces, emitting and counting formulas do not
+// use that state and run in parallel
+
+#ifndef CFCOUNT_CFCOUNT_H
+#define CFCOUNT_CFCOUNT_H
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace llvm {
+class Module;
+}
+
+namespace cfcount {
+
+// Lower and upper bound of each input, in the order the program reads
+// them (the pairs of a bounds file)
+typedef std::vector<std::pair<int, int> > Bounds;
+
+// Model of the path of a trace
+struct Formula {
+  // Z3Py script that prints the SAT formula of the path
+  std::string script;
+  // Bools declared by the script (the bool file of the pass)
+  std::vector<std::string> bools;
+  // Bools of the input bits, in bounds order, least significant bit
+  // first (the -cfcount-inputs-file of the pass)
+  std::vector<std::string> inputBits;
+};
+
+// What Emit writes of a formula: its script or the contents of its bool
+// or inputs file, which scripts/convert.py reads
+enum FormulaFormat { Z3PyScript, BoolNames, InputBitNames };
+
+class Engine {
+public:
+  // Load a module from a bitcode (or textual IR) file. Returns NULL, with
+  // the reason in *error, if it cannot be read
+  static std::unique_ptr<Engine> LoadModule(const std::string &filename,
+                                            std::string *error);
+  // Model the paths of a module owned by the caller, which is renamed as
+  // CFCountPass renames it and must outlive the engine
+  explicit Engine(llvm::Module &m);
+  ~Engine();
+
+  // Read the blocks of a trace file (text, or binary from a program
+  // instrumented with CFCountTracer). Returns false if it cannot be read
+  bool ReadTrace(const std::string &filename, std::vector<std::string> *trace);
+
+  // Model the path a trace takes within the bounds of its inputs. With
+  // inputBits the formula declares a Bool for every input bit. Returns
+  // NULL, with the reason in *error, if the path cannot be modeled (an
+  // empty trace, or a path -cfcount-check-every finds infeasible)
+  std::shared_ptr<const Formula>
+  ModelTrace(const std::vector<std::string> &trace, const Bounds &bounds,
+             std::string *error, bool inputBits = false);
+
+  // Read a bounds file. Returns false if it cannot be read
+  static bool ReadBounds(const std::string &filename, Bounds *bounds);
+
+  // A formula in one of the formats of the files of the pass
+  static std::string Emit(const Formula &formula, FormulaFormat format);
+  // Write a formula to a file. Returns false if it cannot be written
+  static bool Emit(const Formula &formula, FormulaFormat format,
+                   const std::string &filename);
+
+  // Count a formula with a count command: the program (looked up in
+  // PATH) and its first arguments, run without a shell with the z3, bool
+  // and inputs files of the formula added (e.g. scripts/count_path.sh,
+  // whose counter is the model counting engine). Returns false if the
+  // command failed; *output has what it printed
+  static bool Count(const Formula &formula,
+                    const std::vector<std::string> &command,
+                    std::string *output);
+
+private:
+  struct Impl;
+  std::unique_ptr<Impl> impl;
+};
+
+// Files and modes of a run of CFCountPass, its options on the opt
+// command line (see the README)
+struct PassOptions {
+  // <trace file> <z3 file> <bounds file> <bool file>, and
+  // -cfcount-inputs-file
+  std::string traceFile;
+  std::string z3File;
+  std::string boundsFile;
+  std::string boolFile;
+  std::string inputsFile;
+  // -cfcount-serve, -cfcount-batch (-cfcount-batch-count) and
+  // -cfcount-online (-cfcount-online-queue)
+  std::string serveSocket;
+  std::string batchFile;
+  bool batchCount = false;
+  bool online = false;
+  unsigned onlineQueueDepth = 16;
+  // -cfcount-cache-dir, -cfcount-cache-size and -cfcount-no-cache
+  std::string cacheDir;
+  unsigned cacheSize = 1024;
+  bool noCache = false;
+  // -cfcount-stats-json and -cfcount-count-command
+  std::string statsJSONFile;
+  std::string countCommand = "scripts/count_path.sh";
+};
+
+// Run CFCountPass on a module: model the path of its trace, a batch of
+// traces, or serve requests until killed. Returns false, with the reason
+// in *error, if the run fails (e.g. missing files or an infeasible path)
+bool RunPass(llvm::Module &m, const PassOptions &options, std::string *error);
+
+// Instrument a module to write the binary traces CFCountPass reads
+// (CFCountTracer)
+void InstrumentModule(llvm::Module &m);
+
+} // namespace cfcount
+
+#endif
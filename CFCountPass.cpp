@@ -0,0 +1,160 @@
+// CFCountPass.cpp
+// The passes opt loads from LLVMCFCount: CFCountPass, which models the
+// path of a trace, and CFCountTracer, which instruments a program to
+// write binary traces. They only take their options from the command
+// line and run the engine (CFCount.h), linked in from LLVMCFCountEngine
+
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ErrorHandling.h"
+
+#include <string>
+
+#include "CFCount.h"
+
+using namespace llvm;
+
+/** Required Parameters for LLVM Pass **/
+/** (not used with -cfcount-serve or -cfcount-batch, where each **/
+/** request or trace names its own) **/
+
+// Trace file indicating what path in the program is being modeled
+static cl::opt<std::string> TraceFilename(cl::Positional, cl::Optional,
+                                          cl::desc("<trace file>"));
+// Name of the resulting Z3Py file that converts path conditions to Z3's SAT
+// format
+static cl::opt<std::string> Z3Filename(cl::Positional, cl::Optional,
+                                       cl::desc("<z3 file>"));
+// File indicating the upper and lower bounds of input variables in the program
+// being modeled
+static cl::opt<std::string> BoundsFilename(cl::Positional, cl::Optional,
+                                           cl::desc("<bounds file>"));
+// File to track the name of boolean variables created in the model
+// (needed later when converting Z3's output to standard SAT format, CNF
+static cl::opt<std::string> BoolFilename(cl::Positional, cl::Optional,
+                                         cl::desc("<bool file>"));
+
+/** Optional Parameters for LLVM Pass **/
+/** (the options of the engine itself are in CFCount.cpp) **/
+
+// File to record the Bool variables that name the bits of each input
+// (used later to mark the input bits in the CNF)
+static cl::opt<std::string> InputsFilename(
+    "cfcount-inputs-file", cl::init(""),
+    cl::desc("File to record the Bool variables of the input bits"));
+
+// Unix domain socket to serve requests on. The module is loaded and its
+// CFG built once, then each request only pays for its own trace
+static cl::opt<std::string> ServeSocket(
+    "cfcount-serve", cl::init(""),
+    cl::desc("Serve path requests on this Unix domain socket"));
+// File listing traces to model in one run, sharing the work of
+// their common prefixes
+static cl::opt<std::string> BatchFilename(
+    "cfcount-batch", cl::init(""),
+    cl::desc("Model the traces listed in this file"));
+// Also count the paths of the batch
+static cl::opt<bool> BatchCount(
+    "cfcount-batch-count", cl::init(false),
+    cl::desc("Count each path of the batch into <z3 file>.count"));
+
+// Read the trace from a pipe or FIFO while the traced program writes it,
+// reading, inlining and generating constraints at the same time
+static cl::opt<bool> Online(
+    "cfcount-online", cl::init(false),
+    cl::desc("Model the trace while it is written (pipe, FIFO or \"-\")"));
+// Batches of blocks (and of instructions) each stage of -cfcount-online
+// can get ahead of the next one
+static cl::opt<unsigned> OnlineQueueDepth(
+    "cfcount-online-queue", cl::init(16),
+    cl::desc("Batches queued between the stages of -cfcount-online"));
+
+// Cache of generated paths and counts, indexed by the module, trace
+// and bounds they were generated from
+static cl::opt<std::string> CacheDir(
+    "cfcount-cache-dir", cl::init(""),
+    cl::desc("Cache directory (default $HOME/.cache/cfcount)"));
+static cl::opt<unsigned> CacheSize(
+    "cfcount-cache-size", cl::init(1024),
+    cl::desc("Size of the cache in MB before old entries are evicted"));
+static cl::opt<bool> NoCache("cfcount-no-cache", cl::init(false),
+                             cl::desc("Do not use the cache"));
+
+// JSON report of the time spent in each phase and of the statistics
+static cl::opt<std::string> StatsJSONFilename(
+    "cfcount-stats-json", cl::init(""),
+    cl::desc("Write a JSON report of phase times and statistics"));
+
+// Program run by "count" requests on the generated files (without a
+// shell, the filenames of requests are its arguments as they are)
+static cl::opt<std::string> CountCommand(
+    "cfcount-count-command", cl::init("scripts/count_path.sh"),
+    cl::desc("Program that counts the path from the generated files"));
+
+/***************************************/
+
+namespace {
+struct Hello2 : public ModulePass {
+  static char ID; // Pass identification, replacement for typeid
+  Hello2() : ModulePass(ID) {}
+
+  bool runOnModule(Module &m) override {
+
+    cfcount::PassOptions options;
+    options.traceFile = TraceFilename;
+    options.z3File = Z3Filename;
+    options.boundsFile = BoundsFilename;
+    options.boolFile = BoolFilename;
+    options.inputsFile = InputsFilename;
+    options.serveSocket = ServeSocket;
+    options.batchFile = BatchFilename;
+    options.batchCount = BatchCount;
+    options.online = Online;
+    options.onlineQueueDepth = OnlineQueueDepth;
+    options.cacheDir = CacheDir;
+    options.cacheSize = CacheSize;
+    options.noCache = NoCache;
+    options.statsJSONFile = StatsJSONFilename;
+    options.countCommand = CountCommand;
+
+    std::string error;
+    if (!cfcount::RunPass(m, options, &error)) {
+      report_fatal_error(Twine(error), false);
+    }
+    return false;
+  }
+
+  // We don't modify the program, so we preserve all analyses.
+  void getAnalysisUsage(AnalysisUsage &AU) const override {
+    // AU.setPreservesAll();
+  }
+};
+}
+
+char Hello2::ID = 0;
+static RegisterPass<Hello2>
+Y("CFCountPass",
+  "Pass for generating a Z3 SAT representation of a program's execution path");
+
+namespace {
+// Instruments a program to write the binary traces CFCountPass reads:
+// every block records its id when it starts, calls of defined functions
+// and returns record themselves too. The records are kept in per-thread
+// buffers by the runtime (runtime/cfcount_trace_rt.c, linked with the
+// program) and written out in large chunks, to $CFCOUNT_TRACE
+struct CFCountTracer : public ModulePass {
+  static char ID;
+  CFCountTracer() : ModulePass(ID) {}
+
+  bool runOnModule(Module &m) override {
+    cfcount::InstrumentModule(m);
+    return true;
+  }
+};
+}
+
+char CFCountTracer::ID = 0;
+static RegisterPass<CFCountTracer>
+T("CFCountTracer",
+  "Instrument a program to write binary block traces for CFCountPass");
@@ -0,0 +1,323 @@
+from __future__ import print_function
+
+import argparse
+import glob
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+
+# Checks of the counting/ tools on the small CNFs of bench/cnf. Each
+# fixture states its model count ("c count <n>"), which is checked
+# against a brute force count first; the count of every tool on the
+# fixture must then be the same: the CNF cfcount-preprocess writes,
+# cfcount-components and cfcount-cubes (with this script as their
+# counter, forcing every component and cube through it too),
+# cfcount-ddnnf with and without bounds and cfcount-approx (exact below
+# its cell threshold, within its tolerance above). cfcount-sample must
+# only draw models, and every model within the bounds of small ones;
+# cfcount-convert must give goal.z3 its count.
+#
+# Exits with 1 if a check fails.
+
+bench_dir = os.path.dirname(os.path.abspath(__file__))
+cnf_dir = os.path.join(bench_dir, "cnf")
+
+# Models of goal.z3 over its input bits: bit 0 or bit 1, not bit 2, and
+# bit 3, which is in no clause, free
+goal_count = 6
+
+# Tolerance the approximate counts are checked with (-epsilon)
+approx_epsilon = 0.8
+
+
+class CNF(object):
+    def __init__(self, path):
+        self.num_vars = 0
+        self.clauses = []
+        self.projection = None
+        self.inputs = {}
+        self.count = None
+        clause = []
+        with open(path) as f:
+            for line in f:
+                fields = line.split()
+                if not fields:
+                    continue
+                if fields[0] == "c":
+                    if fields[1:2] == ["count"]:
+                        self.count = int(fields[2])
+                    elif fields[1:2] == ["ind"]:
+                        self.projection = [int(v) for v in fields[2:-1]]
+                    elif fields[1:2] == ["input"]:
+                        width = int(fields[3])
+                        self.inputs[int(fields[2])] = \
+                            [int(v) for v in fields[4:4 + width]]
+                    continue
+                if fields[0] == "p":
+                    self.num_vars = int(fields[2])
+                    continue
+                for lit in map(int, fields):
+                    if lit == 0:
+                        self.clauses.append(clause)
+                        clause = []
+                    else:
+                        clause.append(lit)
+                        self.num_vars = max(self.num_vars, abs(lit))
+
+    def counted_vars(self):
+        if self.projection is None:
+            return list(range(1, self.num_vars + 1))
+        return self.projection
+
+    def models(self):
+        # Assignments of the counted variables that extend to a model,
+        # each one a dict of var -> bool
+        masks = []
+        for clause in self.clauses:
+            pos = neg = 0
+            for lit in clause:
+                if lit > 0:
+                    pos |= 1 << (lit - 1)
+                else:
+                    neg |= 1 << (-lit - 1)
+            masks.append((pos, neg))
+        counted = self.counted_vars()
+        full = (1 << self.num_vars) - 1
+        found = set()
+        for a in range(1 << self.num_vars):
+            if all((a & pos) or (~a & full & neg) for pos, neg in masks):
+                found.add(tuple(bool(a >> (v - 1) & 1) for v in counted))
+        return [dict(zip(counted, values)) for values in found]
+
+    def input_values(self, model):
+        # Signed value of each input in a model
+        values = []
+        for i in sorted(self.inputs):
+            bits = self.inputs[i]
+            value = sum(1 << b for b, v in enumerate(bits) if model[v])
+            if model[bits[-1]]:
+                value -= 1 << len(bits)
+            values.append(value)
+        return tuple(values)
+
+
+def brute_force_count(path):
+    return len(CNF(path).models())
+
+
+def read_bounds(path):
+    with open(path) as f:
+        values = [int(v) for v in f.read().split()]
+    return list(zip(values[::2], values[1::2]))
+
+
+def models_in_bounds(cnf, bounds):
+    result = set()
+    for model in cnf.models():
+        values = cnf.input_values(model)
+        if all(lower <= v <= upper for v, (lower, upper) in
+               zip(values, bounds)):
+            result.add(values)
+    return result
+
+
+def parse_count(output):
+    # sharpSAT's format: "# solutions" followed by the count
+    lines = [l.strip() for l in output.splitlines()]
+    for i in range(len(lines) - 1):
+        if lines[i].startswith("# solutions"):
+            return int(lines[i + 1])
+    return None
+
+
+class Checker(object):
+    def __init__(self, args, work_dir):
+        self.args = args
+        self.work_dir = work_dir
+        self.failed = 0
+        self.checks = 0
+        # The tools run this script with -count as their counter
+        self.counter = '"%s" "%s" -count' % (sys.executable,
+                                             os.path.abspath(__file__))
+
+    def tool(self, name):
+        if self.args.tools:
+            return os.path.join(self.args.tools, name)
+        return name
+
+    def run(self, cmd):
+        p = subprocess.Popen(cmd, stdout=subprocess.PIPE,
+                             stderr=subprocess.PIPE)
+        out, err = p.communicate()
+        return p.returncode, out.decode(), err.decode()
+
+    def check(self, what, ok, detail=""):
+        self.checks += 1
+        if not ok:
+            self.failed += 1
+            print("FAIL %s%s" % (what, ": " + detail if detail else ""))
+        elif self.args.verbose:
+            print("ok   %s" % what)
+
+    def check_count(self, what, cmd, expected):
+        status, out, err = self.run(cmd)
+        count = parse_count(out) if status == 0 else None
+        self.check(what, count == expected,
+                   "counted %s, expected %d (exit %d) %s" %
+                   (count, expected, status, err.strip()))
+        return count
+
+    def work_file(self, name):
+        return os.path.join(self.work_dir, name)
+
+    def check_fixture(self, path):
+        name = os.path.splitext(os.path.basename(path))[0]
+        cnf = CNF(path)
+        expected = cnf.count
+        brute = len(cnf.models())
+        self.check(name + ": brute force", brute == expected,
+                   "counted %d, the fixture says %s" % (brute, expected))
+
+        # Preprocessing keeps the count, and the components of its
+        # output count the same
+        pre = self.work_file(name + ".pre.cnf")
+        status, _, err = self.run([self.tool("cfcount-preprocess"), path,
+                                   pre])
+        self.check(name + ": preprocess", status == 0, err.strip())
+        if status == 0:
+            count = brute_force_count(pre)
+            self.check(name + ": preprocess count", count == expected,
+                       "counted %d, expected %d" % (count, expected))
+            self.check_count(name + ": components of preprocessed",
+                             [self.tool("cfcount-components"),
+                              "-counter=" + self.counter, "-j=2", pre],
+                             expected)
+
+        for enumerate_vars in [0, 12]:
+            self.check_count(
+                "%s: components -enumerate-vars=%d" % (name, enumerate_vars),
+                [self.tool("cfcount-components"), "-counter=" + self.counter,
+                 "-j=2", "-enumerate-vars=%d" % enumerate_vars, path],
+                expected)
+        self.check_count(name + ": cubes",
+                         [self.tool("cfcount-cubes"),
+                          "-counter=" + self.counter, "-j=2",
+                          "-split-bits=2", "-enumerate-vars=0",
+                          "-queue-dir=" + self.work_file(name + ".cubes"),
+                          path], expected)
+
+        # d-DNNF, counted over all values of the input bits and in
+        # the bounds of the fixture
+        nnf = self.work_file(name + ".nnf")
+        status, _, err = self.run([self.tool("cfcount-ddnnf"), "-compile",
+                                   path, nnf])
+        self.check(name + ": ddnnf -compile", status == 0, err.strip())
+        bounds = os.path.splitext(path)[0] + ".bounds"
+        if status == 0:
+            self.check_count(name + ": ddnnf", [self.tool("cfcount-ddnnf"),
+                                                nnf], expected)
+            if os.path.exists(bounds):
+                in_bounds = models_in_bounds(cnf, read_bounds(bounds))
+                self.check_count(name + ": ddnnf in bounds",
+                                 [self.tool("cfcount-ddnnf"), nnf, bounds],
+                                 len(in_bounds))
+                self.check_samples(name, cnf, path, bounds, in_bounds)
+
+        # Approximate counts are exact below the cell threshold
+        status, out, err = self.run([self.tool("cfcount-approx"),
+                                     "-epsilon=%g" % approx_epsilon, "-j=2",
+                                     path])
+        estimate = parse_count(out) if status == 0 else None
+        if expected == 0:
+            ok = estimate == 0
+        else:
+            ok = estimate is not None and \
+                expected <= estimate * (1 + approx_epsilon) and \
+                estimate <= expected * (1 + approx_epsilon)
+        self.check(name + ": approx", ok,
+                   "estimated %s, expected %d (exit %d) %s" %
+                   (estimate, expected, status, err.strip()))
+
+    def check_samples(self, name, cnf, path, bounds, in_bounds):
+        # Every sample is a model within the bounds, and with many more
+        # samples than models every model is drawn
+        for nnf_mode in [False, True]:
+            what = name + (": sample -nnf" if nnf_mode else ": sample")
+            cmd = [self.tool("cfcount-sample"), "-n=200", "-j=2"]
+            if nnf_mode:
+                cmd += ["-nnf", self.work_file(name + ".nnf")]
+            else:
+                cmd += [path]
+            status, out, err = self.run(cmd + [bounds])
+            self.check(what, status == 0, err.strip())
+            if status != 0:
+                continue
+            samples = [tuple(int(v) for v in line.split())
+                       for line in out.splitlines() if line.strip()]
+            self.check(what + " count", len(samples) == 200,
+                       "%d samples" % len(samples))
+            drawn = set(samples)
+            self.check(what + " models", drawn <= in_bounds,
+                       "not models: %s" % sorted(drawn - in_bounds))
+            self.check(what + " coverage", drawn == in_bounds,
+                       "never drawn: %s" % sorted(in_bounds - drawn))
+
+    def check_convert(self):
+        goal = os.path.join(cnf_dir, "goal")
+        status, out, err = self.run([self.tool("cfcount-convert"),
+                                     goal + ".z3", goal + ".bools",
+                                     goal + ".inputs"])
+        self.check("goal: convert", status == 0, err.strip())
+        if status != 0:
+            return
+        converted = self.work_file("goal.cnf")
+        with open(converted, "w") as f:
+            f.write(out)
+        cnf = CNF(converted)
+        self.check("goal: convert inputs", len(cnf.inputs.get(0, [])) == 4,
+                   "input bits %s" % cnf.inputs)
+        count = len(cnf.models())
+        self.check("goal: convert count", count == goal_count,
+                   "counted %d, expected %d" % (count, goal_count))
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Check the counts of the counting tools on small CNFs")
+    parser.add_argument("-tools", default="",
+                        help="directory of the cfcount-* tools (default: "
+                             "the PATH)")
+    parser.add_argument("-o", dest="out_dir", default="",
+                        help="keep the files of the checks in this "
+                             "directory")
+    parser.add_argument("-v", dest="verbose", action="store_true",
+                        help="print the checks that pass too")
+    parser.add_argument("-count", metavar="<cnf>",
+                        help="count a CNF by brute force, in sharpSAT's "
+                             "format (the counter the tools are run with)")
+    args = parser.parse_args()
+
+    if args.count:
+        print("# solutions \n%d\n# END" % brute_force_count(args.count))
+        return 0
+
+    work_dir = args.out_dir or tempfile.mkdtemp(prefix="cfcount-check")
+    if not os.path.isdir(work_dir):
+        os.makedirs(work_dir)
+    checker = Checker(args, work_dir)
+    try:
+        for path in sorted(glob.glob(os.path.join(cnf_dir, "*.cnf"))):
+            checker.check_fixture(path)
+        checker.check_convert()
+    finally:
+        if not args.out_dir:
+            shutil.rmtree(work_dir)
+
+    print("%d of %d checks failed" % (checker.failed, checker.checks))
+    return 1 if checker.failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
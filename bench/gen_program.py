@@ -0,0 +1,145 @@
+from __future__ import print_function
+
+import argparse
+import os
+import random
+
+# Generates a synthetic C program for the scaling benchmarks, with the
+# bounds file of its inputs and one concrete input (the path that is
+# traced). The shape of the program is set by:
+#
+#   loop_depth  nested loops around the body of main
+#   trip        iterations of each loop (the trace grows as trip^loop_depth)
+#   inputs      number of scanf'd inputs, each one branched on in the body
+#   array_size  elements of the local array the body reads and writes
+#   call_depth  length of the chain of functions called from the body
+#
+# Only constructs CFCount models are used (scanf, int arithmetic,
+# comparisons, local arrays, calls to defined functions and printf)
+
+
+def gen_function(level, call_depth):
+    # f<level> calls f<level + 1>, the last one is a leaf
+    name = "f" + str(level)
+    lines = ["int " + name + "(int a, int b) {"]
+    if level < call_depth:
+        lines += ["  int r = f" + str(level + 1) + "(a + 1, b);",
+                  "  if (r > 10) {",
+                  "    return r - 10;",
+                  "  }",
+                  "  return r + a;"]
+    else:
+        lines += ["  if (a > b) {",
+                  "    return a - b;",
+                  "  }",
+                  "  return b - a + 1;"]
+    lines += ["}", ""]
+    return lines
+
+
+def gen_program(loop_depth, trip, inputs, array_size, call_depth):
+    lines = ["#include <stdio.h>", "",
+             "/* Generated by bench/gen_program.py: loop_depth %d, trip %d, "
+             "inputs %d, array_size %d, call_depth %d */" %
+             (loop_depth, trip, inputs, array_size, call_depth), ""]
+
+    for level in range(call_depth, 0, -1):
+        lines += gen_function(level, call_depth)
+
+    lines += ["int main() {"]
+    for i in range(inputs):
+        lines += ["  int in%d;" % i]
+    for d in range(loop_depth):
+        lines += ["  int i%d;" % d]
+    lines += ["  int k;",
+              "  int arr[%d];" % array_size,
+              "  int acc = 0;", ""]
+    for i in range(inputs):
+        lines += ['  scanf("%%d", &in%d);' % i]
+    lines += ["",
+              "  for (k = 0; k < %d; k++) {" % array_size,
+              "    arr[k] = k;",
+              "  }", ""]
+
+    indent = "  "
+    for d in range(loop_depth):
+        lines += [indent + "for (i%d = 0; i%d < %d; i%d++) {" %
+                  (d, d, trip, d)]
+        indent += "  "
+
+    # The index of the body's array element only depends on the loop
+    # counters, the values stored there depend on the inputs
+    counters = " + ".join(["i%d" % d for d in range(loop_depth)]) or "0"
+    for i in range(inputs):
+        idx = "(%s + %d) %% %d" % (counters, i, array_size)
+        call = "f1(in%d, %s)" % (i, counters) if call_depth > 0 else \
+            "in%d" % i
+        lines += [indent + "arr[%s] = arr[%s] + in%d;" % (idx, idx, i),
+                  indent + "if (arr[%s] > in%d) {" % (idx, (i + 1) % inputs),
+                  indent + "  acc = acc + %s;" % call,
+                  indent + "} else {",
+                  indent + "  acc = acc - 1;",
+                  indent + "}"]
+
+    for d in range(loop_depth):
+        indent = indent[:-2]
+        lines += [indent + "}"]
+
+    lines += ["",
+              "  if (acc > 0) {",
+              '    printf("positive\\n");',
+              "  } else {",
+              '    printf("not positive\\n");',
+              "  }",
+              "  return 0;",
+              "}"]
+    return "\n".join(lines) + "\n"
+
+
+def write_program(out_dir, loop_depth, trip, inputs, array_size, call_depth,
+                  lower, upper, seed):
+    # Writes prog.c, bounds and input to out_dir
+    if not os.path.isdir(out_dir):
+        os.makedirs(out_dir)
+
+    with open(os.path.join(out_dir, "prog.c"), "w") as f:
+        f.write(gen_program(loop_depth, trip, inputs, array_size, call_depth))
+
+    with open(os.path.join(out_dir, "bounds"), "w") as f:
+        for i in range(inputs):
+            f.write("%d\n%d\n" % (lower, upper))
+
+    rng = random.Random(seed)
+    with open(os.path.join(out_dir, "input"), "w") as f:
+        for i in range(inputs):
+            f.write("%d\n" % rng.randint(lower, upper))
+
+
+def add_shape_arguments(parser):
+    parser.add_argument("-loop-depth", type=int, default=1)
+    parser.add_argument("-trip", type=int, default=4)
+    parser.add_argument("-inputs", type=int, default=2)
+    parser.add_argument("-array-size", type=int, default=4)
+    parser.add_argument("-call-depth", type=int, default=1)
+    parser.add_argument("-lower", type=int, default=0,
+                        help="lower bound of every input")
+    parser.add_argument("-upper", type=int, default=15,
+                        help="upper bound of every input")
+    parser.add_argument("-seed", type=int, default=1,
+                        help="seed of the traced input")
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(
+        description="Generate a benchmark program, its bounds and an input")
+    add_shape_arguments(parser)
+    parser.add_argument("out_dir")
+    args = parser.parse_args()
+
+    if args.inputs < 1 or args.array_size < 1 or args.trip < 0 or \
+            args.loop_depth < 0 or args.call_depth < 0:
+        parser.error("need inputs, array-size >= 1 and no negative shape")
+
+    write_program(args.out_dir, args.loop_depth, args.trip, args.inputs,
+                  args.array_size, args.call_depth, args.lower, args.upper,
+                  args.seed)
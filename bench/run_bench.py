@@ -0,0 +1,253 @@
+from __future__ import print_function
+
+import argparse
+import itertools
+import json
+import os
+import subprocess
+import sys
+import time
+from multiprocessing.pool import ThreadPool
+
+import gen_program
+
+# Scaling benchmarks: generates programs of growing size (one shape
+# parameter at a time), traces them and runs every stage of the pipeline
+# on the trace, recording the time and peak RSS of each stage, the size
+# of the formula and CFCount's own report (-cfcount-stats-json). On small
+# domains the count is checked against brute force enumeration: the
+# traced program is run on every input within the bounds and the inputs
+# that take the same path are counted.
+#
+# Results are written as one JSON object per program to
+# <out dir>/results.jsonl and summarized on stdout.
+
+bench_dir = os.path.dirname(os.path.abspath(__file__))
+scripts_dir = os.path.join(os.path.dirname(bench_dir), "scripts")
+
+# Each parameter is swept from the base shape when no -sweep is given
+default_sweeps = [("trip", [2, 4, 8, 16]),
+                  ("loop_depth", [1, 2, 3]),
+                  ("inputs", [1, 2, 3]),
+                  ("array_size", [4, 16, 64]),
+                  ("call_depth", [0, 2, 4, 8])]
+
+
+class StageFailed(Exception):
+    pass
+
+
+def run_stage(record, stage, cmd, cwd, stdin=None, stdout=None, env=None):
+    # Run a stage, adding its wall time and peak RSS (KB) to the record
+    log = open(os.path.join(cwd, stage.replace(" ", "_") + ".log"), "w")
+    stdin_file = open(os.path.join(cwd, stdin)) if stdin else None
+    stdout_file = open(os.path.join(cwd, stdout), "w") if stdout else log
+    start = time.time()
+    p = subprocess.Popen(cmd, cwd=cwd, stdin=stdin_file, stdout=stdout_file,
+                         stderr=log, env=env)
+    _, status, usage = os.wait4(p.pid, 0)
+    record["stages"][stage] = {"seconds": time.time() - start,
+                               "max_rss_kb": usage.ru_maxrss}
+    for f in [log, stdin_file, stdout_file]:
+        if f is not None and not f.closed:
+            f.close()
+    if status != 0:
+        raise StageFailed(stage)
+
+
+def read_lines(path):
+    with open(path) as f:
+        return f.read().split()
+
+
+def brute_force_count(binary, trace, lower, upper, inputs, run_dir, jobs):
+    # Number of inputs within the bounds that take the traced path
+    def takes_path(values):
+        env = dict(os.environ)
+        env["CFCOUNT_TRACE"] = os.path.join(
+            run_dir, "brute_" + "_".join(map(str, values)) + ".trace")
+        p = subprocess.Popen([binary], stdin=subprocess.PIPE,
+                             stdout=subprocess.PIPE, env=env)
+        p.communicate(("\n".join(map(str, values)) + "\n").encode())
+        same = read_lines(env["CFCOUNT_TRACE"]) == trace
+        os.remove(env["CFCOUNT_TRACE"])
+        return same
+
+    domain = itertools.product(range(lower, upper + 1), repeat=inputs)
+    pool = ThreadPool(jobs)
+    count = sum(pool.map(takes_path, list(domain)))
+    pool.close()
+    return count
+
+
+def parse_count(path):
+    # sharpSAT's format: "# solutions" followed by the count
+    with open(path) as f:
+        lines = [l.strip() for l in f.read().splitlines()]
+    for i in range(len(lines) - 1):
+        if lines[i].startswith("# solutions"):
+            return int(lines[i + 1])
+    return None
+
+
+def cnf_size(path):
+    with open(path) as f:
+        for line in f:
+            if line.startswith("p cnf"):
+                fields = line.split()
+                return int(fields[2]), int(fields[3])
+    return None, None
+
+
+def bench_program(args, shape, run_dir):
+    record = {"shape": shape, "stages": {}}
+    gen_program.write_program(run_dir, shape["loop_depth"], shape["trip"],
+                              shape["inputs"], shape["array_size"],
+                              shape["call_depth"], args.lower, args.upper,
+                              args.seed)
+
+    try:
+        run_stage(record, "compile", [args.clang, "-O0", "-S", "-emit-llvm",
+                                      "prog.c", "-o", "prog.ll"], run_dir)
+
+        # Build the traced program and trace the input
+        run_stage(record, "instrument",
+                  [args.python, os.path.join(bench_dir, "trace_ll.py"),
+                   "prog.ll", "traced.ll", "trace_rt.c"], run_dir)
+        run_stage(record, "build traced", [args.clang, "traced.ll",
+                                           "trace_rt.c", "-o", "traced"],
+                  run_dir)
+        env = dict(os.environ)
+        env["CFCOUNT_TRACE"] = os.path.join(run_dir, "trace")
+        run_stage(record, "run traced", ["./traced"], run_dir, stdin="input",
+                  env=env)
+        trace = read_lines(os.path.join(run_dir, "trace"))
+        record["trace_blocks"] = len(trace)
+
+        # Model the path
+        run_stage(record, "model",
+                  [args.opt] + args.opt_args.split() +
+                  ["-load", args.pass_lib, "-CFCountPass", "-cfcount-no-cache",
+                   "-cfcount-inputs-file=inputs",
+                   "-cfcount-stats-json=stats.json", "prog.ll", "trace",
+                   "z3.py", "bounds", "bools"], run_dir)
+        with open(os.path.join(run_dir, "stats.json")) as f:
+            record["cfcount"] = json.load(f)
+        record["z3_bytes"] = os.path.getsize(os.path.join(run_dir, "z3.py"))
+
+        # The script imports the model library by file name
+        with open(os.path.join(run_dir, "z3.py")) as f:
+            script = f.read()
+        with open(os.path.join(run_dir, "z3.py"), "w") as f:
+            f.write(script.replace("import models.py as", "import models as"))
+        if os.path.exists(os.path.join(run_dir, "models.py")):
+            os.remove(os.path.join(run_dir, "models.py"))
+        run_stage(record, "array models",
+                  [args.python, os.path.join(scripts_dir,
+                                             "create_array_models.py"),
+                   "models.py", str(shape["array_size"])], run_dir)
+
+        run_stage(record, "z3", [args.python, "z3.py"], run_dir,
+                  stdout="z3.out")
+        run_stage(record, "convert",
+                  [args.python, os.path.join(scripts_dir, "convert.py"),
+                   "z3.out", "bools", "inputs"], run_dir, stdout="path.cnf")
+        record["cnf_vars"], record["cnf_clauses"] = \
+            cnf_size(os.path.join(run_dir, "path.cnf"))
+        run_stage(record, "count", args.counter.split() + ["path.cnf"],
+                  run_dir, stdout="count")
+        record["count"] = parse_count(os.path.join(run_dir, "count"))
+    except StageFailed as e:
+        record["error"] = "%s failed (see %s.log)" % \
+            (e.args[0], e.args[0].replace(" ", "_"))
+        return record
+
+    domain = (args.upper - args.lower + 1) ** shape["inputs"]
+    if domain <= args.brute_limit:
+        start = time.time()
+        record["brute_count"] = brute_force_count(
+            os.path.join(run_dir, "traced"), trace, args.lower, args.upper,
+            shape["inputs"], run_dir, args.j)
+        record["stages"]["brute force"] = {"seconds": time.time() - start}
+        if record["brute_count"] != record["count"]:
+            record["error"] = "count %s, brute force %d" % \
+                (record["count"], record["brute_count"])
+
+    return record
+
+
+def summary_line(name, value, record):
+    if "error" in record and "count" not in record:
+        return "%-24s %s" % (name + "=" + str(value), record["error"])
+    stages = record["stages"]
+    return "%-24s %8d %8.2f %8.2f %8.2f %8d %10d %10s %s" % (
+        name + "=" + str(value), record["trace_blocks"],
+        stages["model"]["seconds"], stages["z3"]["seconds"],
+        stages["count"]["seconds"], stages["model"]["max_rss_kb"] // 1024,
+        record["z3_bytes"], record["count"],
+        record.get("error", "ok" if "brute_count" in record else ""))
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Run the pipeline on generated programs of growing size")
+    gen_program.add_shape_arguments(parser)
+    parser.add_argument("-sweep", action="append", default=[],
+                        metavar="<param>=<v1>,<v2>,...",
+                        help="values of a shape parameter (e.g. trip=2,4,8)")
+    parser.add_argument("-pass", dest="pass_lib", required=True,
+                        help="the LLVMCFCount module")
+    parser.add_argument("-opt", default="opt")
+    parser.add_argument("-opt-args", default="",
+                        help="extra arguments of opt")
+    parser.add_argument("-clang", default="clang")
+    parser.add_argument("-python", default="python",
+                        help="Python interpreter with Z3Py")
+    parser.add_argument("-counter", default="sharpSAT")
+    parser.add_argument("-brute-limit", type=int, default=4096,
+                        help="largest domain checked by brute force")
+    parser.add_argument("-j", type=int, default=4,
+                        help="parallel runs of the brute force check")
+    parser.add_argument("-o", dest="out_dir", default="bench_out")
+    args = parser.parse_args()
+
+    base = {"loop_depth": args.loop_depth, "trip": args.trip,
+            "inputs": args.inputs, "array_size": args.array_size,
+            "call_depth": args.call_depth}
+    sweeps = default_sweeps
+    if args.sweep:
+        sweeps = []
+        for sweep in args.sweep:
+            name, values = sweep.split("=")
+            name = name.replace("-", "_")
+            if name not in base:
+                parser.error("unknown parameter " + name)
+            sweeps.append((name, [int(v) for v in values.split(",")]))
+
+    out_dir = os.path.abspath(args.out_dir)
+    if not os.path.isdir(out_dir):
+        os.makedirs(out_dir)
+    results = open(os.path.join(out_dir, "results.jsonl"), "w")
+
+    print("%-24s %8s %8s %8s %8s %8s %10s %10s" %
+          ("program", "blocks", "model s", "z3 s", "count s", "RSS MB",
+           "z3 bytes", "count"))
+    failed = False
+    for name, values in sweeps:
+        for value in values:
+            shape = dict(base)
+            shape[name] = value
+            run_dir = os.path.join(out_dir, "%s_%d" % (name, value))
+            record = bench_program(args, shape, run_dir)
+            results.write(json.dumps(record, sort_keys=True) + "\n")
+            results.flush()
+            print(summary_line(name, value, record))
+            sys.stdout.flush()
+            failed = failed or "error" in record
+    results.close()
+
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,111 @@
+from __future__ import print_function
+
+import re
+import sys
+
+# Instruments a textual LLVM module (clang -O0 -S -emit-llvm) so that
+# running it writes its block trace in the format CFCount reads. Blocks
+# get the names CFCount's rename_bbs gives them: <function>_entry for
+# the first block, then <function>_bb, <function>_bb1, <function>_bb2...
+# in the order of the function.
+#
+#   trace_ll.py <input ll> <output ll> <output runtime c>
+#
+# The output module calls __cfcount_trace(<block id>) at the start of
+# every block. The runtime (compile and link it with the output module)
+# writes the block names to $CFCOUNT_TRACE, or to stderr if it is not set
+
+define_re = re.compile(r'^define .*@("[^"]+"|[-a-zA-Z$._0-9]+)\(')
+label_re = re.compile(r'^("[^"]+"|[-a-zA-Z$._0-9]+):')
+old_label_re = re.compile(r'^; <label>:\d+')
+
+
+def is_block_start(line):
+    return label_re.match(line) is not None or \
+        old_label_re.match(line) is not None
+
+
+def instrument(lines):
+    names = []
+    out = []
+    func = None
+    block = 0
+    pending = False
+    for line in lines:
+        m = define_re.match(line)
+        if m is not None and line.rstrip().endswith("{"):
+            func = m.group(1).strip('"')
+            block = 0
+            pending = True
+            out.append(line)
+            continue
+        if func is None:
+            out.append(line)
+            continue
+        if line.startswith("}"):
+            func = None
+            out.append(line)
+            continue
+
+        if is_block_start(line):
+            out.append(line)
+            pending = True
+            continue
+
+        stripped = line.strip()
+        # The call goes after the phis of the block
+        if pending and stripped != "" and not stripped.startswith(";") and \
+                " = phi " not in stripped and \
+                not stripped.startswith("landingpad"):
+            if block == 0:
+                name = func + "_entry"
+            elif block == 1:
+                name = func + "_bb"
+            else:
+                name = func + "_bb" + str(block - 1)
+            out.append("  call void @__cfcount_trace(i32 %d)" % len(names))
+            names.append(name)
+            block += 1
+            pending = False
+        out.append(line)
+
+    out.append("declare void @__cfcount_trace(i32)")
+    return out, names
+
+
+def runtime(names):
+    lines = ["#include <stdio.h>",
+             "#include <stdlib.h>",
+             "",
+             "static const char *names[] = {"]
+    for name in names:
+        lines.append('  "%s\\n",' % name)
+    lines += ["};",
+              "",
+              "static FILE *out;",
+              "",
+              "void __cfcount_trace(int id) {",
+              "  if (out == NULL) {",
+              '    const char *path = getenv("CFCOUNT_TRACE");',
+              '    out = path != NULL ? fopen(path, "w") : stderr;',
+              "    setvbuf(out, NULL, _IOFBF, 1 << 16);",
+              "  }",
+              "  fputs(names[id], out);",
+              "}"]
+    return "\n".join(lines) + "\n"
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 4:
+        print("usage: trace_ll.py <input ll> <output ll> <output runtime c>")
+        sys.exit(1)
+
+    with open(sys.argv[1]) as f:
+        lines = f.read().splitlines()
+
+    out, names = instrument(lines)
+
+    with open(sys.argv[2], "w") as f:
+        f.write("\n".join(out) + "\n")
+    with open(sys.argv[3], "w") as f:
+        f.write(runtime(names))
@@ -0,0 +1,116 @@
+// cfcount-model.cpp
+// Models (and counts) the paths of many traces of a program in one
+// process through the library interface of CFCount (CFCount.h): the
+// module is loaded, renamed and its CFG built once, and no opt process
+// is started per trace. Writes the files CFCountPass writes for each
+// trace, path_<k>.py, path_<k>.bools and path_<k>.inputs (with
+// -input-bits), and path_<k>.count (with -count), to the output directory
+
+#include "CFCount.h"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <thread>
+
+using namespace llvm;
+
+// cfcount-model -module=<bitcode> -bounds=<bounds file> -trace=<trace> ...
+cl::opt<std::string> ModuleFilename("module", cl::Required,
+                                    cl::desc("Bitcode of the program"));
+cl::opt<std::string> BoundsFile("bounds", cl::Required,
+                                cl::desc("Bounds file of the inputs"));
+cl::list<std::string> Traces("trace", cl::OneOrMore,
+                             cl::desc("Trace of a path (repeatable)"));
+cl::opt<std::string> OutputDir("out-dir", cl::init("."),
+                               cl::desc("Directory to write the paths to"));
+cl::opt<bool> InputBits("input-bits", cl::init(false),
+                        cl::desc("Declare and write the Bools of the input "
+                                 "bits"));
+cl::opt<bool> Count("count", cl::init(false),
+                    cl::desc("Count each path with -count-command"));
+// Run without a shell, with the files of the path as its arguments
+cl::opt<std::string> CountCommandLine(
+    "count-command", cl::init("scripts/count_path.sh"),
+    cl::desc("Program that counts a path from its files"));
+// Paths are modeled one at a time, their counts run in parallel
+cl::opt<unsigned> Jobs("j", cl::init(std::thread::hardware_concurrency()),
+                       cl::desc("Number of paths counted in parallel"));
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv,
+                              "model the paths of traces in process\n");
+
+  std::string error;
+  std::unique_ptr<cfcount::Engine> engine =
+      cfcount::Engine::LoadModule(ModuleFilename, &error);
+  if (!engine) {
+    errs() << "Cannot load module: " << error << "\n";
+    return 1;
+  }
+  cfcount::Bounds bounds;
+  if (!cfcount::Engine::ReadBounds(BoundsFile, &bounds)) {
+    errs() << "Cannot open bounds file!\n";
+    return 1;
+  }
+
+  std::atomic<unsigned> next(0);
+  std::atomic<bool> failed(false);
+  auto worker = [&]() {
+    for (unsigned k = next++; k < Traces.size(); k = next++) {
+      std::vector<std::string> trace;
+      if (!engine->ReadTrace(Traces[k], &trace)) {
+        errs() << "Cannot open trace file " << Traces[k] << "!\n";
+        failed = true;
+        continue;
+      }
+      std::string error;
+      std::shared_ptr<const cfcount::Formula> formula =
+          engine->ModelTrace(trace, bounds, &error, InputBits);
+      if (!formula) {
+        errs() << "Cannot model " << Traces[k] << ": " << error << "\n";
+        failed = true;
+        continue;
+      }
+
+      std::string path = OutputDir + "/path_" + std::to_string(k);
+      bool written =
+          cfcount::Engine::Emit(*formula, cfcount::Z3PyScript, path + ".py") &&
+          cfcount::Engine::Emit(*formula, cfcount::BoolNames, path + ".bools");
+      if (InputBits) {
+        written = written && cfcount::Engine::Emit(
+                                 *formula, cfcount::InputBitNames,
+                                 path + ".inputs");
+      }
+      if (!written) {
+        errs() << "Cannot write to " << OutputDir << "!\n";
+        failed = true;
+        continue;
+      }
+
+      if (Count) {
+        std::string output;
+        if (!cfcount::Engine::Count(
+                *formula, std::vector<std::string>(1, CountCommandLine),
+                &output)) {
+          errs() << "Count command failed for " << Traces[k] << "!\n";
+          failed = true;
+          continue;
+        }
+        std::ofstream(path + ".count") << output;
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (unsigned w = 0; w < std::max(1u, (unsigned)Jobs); w++) {
+    threads.push_back(std::thread(worker));
+  }
+  for (int t = 0; t < threads.size(); t++) {
+    threads[t].join();
+  }
+  return failed ? 1 : 0;
+}
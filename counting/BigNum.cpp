@@ -0,0 +1,145 @@
+// BigNum.cpp
+// Arbitrary precision unsigned integers for model counts
+
+#include "BigNum.h"
+
+#include <algorithm>
+
+static const uint32_t Base = 1000000000;
+static const int BaseDigits = 9;
+
+BigNum::BigNum(uint64_t val) {
+  while (val > 0) {
+    digits.push_back(val % Base);
+    val /= Base;
+  }
+}
+
+bool BigNum::Parse(const std::string &str, BigNum *result) {
+  if (str.empty() ||
+      str.find_first_not_of("0123456789") != std::string::npos) {
+    return false;
+  }
+  result->digits.clear();
+  for (int end = str.size(); end > 0; end -= BaseDigits) {
+    int start = std::max(0, end - BaseDigits);
+    result->digits.push_back(std::stoul(str.substr(start, end - start)));
+  }
+  result->Trim();
+  return true;
+}
+
+BigNum BigNum::Pow2(unsigned exp) {
+  BigNum result(1);
+  // Multiply in steps of 2^30 to keep the number of steps low
+  while (exp >= 30) {
+    result *= BigNum(1ull << 30);
+    exp -= 30;
+  }
+  result *= BigNum(1ull << exp);
+  return result;
+}
+
+BigNum BigNum::Random(const BigNum &bound, std::mt19937_64 &rng) {
+  // Draw as many digits as the bound has, the top one no larger than the
+  // bound's, until the number is below the bound (at least half the time)
+  std::uniform_int_distribution<uint32_t> digit(0, Base - 1);
+  std::uniform_int_distribution<uint32_t> top(0, bound.digits.back());
+  BigNum result;
+  do {
+    result.digits.resize(bound.digits.size());
+    for (size_t i = 0; i + 1 < bound.digits.size(); i++) {
+      result.digits[i] = digit(rng);
+    }
+    result.digits.back() = top(rng);
+    result.Trim();
+  } while (!(result < bound));
+  return result;
+}
+
+BigNum BigNum::operator+(const BigNum &other) const {
+  BigNum result;
+  uint64_t carry = 0;
+  for (size_t i = 0; i < std::max(digits.size(), other.digits.size()) || carry;
+       i++) {
+    uint64_t sum = carry;
+    if (i < digits.size()) {
+      sum += digits[i];
+    }
+    if (i < other.digits.size()) {
+      sum += other.digits[i];
+    }
+    result.digits.push_back(sum % Base);
+    carry = sum / Base;
+  }
+  result.Trim();
+  return result;
+}
+
+BigNum BigNum::operator*(const BigNum &other) const {
+  BigNum result;
+  if (IsZero() || other.IsZero()) {
+    return result;
+  }
+  std::vector<uint64_t> product(digits.size() + other.digits.size() + 1, 0);
+  for (size_t i = 0; i < digits.size(); i++) {
+    uint64_t carry = 0;
+    for (size_t j = 0; j < other.digits.size() || carry; j++) {
+      uint64_t cur = product[i + j] + carry;
+      if (j < other.digits.size()) {
+        cur += (uint64_t)digits[i] * other.digits[j];
+      }
+      product[i + j] = cur % Base;
+      carry = cur / Base;
+    }
+  }
+  result.digits.assign(product.begin(), product.end());
+  result.Trim();
+  return result;
+}
+
+BigNum &BigNum::operator+=(const BigNum &other) {
+  *this = *this + other;
+  return *this;
+}
+
+BigNum &BigNum::operator*=(const BigNum &other) {
+  *this = *this * other;
+  return *this;
+}
+
+bool BigNum::operator==(const BigNum &other) const {
+  return digits == other.digits;
+}
+
+bool BigNum::operator<(const BigNum &other) const {
+  if (digits.size() != other.digits.size()) {
+    return digits.size() < other.digits.size();
+  }
+  for (int i = digits.size() - 1; i >= 0; i--) {
+    if (digits[i] != other.digits[i]) {
+      return digits[i] < other.digits[i];
+    }
+  }
+  return false;
+}
+
+bool BigNum::IsZero() const { return digits.empty(); }
+
+std::string BigNum::ToString() const {
+  if (digits.empty()) {
+    return "0";
+  }
+  std::string result = std::to_string(digits.back());
+  for (int i = (int)digits.size() - 2; i >= 0; i--) {
+    std::string part = std::to_string(digits[i]);
+    result += std::string(BaseDigits - part.size(), '0') + part;
+  }
+  return result;
+}
+
+void BigNum::Trim() {
+  while (!digits.empty() && digits.back() == 0) {
+    digits.pop_back();
+  }
+}
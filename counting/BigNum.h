@@ -0,0 +1,40 @@
+// BigNum.h
+// Arbitrary precision unsigned integers for model counts
+
+#ifndef CFCOUNT_BIGNUM_H
+#define CFCOUNT_BIGNUM_H
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+class BigNum {
+public:
+  BigNum(uint64_t val = 0);
+
+  // Parse a decimal number. Returns false if the string is not one
+  static bool Parse(const std::string &str, BigNum *result);
+  // 2^exp
+  static BigNum Pow2(unsigned exp);
+  // Uniformly random number below a (non zero) bound
+  static BigNum Random(const BigNum &bound, std::mt19937_64 &rng);
+
+  BigNum operator+(const BigNum &other) const;
+  BigNum operator*(const BigNum &other) const;
+  BigNum &operator+=(const BigNum &other);
+  BigNum &operator*=(const BigNum &other);
+  bool operator==(const BigNum &other) const;
+  bool operator<(const BigNum &other) const;
+
+  bool IsZero() const;
+  std::string ToString() const;
+
+private:
+  // Base 10^9 digits, least significant first, no leading zeros
+  std::vector<uint32_t> digits;
+
+  void Trim();
+};
+
+#endif
@@ -0,0 +1,145 @@
+// CNF.cpp
+// Reading and writing DIMACS files
+
+#include "CNF.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+std::vector<int> CountedVars(const CNF &cnf) {
+  if (cnf.hasProjection) {
+    return cnf.projection;
+  }
+  std::vector<int> vars;
+  for (int var = 1; var <= cnf.numVars; var++) {
+    vars.push_back(var);
+  }
+  return vars;
+}
+
+bool ReadDIMACS(const std::string &filename, CNF *cnf) {
+
+  std::ifstream cnf_file(filename);
+  if (!cnf_file.is_open()) {
+    return false;
+  }
+
+  cnf->numVars = 0;
+  cnf->clauses.clear();
+  cnf->hasProjection = false;
+  cnf->projection.clear();
+  cnf->inputs.clear();
+
+  std::string line;
+  std::vector<int> clause;
+  while (std::getline(cnf_file, line)) {
+    std::stringstream ss(line);
+    std::string first;
+    if (!(ss >> first)) {
+      continue;
+    }
+
+    // Some generators end the file with a "%" line
+    if (first == "%") {
+      break;
+    }
+    // Projection variables and input bits
+    if (first == "c") {
+      std::string kind;
+      int var;
+      if (ss >> kind && kind == "ind") {
+        cnf->hasProjection = true;
+        while (ss >> var && var != 0) {
+          cnf->projection.push_back(var);
+        }
+      } else if (kind == "input") {
+        // c input <index> <width> <var of bit 0> ... <var of bit width - 1>
+        int index, width;
+        if (ss >> index >> width && index >= 0 && width >= 0) {
+          if (index >= cnf->inputs.size()) {
+            cnf->inputs.resize(index + 1);
+          }
+          cnf->inputs[index].assign(width, 0);
+          for (int bit = 0; bit < width && ss >> var; bit++) {
+            cnf->inputs[index][bit] = var;
+          }
+        }
+      }
+      continue;
+    }
+    // Header, the number of clauses is implied by the clauses read
+    if (first == "p") {
+      std::string format;
+      ss >> format >> cnf->numVars;
+      continue;
+    }
+
+    // Clauses can span lines and end with a 0
+    int lit = atoi(first.c_str());
+    do {
+      if (lit != 0) {
+        clause.push_back(lit);
+        continue;
+      }
+
+      // Sort so duplicates and complementary literals are adjacent
+      std::sort(clause.begin(), clause.end(),
+                [](int a, int b) { return abs(a) < abs(b) ||
+                                          (abs(a) == abs(b) && a < b); });
+      clause.erase(std::unique(clause.begin(), clause.end()), clause.end());
+      bool tautology = false;
+      for (int i = 1; i < clause.size(); i++) {
+        if (clause[i] == -clause[i - 1]) {
+          tautology = true;
+        }
+      }
+      for (int i = 0; i < clause.size(); i++) {
+        cnf->numVars = std::max(cnf->numVars, abs(clause[i]));
+      }
+      if (!tautology) {
+        cnf->clauses.push_back(clause);
+      }
+      clause.clear();
+    } while (ss >> lit);
+  }
+
+  return true;
+}
+
+bool WriteDIMACS(const std::string &filename, const CNF &cnf) {
+
+  std::ofstream cnf_file(filename);
+  if (!cnf_file.is_open()) {
+    return false;
+  }
+
+  if (cnf.hasProjection) {
+    cnf_file << "c ind";
+    for (int i = 0; i < cnf.projection.size(); i++) {
+      cnf_file << " " << cnf.projection[i];
+    }
+    cnf_file << " 0\n";
+  }
+  for (int i = 0; i < cnf.inputs.size(); i++) {
+    if (cnf.inputs[i].empty()) {
+      continue;
+    }
+    cnf_file << "c input " << i << " " << cnf.inputs[i].size();
+    for (int bit = 0; bit < cnf.inputs[i].size(); bit++) {
+      cnf_file << " " << cnf.inputs[i][bit];
+    }
+    cnf_file << "\n";
+  }
+
+  cnf_file << "p cnf " << cnf.numVars << " " << cnf.clauses.size() << "\n";
+  for (int i = 0; i < cnf.clauses.size(); i++) {
+    for (int j = 0; j < cnf.clauses[i].size(); j++) {
+      cnf_file << cnf.clauses[i][j] << " ";
+    }
+    cnf_file << "0\n";
+  }
+
+  return true;
+}
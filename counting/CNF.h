@@ -0,0 +1,42 @@
+// CNF.h
+// Formulas in conjunctive normal form as produced by scripts/convert.py,
+// and reading/writing them in the DIMACS format used by model counters
+
+#ifndef CFCOUNT_CNF_H
+#define CFCOUNT_CNF_H
+
+#include <string>
+#include <vector>
+
+// A CNF formula. Variables are numbered 1..numVars and literals
+// are +var / -var as in DIMACS
+struct CNF {
+  int numVars;
+  std::vector<std::vector<int> > clauses;
+  // Variables the count is projected on (the input bits, from the
+  // "c ind" lines). Without a "c ind" line the input bits are unknown and
+  // every variable is counted; "c ind 0" is an empty projection (a path
+  // with no input), counted 1 if the formula is satisfiable
+  bool hasProjection;
+  std::vector<int> projection;
+  // Variable of each bit of each input (from the "c input" lines), least
+  // significant bit first. 0 for bits that occur in no clause (older
+  // converters; they now give such bits a variable). Empty if unknown
+  std::vector<std::vector<int> > inputs;
+
+  CNF() : numVars(0), hasProjection(false) {}
+};
+
+// Variables a count of the formula is over: the projection (possibly
+// empty), or every variable if the input bits are unknown
+std::vector<int> CountedVars(const CNF &cnf);
+
+// Read a DIMACS file. Duplicate literals are removed and tautologies
+// are dropped. Returns false if the file cannot be read
+bool ReadDIMACS(const std::string &filename, CNF *cnf);
+
+// Write a DIMACS file, including a "c ind" line if the formula has a
+// projection (even an empty one) and "c input" lines if its input bits are known
+bool WriteDIMACS(const std::string &filename, const CNF &cnf);
+
+#endif
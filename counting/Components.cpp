@@ -0,0 +1,99 @@
+// Components.cpp
+// Splitting a path's CNF into independent sub-formulas
+
+#include "Components.h"
+
+#include <cstdlib>
+#include <map>
+
+// Find the representative of a variable's set, compressing the path
+static int FindSet(std::vector<int> &parent, int var) {
+  while (parent[var] != var) {
+    parent[var] = parent[parent[var]];
+    var = parent[var];
+  }
+  return var;
+}
+
+int SplitComponents(const CNF &cnf, std::vector<CNF> *components,
+                    std::vector<std::vector<int> > *varMaps) {
+
+  components->clear();
+  varMaps->clear();
+
+  // Union the variables of each clause
+  std::vector<int> parent(cnf.numVars + 1);
+  std::vector<bool> used(cnf.numVars + 1, false);
+  for (int var = 0; var <= cnf.numVars; var++) {
+    parent[var] = var;
+  }
+  for (int c = 0; c < cnf.clauses.size(); c++) {
+    const std::vector<int> &clause = cnf.clauses[c];
+    for (int i = 0; i < clause.size(); i++) {
+      used[abs(clause[i])] = true;
+      int a = FindSet(parent, abs(clause[0]));
+      int b = FindSet(parent, abs(clause[i]));
+      parent[b] = a;
+    }
+  }
+
+  // Counted variables in no clause take either value, the others are
+  // quantified away
+  int freeVars = 0;
+  std::vector<int> counted = CountedVars(cnf);
+  for (int i = 0; i < counted.size(); i++) {
+    if (counted[i] > cnf.numVars || !used[counted[i]]) {
+      freeVars++;
+    }
+  }
+
+  // Number the components and their variables
+  std::map<int, int> componentOf;
+  std::vector<int> newVar(cnf.numVars + 1, 0);
+  for (int var = 1; var <= cnf.numVars; var++) {
+    if (!used[var]) {
+      continue;
+    }
+    int root = FindSet(parent, var);
+    if (componentOf.find(root) == componentOf.end()) {
+      componentOf[root] = components->size();
+      components->push_back(CNF());
+      varMaps->push_back(std::vector<int>());
+    }
+    int comp = componentOf[root];
+    (*varMaps)[comp].push_back(var);
+    newVar[var] = ++(*components)[comp].numVars;
+  }
+
+  for (int c = 0; c < cnf.clauses.size(); c++) {
+    const std::vector<int> &clause = cnf.clauses[c];
+    if (clause.empty()) {
+      // An empty clause makes every component unsatisfiable, keeping it
+      // in its own component is enough for the product to be 0
+      components->push_back(CNF());
+      varMaps->push_back(std::vector<int>());
+      components->back().clauses.push_back(clause);
+      continue;
+    }
+    int comp = componentOf[FindSet(parent, abs(clause[0]))];
+    std::vector<int> renamed;
+    for (int i = 0; i < clause.size(); i++) {
+      int var = newVar[abs(clause[i])];
+      renamed.push_back(clause[i] > 0 ? var : -var);
+    }
+    (*components)[comp].clauses.push_back(renamed);
+  }
+
+  for (int i = 0; i < components->size(); i++) {
+    (*components)[i].hasProjection = cnf.hasProjection;
+  }
+  for (int i = 0; i < cnf.projection.size(); i++) {
+    int var = cnf.projection[i];
+    if (var <= cnf.numVars && used[var]) {
+      int comp = componentOf[FindSet(parent, var)];
+      (*components)[comp].projection.push_back(newVar[var]);
+    }
+  }
+
+  return freeVars;
+}
@@ -0,0 +1,22 @@
+// Components.h
+// Splitting a path's CNF into independent sub-formulas
+
+#ifndef CFCOUNT_COMPONENTS_H
+#define CFCOUNT_COMPONENTS_H
+
+#include "CNF.h"
+
+// Split a formula into components that share no variables (e.g. inputs
+// that never interact on the path). The count of the formula is the
+// product of the counts of its components, times 2 for each counted
+// variable (see CountedVars) that occurs in no clause. With a projection,
+// each component is projected on its part of it; a component with none
+// of the projection counts 1 if it is satisfiable, 0 otherwise.
+//
+// Each component is numbered 1..n, (*varMaps)[i][v - 1] is the original
+// variable of v in component i. Returns the number of free counted
+// variables
+int SplitComponents(const CNF &cnf, std::vector<CNF> *components,
+                    std::vector<std::vector<int> > *varMaps);
+
+#endif
@@ -0,0 +1,196 @@
+// Counter.cpp
+// Counting the models of a CNF, in process for small formulas
+// or with an external model counter (e.g. sharpSAT)
+
+#include "Counter.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <sstream>
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+BigNum EnumerateModels(const CNF &cnf) {
+
+  // Each clause as masks of the variables it needs true/false
+  std::vector<uint32_t> posMask, negMask;
+  for (int c = 0; c < cnf.clauses.size(); c++) {
+    uint32_t pos = 0, neg = 0;
+    for (int i = 0; i < cnf.clauses[c].size(); i++) {
+      int lit = cnf.clauses[c][i];
+      if (lit > 0) {
+        pos |= 1u << (lit - 1);
+      } else {
+        neg |= 1u << (-lit - 1);
+      }
+    }
+    posMask.push_back(pos);
+    negMask.push_back(neg);
+  }
+
+  // With a projection, the models that agree on it count once
+  std::vector<int> projection = CountedVars(cnf);
+  bool projected = projection.size() < cnf.numVars;
+  std::vector<bool> seen(projected ? 1u << projection.size() : 0, false);
+
+  uint64_t count = 0;
+  uint32_t numAssignments = 1u << cnf.numVars;
+  for (uint32_t assignment = 0; assignment < numAssignments; assignment++) {
+    bool satisfied = true;
+    for (int c = 0; c < posMask.size() && satisfied; c++) {
+      satisfied = (assignment & posMask[c]) || (~assignment & negMask[c]);
+    }
+    if (!satisfied) {
+      continue;
+    }
+    if (projected) {
+      uint32_t key = 0;
+      for (int i = 0; i < projection.size(); i++) {
+        key |= ((assignment >> (projection[i] - 1)) & 1) << i;
+      }
+      if (seen[key]) {
+        continue;
+      }
+      seen[key] = true;
+    }
+    count++;
+  }
+  return BigNum(count);
+}
+
+bool ParseCounterOutput(const std::string &output, BigNum *count) {
+
+  std::stringstream ss(output);
+  std::string line;
+  bool nextIsCount = false;
+  while (std::getline(ss, line)) {
+    std::stringstream words(line);
+    std::vector<std::string> tokens;
+    std::string token;
+    while (words >> token) {
+      tokens.push_back(token);
+    }
+    if (tokens.empty()) {
+      continue;
+    }
+
+    // sharpSAT prints the count on the line after "# solutions"
+    if (nextIsCount) {
+      return BigNum::Parse(tokens[0], count);
+    }
+    if (tokens.size() >= 2 && tokens[0] == "#" && tokens[1] == "solutions") {
+      nextIsCount = true;
+    }
+    if (tokens.size() == 3 && tokens[0] == "s" && tokens[1] == "mc") {
+      return BigNum::Parse(tokens[2], count);
+    }
+    if (tokens.size() >= 4 && tokens[0] == "c" && tokens[1] == "s" &&
+        tokens[2] == "exact") {
+      return BigNum::Parse(tokens.back(), count);
+    }
+  }
+  return false;
+}
+
+// Run a command, collecting its stdout and stderr, and kill it (and the
+// processes it started) if it runs longer than timeout seconds
+static bool RunWithTimeout(const std::string &command, unsigned timeout,
+                           std::string *output, bool *timedOut) {
+  int fds[2];
+  if (pipe(fds) != 0) {
+    return false;
+  }
+  pid_t pid = fork();
+  if (pid < 0) {
+    close(fds[0]);
+    close(fds[1]);
+    return false;
+  }
+  if (pid == 0) {
+    setpgid(0, 0);
+    dup2(fds[1], 1);
+    dup2(fds[1], 2);
+    close(fds[0]);
+    close(fds[1]);
+    execl("/bin/sh", "sh", "-c", command.c_str(), (char *)NULL);
+    _exit(127);
+  }
+  close(fds[1]);
+
+  time_t deadline = time(NULL) + timeout;
+  char buffer[4096];
+  while (true) {
+    int left = (int)(deadline - time(NULL));
+    struct pollfd pfd = {fds[0], POLLIN, 0};
+    int ready = left > 0 ? poll(&pfd, 1, left * 1000) : 0;
+    if (ready < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ready == 0) {
+      kill(-pid, SIGKILL);
+      *timedOut = true;
+      break;
+    }
+    ssize_t read = ::read(fds[0], buffer, sizeof(buffer));
+    if (read <= 0) {
+      break;
+    }
+    output->append(buffer, read);
+  }
+  close(fds[0]);
+  waitpid(pid, NULL, 0);
+  return true;
+}
+
+bool RunCounter(const std::string &command, const CNF &cnf, BigNum *count,
+                unsigned timeout, bool *timedOut) {
+
+  if (timedOut != NULL) {
+    *timedOut = false;
+  }
+
+  llvm::SmallString<128> path;
+  if (llvm::sys::fs::createTemporaryFile("cfcount", "cnf", path)) {
+    return false;
+  }
+  std::string filename = path.str().str();
+  if (!WriteDIMACS(filename, cnf)) {
+    return false;
+  }
+
+  std::string output;
+  bool ran = false;
+  if (timeout > 0) {
+    bool killed = false;
+    ran = RunWithTimeout(command + " " + filename, timeout, &output, &killed);
+    if (killed) {
+      llvm::sys::fs::remove(filename);
+      if (timedOut != NULL) {
+        *timedOut = true;
+      }
+      return false;
+    }
+  } else {
+    FILE *counter = popen((command + " " + filename + " 2>&1").c_str(), "r");
+    if (counter != NULL) {
+      char buffer[4096];
+      size_t read;
+      while ((read = fread(buffer, 1, sizeof(buffer), counter)) > 0) {
+        output.append(buffer, read);
+      }
+      pclose(counter);
+      ran = true;
+    }
+  }
+  llvm::sys::fs::remove(filename);
+
+  return ran && ParseCounterOutput(output, count);
+}
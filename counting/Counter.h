@@ -0,0 +1,31 @@
+// Counter.h
+// Counting the models of a CNF, in process for small formulas
+// or with an external model counter (e.g. sharpSAT)
+
+#ifndef CFCOUNT_COUNTER_H
+#define CFCOUNT_COUNTER_H
+
+#include "BigNum.h"
+#include "CNF.h"
+
+// Largest formula (in variables) counted by enumerating its assignments
+static const int MaxEnumerateVars = 20;
+
+// Count the models of a formula with at most MaxEnumerateVars
+// variables by trying every assignment. With a projection, the
+// assignments of the projection that extend to a model are counted
+BigNum EnumerateModels(const CNF &cnf);
+
+// Read the count from the output of a model counter. Understands
+// sharpSAT ("# solutions" followed by the count) and the model counting
+// competition format ("s mc <count>", "c s exact arb int <count>")
+bool ParseCounterOutput(const std::string &output, BigNum *count);
+
+// Count a formula by writing it to a temporary DIMACS file and running
+// "<command> <file>". Returns false if the counter did not report a count.
+// With a timeout (in seconds) the counter is killed when it runs longer,
+// which sets *timedOut
+bool RunCounter(const std::string &command, const CNF &cnf, BigNum *count,
+                unsigned timeout = 0, bool *timedOut = NULL);
+
+#endif
@@ -0,0 +1,265 @@
+// Cubes.cpp
+// Cube-and-conquer counting: splitting a formula into cubes of input
+// bits and counting each cube
+
+#include "Cubes.h"
+#include "Counter.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+// Literal of a DIMACS literal
+static int ToLit(int lit) { return 2 * (abs(lit) - 1) + (lit < 0); }
+
+Propagator::Propagator(const CNF &cnf)
+    : watches(2 * cnf.numVars), value(cnf.numVars, 2), qhead(0),
+      empty(false) {
+  for (int c = 0; c < cnf.clauses.size(); c++) {
+    const std::vector<int> &clause = cnf.clauses[c];
+    if (clause.empty()) {
+      empty = true;
+    } else if (clause.size() == 1) {
+      units.push_back(ToLit(clause[0]));
+    } else {
+      std::vector<int> lits;
+      for (int i = 0; i < clause.size(); i++) {
+        lits.push_back(ToLit(clause[i]));
+      }
+      watches[lits[0]].push_back(clauses.size());
+      watches[lits[1]].push_back(clauses.size());
+      clauses.push_back(lits);
+    }
+  }
+}
+
+int Propagator::LitValue(int lit) const {
+  int v = value[lit >> 1];
+  return v == 2 ? 2 : v ^ (lit & 1);
+}
+
+bool Propagator::Assign(int lit) {
+  int v = LitValue(lit);
+  if (v != 2) {
+    return v == 1;
+  }
+  value[lit >> 1] = !(lit & 1);
+  trail.push_back(lit);
+  return true;
+}
+
+// Clauses are watched by two of their literals and visited when one of
+// them becomes false
+bool Propagator::Propagate() {
+  while (qhead < trail.size()) {
+    int falseLit = trail[qhead++] ^ 1;
+    std::vector<int> &ws = watches[falseLit];
+    int i = 0, j = 0;
+    while (i < ws.size()) {
+      int c = ws[i++];
+      std::vector<int> &lits = clauses[c];
+      if (lits[0] == falseLit) {
+        std::swap(lits[0], lits[1]);
+      }
+      if (LitValue(lits[0]) == 1) {
+        ws[j++] = c;
+        continue;
+      }
+
+      // Watch another literal that is not false
+      bool moved = false;
+      for (int k = 2; k < lits.size(); k++) {
+        if (LitValue(lits[k]) != 0) {
+          std::swap(lits[1], lits[k]);
+          watches[lits[1]].push_back(c);
+          moved = true;
+          break;
+        }
+      }
+      if (moved) {
+        continue;
+      }
+
+      ws[j++] = c;
+      if (!Assign(lits[0])) {
+        while (i < ws.size()) {
+          ws[j++] = ws[i++];
+        }
+        ws.resize(j);
+        qhead = trail.size();
+        return false;
+      }
+    }
+    ws.resize(j);
+  }
+  return true;
+}
+
+void Propagator::Backtrack(int trailSize) {
+  while (trail.size() > trailSize) {
+    value[trail.back() >> 1] = 2;
+    trail.pop_back();
+  }
+  qhead = trailSize;
+}
+
+bool Propagator::SetCube(const std::vector<int> &cube) {
+  Backtrack(0);
+  if (empty) {
+    return false;
+  }
+  for (int i = 0; i < units.size(); i++) {
+    if (!Assign(units[i])) {
+      return false;
+    }
+  }
+  for (int i = 0; i < cube.size(); i++) {
+    if (!Assign(ToLit(cube[i]))) {
+      return false;
+    }
+  }
+  return Propagate();
+}
+
+int Propagator::Implied(int lit) {
+  int l = ToLit(lit);
+  if (LitValue(l) != 2) {
+    return LitValue(l) == 1 ? 0 : -1;
+  }
+  int trailSize = trail.size();
+  bool ok = Assign(l) && Propagate();
+  int implied = trail.size() - trailSize;
+  Backtrack(trailSize);
+  return ok ? implied : -1;
+}
+
+std::vector<int> SplitCandidates(const CNF &cnf, int max) {
+  std::vector<int> occurrences(cnf.numVars + 1, 0);
+  for (int c = 0; c < cnf.clauses.size(); c++) {
+    for (int i = 0; i < cnf.clauses[c].size(); i++) {
+      occurrences[abs(cnf.clauses[c][i])]++;
+    }
+  }
+
+  std::vector<int> candidates;
+  std::vector<int> counted = CountedVars(cnf);
+  for (int i = 0; i < counted.size(); i++) {
+    if (occurrences[counted[i]] > 0) {
+      candidates.push_back(counted[i]);
+    }
+  }
+  std::stable_sort(candidates.begin(), candidates.end(),
+                   [&occurrences](int a, int b) {
+                     return occurrences[a] > occurrences[b];
+                   });
+  if (candidates.size() > max) {
+    candidates.resize(max);
+  }
+  return candidates;
+}
+
+std::vector<int> PickSplitVars(Propagator &prop,
+                               const std::vector<int> &candidates,
+                               const std::vector<int> &cube, int max) {
+  std::vector<std::pair<double, int> > scored;
+  if (!prop.SetCube(cube)) {
+    return std::vector<int>();
+  }
+
+  int decidesAll = candidates.size();
+  for (int i = 0; i < candidates.size(); i++) {
+    int var = candidates[i];
+    if (prop.Value(var) != 2) {
+      continue;
+    }
+    int pos = prop.Implied(var);
+    int neg = prop.Implied(-var);
+    pos = pos < 0 ? decidesAll : pos;
+    neg = neg < 0 ? decidesAll : neg;
+    // Sorted by decreasing score, then by variable
+    scored.push_back(std::make_pair(-(double)(pos + 1) * (neg + 1), var));
+  }
+  std::sort(scored.begin(), scored.end());
+
+  std::vector<int> vars;
+  for (int i = 0; i < scored.size() && i < max; i++) {
+    vars.push_back(scored[i].second);
+  }
+  return vars;
+}
+
+CubeCount CountCube(const CNF &cnf, Propagator &prop,
+                    const std::vector<int> &cube, const std::string &command,
+                    int enumerateVars, unsigned timeout) {
+  CubeCount result;
+  result.status = CubeCount::Counted;
+  if (!prop.SetCube(cube)) {
+    result.count = BigNum(0);
+    return result;
+  }
+
+  // The clauses the cube does not satisfy, without their false literals,
+  // over the variables that are left
+  CNF rest;
+  rest.hasProjection = cnf.hasProjection;
+  std::vector<int> newVar(cnf.numVars + 1, 0);
+  for (int c = 0; c < cnf.clauses.size(); c++) {
+    const std::vector<int> &clause = cnf.clauses[c];
+    bool satisfied = false;
+    for (int i = 0; i < clause.size() && !satisfied; i++) {
+      int val = prop.Value(abs(clause[i]));
+      satisfied = val != 2 && val == (clause[i] > 0);
+    }
+    if (satisfied) {
+      continue;
+    }
+    std::vector<int> lits;
+    for (int i = 0; i < clause.size(); i++) {
+      int var = abs(clause[i]);
+      if (prop.Value(var) == 2) {
+        if (newVar[var] == 0) {
+          newVar[var] = ++rest.numVars;
+        }
+        lits.push_back(clause[i] > 0 ? newVar[var] : -newVar[var]);
+      }
+    }
+    rest.clauses.push_back(lits);
+  }
+
+  // The projection of the rest, and the unassigned counted variables in
+  // no clause, which take either value
+  int freeVars = 0;
+  std::vector<int> counted = CountedVars(cnf);
+  for (int i = 0; i < counted.size(); i++) {
+    int var = counted[i];
+    if (prop.Value(var) != 2) {
+      continue;
+    }
+    if (newVar[var] == 0) {
+      freeVars++;
+    } else if (cnf.hasProjection) {
+      rest.projection.push_back(newVar[var]);
+    }
+  }
+  // Once a projected formula has no counted variable left, all its
+  // models are one assignment of the projection
+  bool existential = cnf.hasProjection && rest.projection.empty();
+
+  BigNum count(1);
+  if (rest.clauses.empty()) {
+    // Every assignment of the rest is a model
+  } else if (rest.numVars <= std::min(enumerateVars, MaxEnumerateVars)) {
+    // Enumeration counts over the projection
+    count = EnumerateModels(rest);
+  } else {
+    bool timedOut = false;
+    if (!RunCounter(command, rest, &count, timeout, &timedOut)) {
+      result.status = timedOut ? CubeCount::TimedOut : CubeCount::Failed;
+      return result;
+    }
+  }
+  if (existential && !(count == BigNum(0))) {
+    count = BigNum(1);
+  }
+  result.count = count * BigNum::Pow2(freeVars);
+  return result;
+}
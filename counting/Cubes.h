@@ -0,0 +1,76 @@
+// Cubes.h
+// Cube-and-conquer counting: the formula is split into cubes (values of
+// a few input bits) that are counted independently. The cubes of a split
+// are disjoint and cover every assignment, so the count of the formula is
+// the sum of the counts of its cubes
+
+#ifndef CFCOUNT_CUBES_H
+#define CFCOUNT_CUBES_H
+
+#include "BigNum.h"
+#include "CNF.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Unit propagation of a formula under a cube (two watched literals)
+class Propagator {
+public:
+  Propagator(const CNF &cnf);
+
+  // Undo every assignment and assign the literals of a cube, with unit
+  // propagation. Returns false if the cube contradicts the formula
+  bool SetCube(const std::vector<int> &cube);
+  // Number of variables a literal assigns (itself included) on top of
+  // the cube, or -1 if it contradicts it
+  int Implied(int lit);
+  // Value of a variable (0 false, 1 true, 2 unassigned)
+  int Value(int var) const { return value[var - 1]; }
+
+private:
+  // Literals are 2 * var + sign, variables are 0 based
+  std::vector<std::vector<int> > clauses;
+  std::vector<std::vector<int> > watches;
+  std::vector<int> units;
+  std::vector<uint8_t> value;
+  std::vector<int> trail;
+  int qhead;
+  bool empty;
+
+  int LitValue(int lit) const;
+  bool Assign(int lit);
+  bool Propagate();
+  void Backtrack(int trailSize);
+};
+
+// Variables worth splitting on: the counted variables that occur in the
+// formula (at most the max that occur most often)
+std::vector<int> SplitCandidates(const CNF &cnf, int max = 256);
+
+// The (at most max) candidates unassigned by the cube that decide the
+// most of the formula under it: each is scored by the product of the
+// variables its two values imply (lookahead). A value that contradicts
+// the cube decides everything
+std::vector<int> PickSplitVars(Propagator &prop,
+                               const std::vector<int> &candidates,
+                               const std::vector<int> &cube, int max);
+
+// How counting a cube ended
+struct CubeCount {
+  enum Status { Counted, TimedOut, Failed };
+  Status status;
+  BigNum count;
+};
+
+// Count the models of the formula that agree with the cube. The formula
+// is simplified under the cube first, counted variables left in no clause
+// count twice and remainders of at most enumerateVars variables are
+// enumerated.
+// Others are counted by "<command> <file>", which is given up after
+// timeout seconds (0 for no limit)
+CubeCount CountCube(const CNF &cnf, Propagator &prop,
+                    const std::vector<int> &cube, const std::string &command,
+                    int enumerateVars, unsigned timeout);
+
+#endif
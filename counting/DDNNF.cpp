@@ -0,0 +1,872 @@
+// DDNNF.cpp
+// Top-down compilation of a path's CNF into a decision-DNNF over its
+// input bits (decisions, unit propagation, components and a cache of
+// compiled components), and counting the circuit under assumptions
+
+#include "DDNNF.h"
+
+#include "Solver.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <thread>
+
+namespace {
+
+// Index of a literal in per-literal tables
+inline int LitIdx(int lit) { return 2 * abs(lit) + (lit < 0); }
+
+struct Compiler {
+  const CNF &cnf;
+  DDNNF *ddnnf;
+  CompileStats stats;
+  std::vector<bool> isProjection;
+  // Clauses each literal occurs in
+  std::vector<std::vector<int> > occurs;
+  // Value of each variable (1 true, -1 false, 0 unassigned)
+  std::vector<int> value;
+  std::vector<int> trail;
+  // True and false literals of each clause under the assignment
+  std::vector<int> numTrue;
+  std::vector<int> numFalse;
+  // Scratch marks of variables and clauses, set to the current stamp
+  std::vector<int> varMark;
+  std::vector<int> clauseMark;
+  std::vector<int> occurrences;
+  int stamp;
+  // Nodes of the circuit by kind, literal and children
+  std::map<std::vector<int>, int> unique;
+  // Compiled components by their variables and clauses
+  std::map<std::vector<int>, int> cache;
+  int trueNode;
+  int falseNode;
+
+  Compiler(const CNF &cnf, DDNNF *ddnnf);
+  int AddNode(DDNNF::Kind kind, int lit, std::vector<int> children);
+  int MakeAnd(std::vector<int> children);
+  int MakeOr(int decision, std::vector<int> children);
+  void SetTrue(int lit);
+  bool Assign(int lit);
+  void Undo(int trailSize);
+  void SplitResidual(const std::vector<int> &clauses,
+                     std::vector<std::vector<int> > *compClauses,
+                     std::vector<std::vector<int> > *compVars);
+  bool Satisfiable(const std::vector<int> &clauses);
+  int CompileResidual(const std::vector<int> &clauses,
+                      const std::vector<int> &projection, int trailStart);
+  int CompileComponent(const std::vector<int> &clauses,
+                       const std::vector<int> &vars);
+};
+
+Compiler::Compiler(const CNF &cnf, DDNNF *ddnnf)
+    : cnf(cnf), ddnnf(ddnnf), isProjection(cnf.numVars + 1, false),
+      occurs(2 * cnf.numVars + 2), value(cnf.numVars + 1, 0),
+      numTrue(cnf.clauses.size(), 0), numFalse(cnf.clauses.size(), 0),
+      varMark(cnf.numVars + 1, 0), clauseMark(cnf.clauses.size(), 0),
+      occurrences(cnf.numVars + 1, 0), stamp(0) {
+
+  stats = CompileStats();
+  std::vector<int> projection = CountedVars(cnf);
+  for (int i = 0; i < projection.size(); i++) {
+    isProjection[projection[i]] = true;
+  }
+  for (int c = 0; c < cnf.clauses.size(); c++) {
+    for (int i = 0; i < cnf.clauses[c].size(); i++) {
+      occurs[LitIdx(cnf.clauses[c][i])].push_back(c);
+    }
+  }
+
+  ddnnf->nodes.clear();
+  ddnnf->numVars = cnf.numVars;
+  ddnnf->hasProjection = cnf.hasProjection;
+  ddnnf->projection = cnf.projection;
+  ddnnf->inputs = cnf.inputs;
+  trueNode = AddNode(DDNNF::And, 0, std::vector<int>());
+  falseNode = AddNode(DDNNF::Or, 0, std::vector<int>());
+}
+
+int Compiler::AddNode(DDNNF::Kind kind, int lit, std::vector<int> children) {
+  std::vector<int> key(1, kind);
+  key.push_back(lit);
+  key.insert(key.end(), children.begin(), children.end());
+  std::map<std::vector<int>, int>::iterator it = unique.find(key);
+  if (it != unique.end()) {
+    return it->second;
+  }
+  DDNNF::Node node;
+  node.kind = kind;
+  node.lit = lit;
+  node.children = children;
+  ddnnf->nodes.push_back(node);
+  unique[key] = ddnnf->nodes.size() - 1;
+  return ddnnf->nodes.size() - 1;
+}
+
+int Compiler::MakeAnd(std::vector<int> children) {
+  std::vector<int> kept;
+  for (int i = 0; i < children.size(); i++) {
+    if (children[i] == falseNode) {
+      return falseNode;
+    }
+    if (children[i] != trueNode) {
+      kept.push_back(children[i]);
+    }
+  }
+  if (kept.size() == 1) {
+    return kept[0];
+  }
+  std::sort(kept.begin(), kept.end());
+  return AddNode(DDNNF::And, 0, kept);
+}
+
+int Compiler::MakeOr(int decision, std::vector<int> children) {
+  std::vector<int> kept;
+  for (int i = 0; i < children.size(); i++) {
+    if (children[i] != falseNode) {
+      kept.push_back(children[i]);
+    }
+  }
+  if (kept.empty()) {
+    return falseNode;
+  }
+  if (kept.size() == 1) {
+    return kept[0];
+  }
+  return AddNode(DDNNF::Or, decision, kept);
+}
+
+void Compiler::SetTrue(int lit) {
+  value[abs(lit)] = lit > 0 ? 1 : -1;
+  trail.push_back(lit);
+  const std::vector<int> &satisfied = occurs[LitIdx(lit)];
+  for (int i = 0; i < satisfied.size(); i++) {
+    numTrue[satisfied[i]]++;
+  }
+  const std::vector<int> &shrunk = occurs[LitIdx(-lit)];
+  for (int i = 0; i < shrunk.size(); i++) {
+    numFalse[shrunk[i]]++;
+  }
+}
+
+// Assign a literal and propagate it. Returns false on a conflict, the
+// caller undoes the assignment either way
+bool Compiler::Assign(int lit) {
+  if (value[abs(lit)] != 0) {
+    return value[abs(lit)] == (lit > 0 ? 1 : -1);
+  }
+  int head = trail.size();
+  SetTrue(lit);
+  while (head < trail.size()) {
+    const std::vector<int> &shrunk = occurs[LitIdx(-trail[head++])];
+    for (int i = 0; i < shrunk.size(); i++) {
+      int c = shrunk[i];
+      const std::vector<int> &clause = cnf.clauses[c];
+      if (numTrue[c] > 0 || numFalse[c] < clause.size() - 1) {
+        continue;
+      }
+      if (numFalse[c] == clause.size()) {
+        return false;
+      }
+      // The only unassigned literal is implied
+      for (int j = 0; j < clause.size(); j++) {
+        if (value[abs(clause[j])] == 0) {
+          SetTrue(clause[j]);
+          break;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+void Compiler::Undo(int trailSize) {
+  while (trail.size() > trailSize) {
+    int lit = trail.back();
+    trail.pop_back();
+    value[abs(lit)] = 0;
+    const std::vector<int> &satisfied = occurs[LitIdx(lit)];
+    for (int i = 0; i < satisfied.size(); i++) {
+      numTrue[satisfied[i]]--;
+    }
+    const std::vector<int> &shrunk = occurs[LitIdx(-lit)];
+    for (int i = 0; i < shrunk.size(); i++) {
+      numFalse[shrunk[i]]--;
+    }
+  }
+}
+
+// Split the clauses that are not satisfied yet into components connected
+// by unassigned variables. Clauses and variables of each are sorted
+void Compiler::SplitResidual(const std::vector<int> &clauses,
+                             std::vector<std::vector<int> > *compClauses,
+                             std::vector<std::vector<int> > *compVars) {
+  stamp++;
+  for (int i = 0; i < clauses.size(); i++) {
+    int start = clauses[i];
+    if (numTrue[start] > 0 || clauseMark[start] == stamp) {
+      continue;
+    }
+    compClauses->push_back(std::vector<int>());
+    compVars->push_back(std::vector<int>());
+    std::vector<int> &compClause = compClauses->back();
+    std::vector<int> &compVar = compVars->back();
+
+    clauseMark[start] = stamp;
+    compClause.push_back(start);
+    for (int next = 0; next < compClause.size(); next++) {
+      const std::vector<int> &clause = cnf.clauses[compClause[next]];
+      for (int j = 0; j < clause.size(); j++) {
+        int var = abs(clause[j]);
+        if (value[var] != 0 || varMark[var] == stamp) {
+          continue;
+        }
+        varMark[var] = stamp;
+        compVar.push_back(var);
+        for (int sign = 1; sign >= -1; sign -= 2) {
+          const std::vector<int> &occ = occurs[LitIdx(sign * var)];
+          for (int k = 0; k < occ.size(); k++) {
+            if (numTrue[occ[k]] == 0 && clauseMark[occ[k]] != stamp) {
+              clauseMark[occ[k]] = stamp;
+              compClause.push_back(occ[k]);
+            }
+          }
+        }
+      }
+    }
+    std::sort(compClause.begin(), compClause.end());
+    std::sort(compVar.begin(), compVar.end());
+  }
+}
+
+// Whether a component with no projection variables has a model
+bool Compiler::Satisfiable(const std::vector<int> &clauses) {
+  stats.satChecks++;
+  CNF residual;
+  std::map<int, int> newVar;
+  for (int i = 0; i < clauses.size(); i++) {
+    const std::vector<int> &clause = cnf.clauses[clauses[i]];
+    std::vector<int> lits;
+    for (int j = 0; j < clause.size(); j++) {
+      int var = abs(clause[j]);
+      if (value[var] != 0) {
+        continue;
+      }
+      if (newVar.find(var) == newVar.end()) {
+        int next = newVar.size() + 1;
+        newVar[var] = next;
+      }
+      lits.push_back(clause[j] > 0 ? newVar[var] : -newVar[var]);
+    }
+    residual.clauses.push_back(lits);
+  }
+  residual.numVars = newVar.size();
+  Solver solver(residual);
+  return solver.Solve();
+}
+
+// The circuit of what is left of a component after the literals assigned
+// since trailStart: the assigned projection literals, the components of
+// the clauses that are not satisfied and both values of every projection
+// variable that is left in none of them
+int Compiler::CompileResidual(const std::vector<int> &clauses,
+                              const std::vector<int> &projection,
+                              int trailStart) {
+  std::vector<int> children;
+  for (int i = trailStart; i < trail.size(); i++) {
+    if (isProjection[abs(trail[i])]) {
+      children.push_back(AddNode(DDNNF::Lit, trail[i], std::vector<int>()));
+    }
+  }
+
+  std::vector<std::vector<int> > compClauses, compVars;
+  SplitResidual(clauses, &compClauses, &compVars);
+
+  stamp++;
+  for (int i = 0; i < compVars.size(); i++) {
+    for (int j = 0; j < compVars[i].size(); j++) {
+      varMark[compVars[i][j]] = stamp;
+    }
+  }
+  for (int i = 0; i < projection.size(); i++) {
+    int var = projection[i];
+    if (value[var] == 0 && varMark[var] != stamp) {
+      std::vector<int> both;
+      both.push_back(AddNode(DDNNF::Lit, var, std::vector<int>()));
+      both.push_back(AddNode(DDNNF::Lit, -var, std::vector<int>()));
+      children.push_back(MakeOr(0, both));
+    }
+  }
+
+  for (int i = 0; i < compClauses.size(); i++) {
+    int child = CompileComponent(compClauses[i], compVars[i]);
+    if (child == falseNode) {
+      return falseNode;
+    }
+    children.push_back(child);
+  }
+  return MakeAnd(children);
+}
+
+int Compiler::CompileComponent(const std::vector<int> &clauses,
+                               const std::vector<int> &vars) {
+  std::vector<int> key = vars;
+  key.push_back(0);
+  key.insert(key.end(), clauses.begin(), clauses.end());
+  std::map<std::vector<int>, int>::iterator it = cache.find(key);
+  if (it != cache.end()) {
+    stats.cacheHits++;
+    return it->second;
+  }
+
+  std::vector<int> projection;
+  for (int i = 0; i < vars.size(); i++) {
+    if (isProjection[vars[i]]) {
+      projection.push_back(vars[i]);
+    }
+  }
+
+  int node;
+  if (projection.empty()) {
+    // Every model of the rest is the same assignment of the projection
+    node = Satisfiable(clauses) ? trueNode : falseNode;
+  } else {
+    // Decide the projection variable in the most unsatisfied clauses
+    for (int i = 0; i < clauses.size(); i++) {
+      const std::vector<int> &clause = cnf.clauses[clauses[i]];
+      for (int j = 0; j < clause.size(); j++) {
+        if (value[abs(clause[j])] == 0) {
+          occurrences[abs(clause[j])]++;
+        }
+      }
+    }
+    int decision = projection[0];
+    for (int i = 0; i < projection.size(); i++) {
+      if (occurrences[projection[i]] > occurrences[decision]) {
+        decision = projection[i];
+      }
+    }
+    for (int i = 0; i < vars.size(); i++) {
+      occurrences[vars[i]] = 0;
+    }
+
+    stats.decisions++;
+    std::vector<int> children;
+    for (int sign = 1; sign >= -1; sign -= 2) {
+      int trailSize = trail.size();
+      int child = falseNode;
+      if (Assign(sign * decision)) {
+        child = CompileResidual(clauses, projection, trailSize);
+      }
+      Undo(trailSize);
+      children.push_back(child);
+    }
+    node = MakeOr(decision, children);
+  }
+
+  cache[key] = node;
+  return node;
+}
+
+} // namespace
+
+CompileStats CompileDDNNF(const CNF &cnf, DDNNF *ddnnf) {
+
+  Compiler compiler(cnf, ddnnf);
+
+  // Unit clauses hold in every model
+  bool conflict = false;
+  for (int c = 0; c < cnf.clauses.size() && !conflict; c++) {
+    if (cnf.clauses[c].empty()) {
+      conflict = true;
+    } else if (cnf.clauses[c].size() == 1) {
+      conflict = !compiler.Assign(cnf.clauses[c][0]);
+    }
+  }
+
+  int root = compiler.falseNode;
+  if (!conflict) {
+    std::vector<int> clauses;
+    for (int c = 0; c < cnf.clauses.size(); c++) {
+      clauses.push_back(c);
+    }
+    root = compiler.CompileResidual(clauses, CountedVars(cnf), 0);
+  }
+
+  // The root has to be the last node
+  if (root != ddnnf->nodes.size() - 1) {
+    compiler.AddNode(DDNNF::And, 0, std::vector<int>(1, root));
+  }
+  return compiler.stats;
+}
+
+bool ReadDDNNF(const std::string &filename, DDNNF *ddnnf) {
+
+  std::ifstream nnf_file(filename);
+  if (!nnf_file.is_open()) {
+    return false;
+  }
+
+  ddnnf->nodes.clear();
+  ddnnf->hasProjection = false;
+  ddnnf->projection.clear();
+  ddnnf->inputs.clear();
+  std::string line;
+  while (std::getline(nnf_file, line)) {
+    std::stringstream ss(line);
+    std::string first;
+    if (!(ss >> first)) {
+      continue;
+    }
+
+    // The projection and input bits are written as in the DIMACS files
+    if (first == "c") {
+      std::string kind;
+      int var;
+      if (ss >> kind && kind == "ind") {
+        ddnnf->hasProjection = true;
+        while (ss >> var && var != 0) {
+          ddnnf->projection.push_back(var);
+        }
+      } else if (kind == "input") {
+        int index, width;
+        if (ss >> index >> width && index >= 0 && width >= 0) {
+          if (index >= ddnnf->inputs.size()) {
+            ddnnf->inputs.resize(index + 1);
+          }
+          ddnnf->inputs[index].assign(width, 0);
+          for (int bit = 0; bit < width && ss >> var; bit++) {
+            ddnnf->inputs[index][bit] = var;
+          }
+        }
+      }
+      continue;
+    }
+    if (first == "nnf") {
+      int numNodes, numEdges;
+      ss >> numNodes >> numEdges >> ddnnf->numVars;
+      continue;
+    }
+
+    DDNNF::Node node;
+    int numChildren, child;
+    if (first == "L") {
+      node.kind = DDNNF::Lit;
+      ss >> node.lit;
+    } else if (first == "A" || first == "O") {
+      node.kind = first == "A" ? DDNNF::And : DDNNF::Or;
+      node.lit = 0;
+      if (first == "O") {
+        ss >> node.lit;
+      }
+      ss >> numChildren;
+      for (int i = 0; i < numChildren && ss >> child; i++) {
+        if (child < 0 || child >= ddnnf->nodes.size()) {
+          return false;
+        }
+        node.children.push_back(child);
+      }
+    } else {
+      return false;
+    }
+    ddnnf->nodes.push_back(node);
+  }
+
+  return !ddnnf->nodes.empty();
+}
+
+bool WriteDDNNF(const std::string &filename, const DDNNF &ddnnf) {
+
+  std::ofstream nnf_file(filename);
+  if (!nnf_file.is_open()) {
+    return false;
+  }
+
+  if (ddnnf.hasProjection) {
+    nnf_file << "c ind";
+    for (int i = 0; i < ddnnf.projection.size(); i++) {
+      nnf_file << " " << ddnnf.projection[i];
+    }
+    nnf_file << " 0\n";
+  }
+  for (int i = 0; i < ddnnf.inputs.size(); i++) {
+    if (ddnnf.inputs[i].empty()) {
+      continue;
+    }
+    nnf_file << "c input " << i << " " << ddnnf.inputs[i].size();
+    for (int bit = 0; bit < ddnnf.inputs[i].size(); bit++) {
+      nnf_file << " " << ddnnf.inputs[i][bit];
+    }
+    nnf_file << "\n";
+  }
+
+  int numEdges = 0;
+  for (int i = 0; i < ddnnf.nodes.size(); i++) {
+    numEdges += ddnnf.nodes[i].children.size();
+  }
+  nnf_file << "nnf " << ddnnf.nodes.size() << " " << numEdges << " "
+           << ddnnf.numVars << "\n";
+  for (int i = 0; i < ddnnf.nodes.size(); i++) {
+    const DDNNF::Node &node = ddnnf.nodes[i];
+    if (node.kind == DDNNF::Lit) {
+      nnf_file << "L " << node.lit << "\n";
+      continue;
+    }
+    if (node.kind == DDNNF::And) {
+      nnf_file << "A " << node.children.size();
+    } else {
+      nnf_file << "O " << node.lit << " " << node.children.size();
+    }
+    for (int j = 0; j < node.children.size(); j++) {
+      nnf_file << " " << node.children[j];
+    }
+    nnf_file << "\n";
+  }
+
+  return true;
+}
+
+// Number of assignments of the variables under each node that satisfy it
+// and the assumed literals
+static std::vector<BigNum> NodeCounts(const DDNNF &ddnnf,
+                                      const std::vector<int> &assumptions) {
+
+  // Literals whose negation is assumed count for nothing
+  std::vector<bool> excluded(2 * ddnnf.numVars + 2, false);
+  for (int i = 0; i < assumptions.size(); i++) {
+    if (abs(assumptions[i]) <= ddnnf.numVars) {
+      excluded[LitIdx(-assumptions[i])] = true;
+    }
+  }
+
+  std::vector<BigNum> counts(ddnnf.nodes.size());
+  for (int i = 0; i < ddnnf.nodes.size(); i++) {
+    const DDNNF::Node &node = ddnnf.nodes[i];
+    if (node.kind == DDNNF::Lit) {
+      counts[i] = BigNum(excluded[LitIdx(node.lit)] ? 0 : 1);
+    } else if (node.kind == DDNNF::And) {
+      counts[i] = BigNum(1);
+      for (int j = 0; j < node.children.size(); j++) {
+        counts[i] *= counts[node.children[j]];
+      }
+    } else {
+      for (int j = 0; j < node.children.size(); j++) {
+        counts[i] += counts[node.children[j]];
+      }
+    }
+  }
+  return counts;
+}
+
+BigNum CountDDNNF(const DDNNF &ddnnf, const std::vector<int> &assumptions) {
+  std::vector<BigNum> counts = NodeCounts(ddnnf, assumptions);
+  return counts.empty() ? BigNum(0) : counts.back();
+}
+
+bool ReadBounds(const std::string &filename,
+                std::vector<std::pair<int64_t, int64_t> > *bounds) {
+  std::ifstream bounds_file(filename);
+  if (!bounds_file.is_open()) {
+    return false;
+  }
+  int64_t lower, upper;
+  while (bounds_file >> lower >> upper) {
+    bounds->push_back(std::make_pair(lower, upper));
+  }
+  return true;
+}
+
+namespace {
+
+// Assumptions that restrict an input to one block of its range, and the
+// number of its bits in no clause that the block leaves free. The block
+// fixes the bits from size up to the bits of value
+struct Cube {
+  std::vector<int> lits;
+  int freeBits;
+  int size;
+  uint64_t value;
+};
+
+// Split the signed range [lower, upper] of an input into aligned blocks,
+// each one fixing the bits above some position
+std::vector<Cube> RangeCubes(const std::vector<int> &bits, int64_t lower,
+                             int64_t upper) {
+  std::vector<Cube> cubes;
+  int width = bits.size();
+  int64_t min = width == 64 ? INT64_MIN : -(int64_t)(1ull << (width - 1));
+  int64_t max = width == 64 ? INT64_MAX : (int64_t)(1ull << (width - 1)) - 1;
+  lower = std::max(lower, min);
+  upper = std::min(upper, max);
+  if (lower > upper) {
+    return cubes;
+  }
+
+  // Offset by -min the range is unsigned, the offset flips the sign bit
+  uint64_t low = (uint64_t)lower - (uint64_t)min;
+  uint64_t high = (uint64_t)upper - (uint64_t)min;
+  while (true) {
+    // Grow the block at low while it is aligned and within the range
+    int size = 0;
+    while (size < width && ((low >> size) & 1) == 0) {
+      uint64_t span = size + 1 == 64 ? ~0ull : (1ull << (size + 1)) - 1;
+      if (span > high - low) {
+        break;
+      }
+      size++;
+    }
+
+    Cube cube;
+    cube.freeBits = 0;
+    cube.size = size;
+    cube.value = 0;
+    for (int bit = 0; bit < width; bit++) {
+      if (bit < size) {
+        cube.freeBits += bits[bit] == 0;
+        continue;
+      }
+      bool set = ((low >> bit) & 1) != (bit == width - 1);
+      cube.value |= (uint64_t)set << bit;
+      if (bits[bit] != 0) {
+        cube.lits.push_back(set ? bits[bit] : -bits[bit]);
+      }
+    }
+    cubes.push_back(cube);
+
+    uint64_t last = low + (size == 64 ? ~0ull : (1ull << size) - 1);
+    if (last == high) {
+      break;
+    }
+    low = last + 1;
+  }
+  return cubes;
+}
+
+} // namespace
+
+bool CountDDNNFInBounds(const DDNNF &ddnnf,
+                        const std::vector<std::pair<int64_t, int64_t> > &bounds,
+                        BigNum *count) {
+
+  if (ddnnf.inputs.empty() || bounds.size() < ddnnf.inputs.size()) {
+    return false;
+  }
+
+  std::vector<std::vector<Cube> > cubes;
+  for (int i = 0; i < ddnnf.inputs.size(); i++) {
+    if (ddnnf.inputs[i].empty()) {
+      continue;
+    }
+    cubes.push_back(RangeCubes(ddnnf.inputs[i], bounds[i].first,
+                               bounds[i].second));
+    if (cubes.back().empty()) {
+      *count = BigNum(0);
+      return true;
+    }
+  }
+
+  // Every combination of one cube per input
+  *count = BigNum(0);
+  std::vector<int> choice(cubes.size(), 0);
+  while (true) {
+    std::vector<int> assumptions;
+    unsigned freeBits = 0;
+    for (int i = 0; i < cubes.size(); i++) {
+      const Cube &cube = cubes[i][choice[i]];
+      assumptions.insert(assumptions.end(), cube.lits.begin(),
+                         cube.lits.end());
+      freeBits += cube.freeBits;
+    }
+    *count += CountDDNNF(ddnnf, assumptions) * BigNum::Pow2(freeBits);
+
+    int i = 0;
+    while (i < cubes.size() && ++choice[i] == cubes[i].size()) {
+      choice[i++] = 0;
+    }
+    if (i == cubes.size()) {
+      break;
+    }
+  }
+  return true;
+}
+
+// Draw an assignment of the circuit's variables: an Or takes a child
+// with probability proportional to its count, an And takes every child.
+// Sets the value (0 or 1) of the variables of the literals it reaches
+static void SampleModel(const DDNNF &ddnnf, const std::vector<BigNum> &counts,
+                        std::mt19937_64 &rng, std::vector<int8_t> *model) {
+  std::vector<int> stack(1, ddnnf.nodes.size() - 1);
+  while (!stack.empty()) {
+    int n = stack.back();
+    stack.pop_back();
+    const DDNNF::Node &node = ddnnf.nodes[n];
+    if (node.kind == DDNNF::Lit) {
+      (*model)[abs(node.lit)] = node.lit > 0;
+    } else if (node.kind == DDNNF::And) {
+      stack.insert(stack.end(), node.children.begin(), node.children.end());
+    } else {
+      BigNum pick = BigNum::Random(counts[n], rng);
+      BigNum sum;
+      for (int j = 0; j < node.children.size(); j++) {
+        sum += counts[node.children[j]];
+        if (pick < sum) {
+          stack.push_back(node.children[j]);
+          break;
+        }
+      }
+    }
+  }
+}
+
+bool SampleDDNNFInBounds(
+    const DDNNF &ddnnf, const std::vector<std::pair<int64_t, int64_t> > &bounds,
+    int numSamples, unsigned jobs, uint64_t seed,
+    std::vector<std::vector<int64_t> > *samples) {
+
+  samples->clear();
+  if (ddnnf.inputs.empty() ||
+      (!bounds.empty() && bounds.size() < ddnnf.inputs.size()) ||
+      ddnnf.nodes.empty()) {
+    return false;
+  }
+
+  // The blocks of each input's range (its whole range without bounds)
+  std::vector<std::vector<Cube> > cubes(ddnnf.inputs.size());
+  uint64_t numCombinations = 1;
+  for (int i = 0; i < ddnnf.inputs.size(); i++) {
+    int width = ddnnf.inputs[i].size();
+    if (width == 0) {
+      continue;
+    }
+    int64_t lower = width == 64 ? INT64_MIN : -(int64_t)(1ull << (width - 1));
+    int64_t upper = width == 64 ? INT64_MAX : (int64_t)(1ull << (width - 1)) - 1;
+    if (!bounds.empty()) {
+      lower = bounds[i].first;
+      upper = bounds[i].second;
+    }
+    cubes[i] = RangeCubes(ddnnf.inputs[i], lower, upper);
+    if (cubes[i].empty()) {
+      return true;
+    }
+    numCombinations *= cubes[i].size();
+  }
+
+  // Combination c takes cube (c / radix) % size of each input. Returns
+  // the number of free bits of its cubes
+  auto combination = [&cubes](uint64_t c, std::vector<int> *choice,
+                              std::vector<int> *assumptions) {
+    unsigned freeBits = 0;
+    choice->assign(cubes.size(), 0);
+    assumptions->clear();
+    for (int i = 0; i < cubes.size(); i++) {
+      if (cubes[i].empty()) {
+        continue;
+      }
+      (*choice)[i] = c % cubes[i].size();
+      c /= cubes[i].size();
+      const Cube &cube = cubes[i][(*choice)[i]];
+      assumptions->insert(assumptions->end(), cube.lits.begin(),
+                          cube.lits.end());
+      freeBits += cube.freeBits;
+    }
+    return freeBits;
+  };
+
+  // Count every combination of one cube per input, on the workers
+  std::vector<BigNum> weights(numCombinations);
+  std::atomic<uint64_t> next(0);
+  std::vector<std::thread> workers;
+  for (unsigned w = 0; w < std::max(1u, jobs); w++) {
+    workers.push_back(std::thread([&]() {
+      std::vector<int> choice, assumptions;
+      for (uint64_t c = next++; c < numCombinations; c = next++) {
+        unsigned freeBits = combination(c, &choice, &assumptions);
+        weights[c] = CountDDNNF(ddnnf, assumptions) * BigNum::Pow2(freeBits);
+      }
+    }));
+  }
+  for (int w = 0; w < workers.size(); w++) {
+    workers[w].join();
+  }
+  workers.clear();
+
+  std::vector<BigNum> prefix(numCombinations);
+  BigNum total;
+  for (uint64_t c = 0; c < numCombinations; c++) {
+    total += weights[c];
+    prefix[c] = total;
+  }
+  if (total.IsZero()) {
+    return true;
+  }
+
+  // Sample s draws from its own generator, so the samples do not depend on
+  // the number of workers. Each one picks a combination by its weight
+  auto generator = [seed](int s) {
+    std::seed_seq seq{(uint32_t)seed, (uint32_t)(seed >> 32), (uint32_t)s};
+    return std::mt19937_64(seq);
+  };
+  std::map<uint64_t, std::vector<int> > byCombination;
+  for (int s = 0; s < numSamples; s++) {
+    std::mt19937_64 rng = generator(s);
+    BigNum pick = BigNum::Random(total, rng);
+    uint64_t c = std::upper_bound(prefix.begin(), prefix.end(), pick) -
+                 prefix.begin();
+    byCombination[c].push_back(s);
+  }
+  std::vector<std::pair<uint64_t, std::vector<int> > > groups(
+      byCombination.begin(), byCombination.end());
+
+  // The circuit is counted once per combination drawn, then each of its
+  // samples is one walk down from the root
+  samples->assign(numSamples, std::vector<int64_t>(ddnnf.inputs.size(), 0));
+  std::atomic<int> nextGroup(0);
+  for (unsigned w = 0; w < std::max(1u, jobs); w++) {
+    workers.push_back(std::thread([&]() {
+      std::vector<int> choice, assumptions;
+      std::vector<int8_t> model;
+      for (int g = nextGroup++; g < groups.size(); g = nextGroup++) {
+        combination(groups[g].first, &choice, &assumptions);
+        std::vector<BigNum> counts = NodeCounts(ddnnf, assumptions);
+        for (int k = 0; k < groups[g].second.size(); k++) {
+          int s = groups[g].second[k];
+          std::mt19937_64 rng = generator(s);
+          // Skip the draw of the combination
+          BigNum::Random(total, rng);
+          model.assign(ddnnf.numVars + 1, -1);
+          SampleModel(ddnnf, counts, rng, &model);
+
+          // Bits the block fixes, then bits of the model, then free bits
+          for (int i = 0; i < ddnnf.inputs.size(); i++) {
+            const std::vector<int> &bits = ddnnf.inputs[i];
+            if (bits.empty()) {
+              continue;
+            }
+            const Cube &cube = cubes[i][choice[i]];
+            uint64_t value = cube.value;
+            for (int bit = 0; bit < cube.size; bit++) {
+              int v = bits[bit] != 0 ? model[bits[bit]] : -1;
+              if (v < 0) {
+                v = rng() & 1;
+              }
+              value |= (uint64_t)v << bit;
+            }
+            // Sign extend
+            int width = bits.size();
+            if (width < 64 && ((value >> (width - 1)) & 1)) {
+              value |= ~0ull << width;
+            }
+            (*samples)[s][i] = (int64_t)value;
+          }
+        }
+      }
+    }));
+  }
+  for (int w = 0; w < workers.size(); w++) {
+    workers[w].join();
+  }
+  return true;
+}
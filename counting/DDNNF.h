@@ -0,0 +1,103 @@
+// DDNNF.h
+// Compiling a path's CNF into a d-DNNF over its input bits, so the path
+// can be counted again under other input bounds without a model counter
+
+#ifndef CFCOUNT_DDNNF_H
+#define CFCOUNT_DDNNF_H
+
+#include "BigNum.h"
+#include "CNF.h"
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// A smooth decision-DNNF: the children of an And share no variables, the
+// children of an Or disagree on its decision variable and every child of
+// an Or mentions the same variables. Only the projection variables (the
+// input bits) are in the circuit, the other variables of the CNF are
+// existentially quantified away.
+//
+// An And with no children is true, an Or with no children is false
+struct DDNNF {
+  enum Kind { Lit, And, Or };
+  struct Node {
+    Kind kind;
+    // The literal of a Lit node, the decision variable of an Or (0 for
+    // the Ors that only make the circuit smooth)
+    int lit;
+    std::vector<int> children;
+  };
+
+  // Children come before their parents, the root is the last node
+  std::vector<Node> nodes;
+  int numVars;
+  // Variables of the circuit and the input bits of the CNF, as in CNF
+  bool hasProjection;
+  std::vector<int> projection;
+  std::vector<std::vector<int> > inputs;
+
+  DDNNF() : numVars(0), hasProjection(false) {}
+};
+
+// What the compiler did
+struct CompileStats {
+  int decisions;
+  int cacheHits;
+  // Components without projection variables checked with the SAT solver
+  int satChecks;
+};
+
+// Compile a formula. The counted variables (see CountedVars) are the
+// vocabulary of the circuit
+CompileStats CompileDDNNF(const CNF &cnf, DDNNF *ddnnf);
+
+// Read and write circuits in c2d's NNF format ("nnf", "L", "A" and "O"
+// lines), with the projection and input bits as "c ind" and "c input"
+// lines before the header as in the DIMACS files
+bool ReadDDNNF(const std::string &filename, DDNNF *ddnnf);
+bool WriteDDNNF(const std::string &filename, const DDNNF &ddnnf);
+
+// Number of assignments of the projection that satisfy the circuit and
+// the assumed literals, in one pass over the circuit
+BigNum CountDDNNF(const DDNNF &ddnnf, const std::vector<int> &assumptions);
+
+// Number of assignments of the input bits with each input within its
+// (signed) bounds that satisfy the circuit. Input bits that are in no
+// clause are free. A range is the union of at most 2 * width cubes that
+// fix a prefix of the input's bits, so this is one pass per combination
+// of cubes of the inputs: up to (2 * width)^k passes for k bounded inputs,
+// exponential in the number of inputs (64^3 = 262144 passes for three
+// 32-bit inputs with arbitrary bounds). Bounds that are whole aligned
+// blocks (e.g. [0, 2^m - 1]) are one cube each.
+//
+// Returns false if the circuit's input bits are unknown or there are
+// fewer bounds than inputs
+bool CountDDNNFInBounds(const DDNNF &ddnnf,
+                        const std::vector<std::pair<int64_t, int64_t> > &bounds,
+                        BigNum *count);
+
+// Read a bounds file: the lower and upper bound of each input, in the
+// order the path reads them
+bool ReadBounds(const std::string &filename,
+                std::vector<std::pair<int64_t, int64_t> > *bounds);
+
+// Draw numSamples assignments of the inputs uniformly at random among
+// those within their (signed) bounds that satisfy the circuit, or among
+// all of them without bounds. Each sample is the value of every input,
+// in the order of the bounds (0 for inputs with unknown bits). The range
+// cubes of CountDDNNFInBounds are counted once (on jobs threads), each
+// sample picks a combination of cubes by its count, and the circuit is
+// counted once per combination picked; a sample is then one walk down
+// the circuit where Ors take a child by its count. Samples are
+// reproducible from the seed whatever the number of jobs.
+//
+// Returns false like CountDDNNFInBounds. No samples if nothing satisfies
+// the circuit within the bounds
+bool SampleDDNNFInBounds(
+    const DDNNF &ddnnf, const std::vector<std::pair<int64_t, int64_t> > &bounds,
+    int numSamples, unsigned jobs, uint64_t seed,
+    std::vector<std::vector<int64_t> > *samples);
+
+#endif
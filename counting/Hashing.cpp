@@ -0,0 +1,144 @@
+// Hashing.cpp
+// Hashing-based approximate model counting (ApproxMC style)
+
+#include "Hashing.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <random>
+#include <thread>
+
+HashedSolver::HashedSolver(const CNF &cnf, uint64_t seed)
+    : solver(cnf), vars(CountedVars(cnf)), rng(seed) {}
+
+void HashedSolver::AddRandomXor() {
+  // Every counted variable is in the XOR with probability 1/2,
+  // and the parity is random
+  std::vector<int> xorVars;
+  for (int i = 0; i < vars.size(); i++) {
+    if (rng() & 1) {
+      xorVars.push_back(vars[i]);
+    }
+  }
+  int activation = solver.NewVar();
+  solver.AddXor(xorVars, rng() & 1, activation);
+  xorActivation.push_back(activation);
+}
+
+int HashedSolver::BoundedSolutions(int numXors, int limit,
+                                   std::vector<std::vector<bool> > *solutions) {
+
+  while (xorActivation.size() < numXors) {
+    AddRandomXor();
+  }
+
+  // The blocking clauses of this query only hold while its
+  // own activation variable is assumed
+  int query = solver.NewVar();
+  std::vector<int> assumptions;
+  for (int i = 0; i < xorActivation.size(); i++) {
+    assumptions.push_back(i < numXors ? xorActivation[i] : -xorActivation[i]);
+  }
+  assumptions.push_back(query);
+
+  int found = 0;
+  while (found < limit && solver.Solve(assumptions)) {
+    found++;
+    std::vector<int> block(1, -query);
+    std::vector<bool> solution;
+    for (int i = 0; i < vars.size(); i++) {
+      bool val = solver.ModelValue(vars[i]);
+      solution.push_back(val);
+      block.push_back(val ? -vars[i] : vars[i]);
+    }
+    if (solutions != NULL) {
+      solutions->push_back(solution);
+    }
+    solver.AddClause(block);
+  }
+
+  // Retire the blocking clauses
+  solver.AddClause(std::vector<int>(1, -query));
+  return found;
+}
+
+int CellThreshold(double epsilon) {
+  return 1 + (int)ceil(9.84 * (1 + epsilon / (1 + epsilon)) *
+                       (1 + 1 / epsilon) * (1 + 1 / epsilon));
+}
+
+bool ApproxCount(const CNF &cnf, double epsilon, double delta, unsigned jobs,
+                 uint64_t seed, BigNum *estimate) {
+
+  int threshold = CellThreshold(epsilon);
+  int numVars = CountedVars(cnf).size();
+
+  // Few enough solutions to count them all
+  {
+    HashedSolver exact(cnf, seed);
+    int found = exact.BoundedSolutions(0, threshold);
+    if (found < threshold) {
+      *estimate = BigNum(found);
+      return true;
+    }
+  }
+
+  // Each trial hashes the solutions into cells, looking for the fewest
+  // XORs m that leave a cell with less than threshold solutions. Cells
+  // shrink as m grows, so a galloping search followed by a binary search
+  // finds m while only generating about twice as many XORs as needed.
+  // The estimate of the trial is the cell's size times 2^m
+  int numTrials = (int)ceil(17 * log2(3 / delta));
+  std::vector<BigNum> estimates(numTrials);
+  std::vector<char> succeeded(numTrials, false);
+  std::atomic<int> next(0);
+  std::vector<std::thread> workers;
+  for (unsigned w = 0; w < std::max(1u, jobs); w++) {
+    workers.push_back(std::thread([&]() {
+      for (int t = next++; t < numTrials; t = next++) {
+        HashedSolver hashed(cnf, seed + t + 1);
+        int low = 0, high = 1;
+        int highCount = hashed.BoundedSolutions(high, threshold);
+        while (highCount >= threshold && high < numVars) {
+          low = high;
+          high = std::min(2 * high, numVars);
+          highCount = hashed.BoundedSolutions(high, threshold);
+        }
+        while (high - low > 1) {
+          int mid = (low + high) / 2;
+          int count = hashed.BoundedSolutions(mid, threshold);
+          if (count >= threshold) {
+            low = mid;
+          } else {
+            high = mid;
+            highCount = count;
+          }
+        }
+        // An empty cell says nothing about the count
+        if (highCount > 0 && highCount < threshold) {
+          estimates[t] = BigNum(highCount) * BigNum::Pow2(high);
+          succeeded[t] = true;
+        }
+      }
+    }));
+  }
+  for (int w = 0; w < workers.size(); w++) {
+    workers[w].join();
+  }
+
+  // The median of the trials
+  std::vector<BigNum> results;
+  for (int t = 0; t < numTrials; t++) {
+    if (succeeded[t]) {
+      results.push_back(estimates[t]);
+    }
+  }
+  // Not a count of 0: there are at least threshold solutions
+  if (results.empty()) {
+    return false;
+  }
+  std::sort(results.begin(), results.end());
+  *estimate = results[results.size() / 2];
+  return true;
+}
@@ -0,0 +1,51 @@
+// Hashing.h
+// Hashing-based approximate model counting: random XOR constraints over
+// the input bits split the solutions into cells small enough to count
+
+#ifndef CFCOUNT_HASHING_H
+#define CFCOUNT_HASHING_H
+
+#include "BigNum.h"
+#include "CNF.h"
+#include "Solver.h"
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+// A solver for a formula with a list of random XOR constraints over the
+// counted variables. Any prefix of the list can be enabled per query,
+// so the cells of smaller prefixes contain the cells of longer ones.
+// XORs are only generated once a query needs them
+class HashedSolver {
+public:
+  HashedSolver(const CNF &cnf, uint64_t seed);
+
+  // Find up to limit solutions (over the counted variables) with the
+  // first numXors XORs enabled. Solutions are stored if requested
+  int BoundedSolutions(int numXors, int limit,
+                       std::vector<std::vector<bool> > *solutions = NULL);
+
+  const std::vector<int> &Vars() const { return vars; }
+
+private:
+  void AddRandomXor();
+
+  Solver solver;
+  std::vector<int> vars;
+  std::mt19937_64 rng;
+  // Activation variable of each XOR
+  std::vector<int> xorActivation;
+};
+
+// Number of solutions a cell can have for the (epsilon, delta) bounds
+int CellThreshold(double epsilon);
+
+// Estimate the number of models (over the projection) within a factor of
+// (1 + epsilon) with probability at least 1 - delta. The independent
+// trials run on jobs threads. Returns false, with no estimate, if every
+// trial failed to find a cell that is small enough but not empty
+bool ApproxCount(const CNF &cnf, double epsilon, double delta, unsigned jobs,
+                 uint64_t seed, BigNum *estimate);
+
+#endif
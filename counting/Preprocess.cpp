@@ -0,0 +1,593 @@
+// Preprocess.cpp
+// Count preserving simplification of a path's CNF: unit propagation,
+// equivalent literal substitution, subsumption and bounded variable
+// elimination of non-projection variables
+
+#include "Preprocess.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <queue>
+#include <stack>
+#include <utility>
+
+// Largest number of clause pairs tried when eliminating a variable
+static const int MaxResolutions = 400;
+// Longest resolvent added by variable elimination
+static const int MaxResolventLength = 32;
+
+namespace {
+
+// Index of a literal in per-literal tables
+inline int LitIdx(int lit) { return 2 * abs(lit) + (lit < 0); }
+
+// Order literals by variable so complementary literals are adjacent
+inline bool LitLess(int a, int b) {
+  return abs(a) < abs(b) || (abs(a) == abs(b) && a < b);
+}
+
+struct Simplifier {
+  int numVars;
+  std::vector<std::vector<int> > clauses;
+  std::vector<bool> removed;
+  // Value of each variable fixed by propagation (0 if unassigned)
+  std::vector<int> value;
+  // Literal each variable was replaced with (0 if not replaced)
+  std::vector<int> replacedBy;
+  std::vector<bool> eliminated;
+  std::vector<bool> isProjection;
+  bool hasProjection;
+  // Clauses each literal occurs in (may contain stale entries, users
+  // check the literal is still in the clause)
+  std::vector<std::vector<int> > occurs;
+  // Scratch marks indexed by literal
+  std::vector<char> mark;
+  // Units found outside of propagation
+  std::queue<int> units;
+  PreprocessStats stats;
+
+  Simplifier(CNF &cnf);
+  void BuildOccurs();
+  bool Contains(int c, int lit);
+  void RemoveLit(int c, int lit);
+  int AddClause(std::vector<int> clause);
+  void Propagate();
+  void SubstituteEquivalences();
+  void Subsume();
+  void EliminateVariables();
+  void Write(CNF *cnf);
+};
+
+Simplifier::Simplifier(CNF &cnf)
+    : numVars(cnf.numVars), value(cnf.numVars + 1, 0),
+      replacedBy(cnf.numVars + 1, 0), eliminated(cnf.numVars + 1, false),
+      isProjection(cnf.numVars + 1, false),
+      hasProjection(cnf.hasProjection), mark(2 * cnf.numVars + 2, 0) {
+
+  stats = PreprocessStats();
+  stats.varsBefore = cnf.numVars;
+  stats.clausesBefore = cnf.clauses.size();
+
+  for (int i = 0; i < cnf.projection.size(); i++) {
+    isProjection[cnf.projection[i]] = true;
+  }
+  for (int i = 0; i < cnf.clauses.size(); i++) {
+    AddClause(cnf.clauses[i]);
+  }
+}
+
+void Simplifier::BuildOccurs() {
+  occurs.assign(2 * numVars + 2, std::vector<int>());
+  for (int c = 0; c < clauses.size(); c++) {
+    if (removed[c]) {
+      continue;
+    }
+    for (int i = 0; i < clauses[c].size(); i++) {
+      occurs[LitIdx(clauses[c][i])].push_back(c);
+    }
+  }
+}
+
+bool Simplifier::Contains(int c, int lit) {
+  return std::binary_search(clauses[c].begin(), clauses[c].end(), lit,
+                            LitLess);
+}
+
+// Remove a literal from a clause, tracking the units and empty
+// clauses it creates
+void Simplifier::RemoveLit(int c, int lit) {
+  std::vector<int> &clause = clauses[c];
+  clause.erase(std::lower_bound(clause.begin(), clause.end(), lit, LitLess));
+  if (clause.empty()) {
+    stats.unsat = true;
+  } else if (clause.size() == 1) {
+    units.push(clause[0]);
+  }
+}
+
+// Add a clause (sorted, no duplicate literals, not a tautology)
+// and register it in the occurrence lists if they exist
+int Simplifier::AddClause(std::vector<int> clause) {
+  std::sort(clause.begin(), clause.end(), LitLess);
+  int c = clauses.size();
+  clauses.push_back(clause);
+  removed.push_back(false);
+  if (clause.empty()) {
+    stats.unsat = true;
+  } else if (clause.size() == 1) {
+    units.push(clause[0]);
+  }
+  if (!occurs.empty()) {
+    for (int i = 0; i < clause.size(); i++) {
+      occurs[LitIdx(clause[i])].push_back(c);
+    }
+  }
+  return c;
+}
+
+// Assign every unit and simplify the clauses it occurs in
+void Simplifier::Propagate() {
+  BuildOccurs();
+  while (!units.empty() && !stats.unsat) {
+    int lit = units.front();
+    units.pop();
+    int var = abs(lit);
+    int sign = lit > 0 ? 1 : -1;
+    if (value[var] == sign) {
+      continue;
+    }
+    if (value[var] == -sign) {
+      stats.unsat = true;
+      break;
+    }
+    value[var] = sign;
+    stats.units++;
+
+    // Clauses with the literal are satisfied
+    std::vector<int> &satisfied = occurs[LitIdx(lit)];
+    for (int i = 0; i < satisfied.size(); i++) {
+      if (!removed[satisfied[i]] && Contains(satisfied[i], lit)) {
+        removed[satisfied[i]] = true;
+      }
+    }
+    // Clauses with its negation lose a literal
+    std::vector<int> &shrunk = occurs[LitIdx(-lit)];
+    for (int i = 0; i < shrunk.size() && !stats.unsat; i++) {
+      if (!removed[shrunk[i]] && Contains(shrunk[i], -lit)) {
+        RemoveLit(shrunk[i], -lit);
+      }
+    }
+  }
+}
+
+// Find literals that imply each other through binary clauses (strongly
+// connected components of the implication graph) and replace each of them
+// with one representative. Representatives are projection variables
+// whenever possible so the projection survives
+void Simplifier::SubstituteEquivalences() {
+
+  int numLits = 2 * numVars + 2;
+  std::vector<std::vector<int> > implies(numLits);
+  for (int c = 0; c < clauses.size(); c++) {
+    if (!removed[c] && clauses[c].size() == 2) {
+      int a = clauses[c][0], b = clauses[c][1];
+      implies[LitIdx(-a)].push_back(b);
+      implies[LitIdx(-b)].push_back(a);
+    }
+  }
+
+  // Iterative Tarjan over literals
+  std::vector<int> index(numLits, -1), lowlink(numLits, 0);
+  std::vector<bool> onStack(numLits, false);
+  std::vector<int> sccStack;
+  std::vector<int> repLit(numLits, 0);
+  int nextIndex = 0;
+
+  for (int var = 1; var <= numVars; var++) {
+    for (int sign = 1; sign >= -1; sign -= 2) {
+      int start = sign * var;
+      if (index[LitIdx(start)] != -1 || implies[LitIdx(start)].empty()) {
+        continue;
+      }
+
+      // DFS stack of (literal, next edge to follow)
+      std::stack<std::pair<int, int> > dfs;
+      dfs.push(std::make_pair(start, 0));
+      index[LitIdx(start)] = lowlink[LitIdx(start)] = nextIndex++;
+      sccStack.push_back(start);
+      onStack[LitIdx(start)] = true;
+
+      while (!dfs.empty()) {
+        int lit = dfs.top().first;
+        int li = LitIdx(lit);
+        if (dfs.top().second < implies[li].size()) {
+          int next = implies[li][dfs.top().second++];
+          int ni = LitIdx(next);
+          if (index[ni] == -1) {
+            index[ni] = lowlink[ni] = nextIndex++;
+            sccStack.push_back(next);
+            onStack[ni] = true;
+            dfs.push(std::make_pair(next, 0));
+          } else if (onStack[ni]) {
+            lowlink[li] = std::min(lowlink[li], index[ni]);
+          }
+          continue;
+        }
+
+        dfs.pop();
+        if (!dfs.empty()) {
+          int parent = LitIdx(dfs.top().first);
+          lowlink[parent] = std::min(lowlink[parent], lowlink[li]);
+        }
+        if (lowlink[li] != index[li]) {
+          continue;
+        }
+
+        // Pop the component rooted at lit
+        std::vector<int> scc;
+        int member;
+        do {
+          member = sccStack.back();
+          sccStack.pop_back();
+          onStack[LitIdx(member)] = false;
+          scc.push_back(member);
+        } while (member != lit);
+
+        // The dual component was already handled
+        if (repLit[LitIdx(scc[0])] != 0 || scc.size() == 1) {
+          continue;
+        }
+        for (int i = 0; i < scc.size(); i++) {
+          mark[LitIdx(scc[i])] = 1;
+        }
+        bool contradiction = false;
+        for (int i = 0; i < scc.size(); i++) {
+          contradiction = contradiction || mark[LitIdx(-scc[i])];
+        }
+        for (int i = 0; i < scc.size(); i++) {
+          mark[LitIdx(scc[i])] = 0;
+        }
+        // A literal equivalent to its own negation
+        if (contradiction) {
+          stats.unsat = true;
+          return;
+        }
+
+        int rep = scc[0];
+        for (int i = 0; i < scc.size(); i++) {
+          bool better = isProjection[abs(scc[i])] != isProjection[abs(rep)]
+                            ? isProjection[abs(scc[i])]
+                            : abs(scc[i]) < abs(rep);
+          if (better) {
+            rep = scc[i];
+          }
+        }
+        for (int i = 0; i < scc.size(); i++) {
+          repLit[LitIdx(scc[i])] = rep;
+          repLit[LitIdx(-scc[i])] = -rep;
+        }
+      }
+    }
+  }
+
+  // Replace the variables that are not their component's representative
+  bool changed = false;
+  for (int var = 1; var <= numVars; var++) {
+    int rep = repLit[LitIdx(var)];
+    if (rep != 0 && rep != var) {
+      replacedBy[var] = rep;
+      stats.equivalences++;
+      changed = true;
+    }
+  }
+  if (!changed) {
+    return;
+  }
+
+  for (int c = 0; c < clauses.size(); c++) {
+    if (removed[c]) {
+      continue;
+    }
+    std::vector<int> clause;
+    bool replaced = false;
+    for (int i = 0; i < clauses[c].size(); i++) {
+      int lit = clauses[c][i];
+      int rep = replacedBy[abs(lit)];
+      if (rep != 0) {
+        lit = lit > 0 ? rep : -rep;
+        replaced = true;
+      }
+      clause.push_back(lit);
+    }
+    if (!replaced) {
+      continue;
+    }
+
+    std::sort(clause.begin(), clause.end(), LitLess);
+    clause.erase(std::unique(clause.begin(), clause.end()), clause.end());
+    bool tautology = false;
+    for (int i = 1; i < clause.size(); i++) {
+      if (clause[i] == -clause[i - 1]) {
+        tautology = true;
+      }
+    }
+    if (tautology) {
+      removed[c] = true;
+    } else {
+      clauses[c] = clause;
+      if (clause.size() == 1) {
+        units.push(clause[0]);
+      }
+    }
+  }
+}
+
+// Remove subsumed clauses and strengthen clauses by self-subsuming
+// resolution: if C = (l v R) and D = (-l v R v S), -l can be removed from D
+void Simplifier::Subsume() {
+
+  BuildOccurs();
+  std::vector<int> order;
+  for (int c = 0; c < clauses.size(); c++) {
+    if (!removed[c]) {
+      order.push_back(c);
+    }
+  }
+  std::stable_sort(order.begin(), order.end(), [this](int a, int b) {
+    return clauses[a].size() < clauses[b].size();
+  });
+
+  for (int o = 0; o < order.size() && !stats.unsat; o++) {
+    int c = order[o];
+    if (removed[c]) {
+      continue;
+    }
+    std::vector<int> clause = clauses[c];
+
+    // Subsumption: candidates share the clause's least occurring literal
+    int best = clause[0];
+    for (int i = 1; i < clause.size(); i++) {
+      if (occurs[LitIdx(clause[i])].size() < occurs[LitIdx(best)].size()) {
+        best = clause[i];
+      }
+    }
+    std::vector<int> &candidates = occurs[LitIdx(best)];
+    for (int i = 0; i < candidates.size(); i++) {
+      int d = candidates[i];
+      if (d == c || removed[d] || clauses[d].size() < clause.size()) {
+        continue;
+      }
+      for (int j = 0; j < clauses[d].size(); j++) {
+        mark[LitIdx(clauses[d][j])] = 1;
+      }
+      bool subset = true;
+      for (int j = 0; j < clause.size() && subset; j++) {
+        subset = mark[LitIdx(clause[j])];
+      }
+      for (int j = 0; j < clauses[d].size(); j++) {
+        mark[LitIdx(clauses[d][j])] = 0;
+      }
+      if (subset) {
+        removed[d] = true;
+        stats.subsumed++;
+      }
+    }
+
+    // Self-subsuming resolution on each literal of the clause
+    for (int k = 0; k < clause.size() && !stats.unsat; k++) {
+      std::vector<int> &strengthen = occurs[LitIdx(-clause[k])];
+      for (int i = 0; i < strengthen.size(); i++) {
+        int d = strengthen[i];
+        if (d == c || removed[d] || clauses[d].size() < clause.size() ||
+            !Contains(d, -clause[k])) {
+          continue;
+        }
+        for (int j = 0; j < clauses[d].size(); j++) {
+          mark[LitIdx(clauses[d][j])] = 1;
+        }
+        bool subset = true;
+        for (int j = 0; j < clause.size() && subset; j++) {
+          subset = j == k || mark[LitIdx(clause[j])];
+        }
+        for (int j = 0; j < clauses[d].size(); j++) {
+          mark[LitIdx(clauses[d][j])] = 0;
+        }
+        if (subset) {
+          RemoveLit(d, -clause[k]);
+          stats.strengthened++;
+        }
+      }
+    }
+  }
+}
+
+// Eliminate non-projection variables by resolution when that does not
+// add clauses (the formula becomes "exists x. F")
+void Simplifier::EliminateVariables() {
+
+  // Without a projection every variable may be an input bit
+  if (!hasProjection) {
+    return;
+  }
+  BuildOccurs();
+
+  // Try the cheapest variables first
+  std::vector<int> order;
+  for (int var = 1; var <= numVars; var++) {
+    if (!isProjection[var] && value[var] == 0 && replacedBy[var] == 0 &&
+        !eliminated[var]) {
+      order.push_back(var);
+    }
+  }
+  std::sort(order.begin(), order.end(), [this](int a, int b) {
+    return occurs[LitIdx(a)].size() + occurs[LitIdx(-a)].size() <
+           occurs[LitIdx(b)].size() + occurs[LitIdx(-b)].size();
+  });
+
+  for (int o = 0; o < order.size() && !stats.unsat; o++) {
+    int var = order[o];
+    std::vector<int> pos, neg;
+    std::vector<int> &posOcc = occurs[LitIdx(var)];
+    std::vector<int> &negOcc = occurs[LitIdx(-var)];
+    for (int i = 0; i < posOcc.size(); i++) {
+      if (!removed[posOcc[i]] && Contains(posOcc[i], var)) {
+        pos.push_back(posOcc[i]);
+      }
+    }
+    for (int i = 0; i < negOcc.size(); i++) {
+      if (!removed[negOcc[i]] && Contains(negOcc[i], -var)) {
+        neg.push_back(negOcc[i]);
+      }
+    }
+    // A variable in no clause is eliminated with no resolvents: it is
+    // not counted, so it does not double the count
+    if (pos.size() * neg.size() > MaxResolutions) {
+      continue;
+    }
+
+    // Collect the non-tautological resolvents, giving up as soon as
+    // there are more of them than the clauses they replace
+    std::vector<std::vector<int> > resolvents;
+    bool bounded = true;
+    for (int i = 0; i < pos.size() && bounded; i++) {
+      for (int j = 0; j < neg.size() && bounded; j++) {
+        std::vector<int> resolvent;
+        bool tautology = false;
+        for (int k = 0; k < clauses[pos[i]].size(); k++) {
+          int lit = clauses[pos[i]][k];
+          if (lit != var) {
+            mark[LitIdx(lit)] = 1;
+            resolvent.push_back(lit);
+          }
+        }
+        for (int k = 0; k < clauses[neg[j]].size(); k++) {
+          int lit = clauses[neg[j]][k];
+          if (lit == -var || mark[LitIdx(lit)]) {
+            continue;
+          }
+          if (mark[LitIdx(-lit)]) {
+            tautology = true;
+          }
+          resolvent.push_back(lit);
+        }
+        for (int k = 0; k < clauses[pos[i]].size(); k++) {
+          mark[LitIdx(clauses[pos[i]][k])] = 0;
+        }
+        if (tautology) {
+          continue;
+        }
+        resolvents.push_back(resolvent);
+        bounded = resolvents.size() <= pos.size() + neg.size() &&
+                  resolvent.size() <= MaxResolventLength;
+      }
+    }
+    if (!bounded) {
+      continue;
+    }
+
+    for (int i = 0; i < pos.size(); i++) {
+      removed[pos[i]] = true;
+    }
+    for (int i = 0; i < neg.size(); i++) {
+      removed[neg[i]] = true;
+    }
+    for (int i = 0; i < resolvents.size(); i++) {
+      AddClause(resolvents[i]);
+    }
+    eliminated[var] = true;
+    stats.eliminated++;
+  }
+}
+
+// Write the simplified formula back with the remaining
+// variables numbered 1..n
+void Simplifier::Write(CNF *cnf) {
+
+  cnf->clauses.clear();
+  std::vector<int> projection;
+  if (stats.unsat) {
+    cnf->numVars = 1;
+    cnf->clauses.push_back(std::vector<int>(1, 1));
+    cnf->clauses.push_back(std::vector<int>(1, -1));
+    if (hasProjection) {
+      projection.push_back(1);
+    }
+  } else {
+    std::vector<int> newVar(numVars + 1, 0);
+    int ct = 0;
+    for (int var = 1; var <= numVars; var++) {
+      if (value[var] == 0 && replacedBy[var] == 0 && !eliminated[var]) {
+        newVar[var] = ++ct;
+        if (isProjection[var]) {
+          projection.push_back(ct);
+        }
+      }
+    }
+    for (int c = 0; c < clauses.size(); c++) {
+      if (removed[c]) {
+        continue;
+      }
+      std::vector<int> clause;
+      for (int i = 0; i < clauses[c].size(); i++) {
+        int lit = clauses[c][i];
+        clause.push_back(lit > 0 ? newVar[lit] : -newVar[-lit]);
+      }
+      cnf->clauses.push_back(clause);
+    }
+    // With every input bit fixed there is one assignment of the projection
+    // left (if the rest is satisfiable). A variable fixed by a unit clause
+    // stands for it, since an empty projection would count every
+    // assignment of the other variables
+    if (hasProjection && projection.empty()) {
+      projection.push_back(++ct);
+      cnf->clauses.push_back(std::vector<int>(1, ct));
+    }
+    cnf->numVars = ct;
+  }
+  cnf->hasProjection = hasProjection;
+  cnf->projection = projection;
+  // Input bits can be fixed or substituted, so they are no longer known
+  cnf->inputs.clear();
+
+  stats.varsAfter = cnf->numVars;
+  stats.clausesAfter = cnf->clauses.size();
+}
+
+} // namespace
+
+PreprocessStats Preprocess(CNF *cnf) {
+
+  Simplifier simplifier(*cnf);
+
+  // Repeat until nothing changes, each step can enable the others
+  int lastChanges = -1;
+  while (!simplifier.stats.unsat) {
+    PreprocessStats &stats = simplifier.stats;
+    int changes = stats.units + stats.equivalences + stats.subsumed +
+                  stats.strengthened + stats.eliminated;
+    if (changes == lastChanges) {
+      break;
+    }
+    lastChanges = changes;
+
+    simplifier.Propagate();
+    if (!stats.unsat) {
+      simplifier.SubstituteEquivalences();
+    }
+    if (!stats.unsat) {
+      simplifier.Propagate();
+    }
+    if (!stats.unsat) {
+      simplifier.Subsume();
+    }
+    if (!stats.unsat) {
+      simplifier.Propagate();
+    }
+    if (!stats.unsat) {
+      simplifier.EliminateVariables();
+    }
+  }
+
+  simplifier.Write(cnf);
+  return simplifier.stats;
+}
@@ -0,0 +1,43 @@
+// Preprocess.h
+// Simplifications of a path's CNF that preserve its model count
+
+#ifndef CFCOUNT_PREPROCESS_H
+#define CFCOUNT_PREPROCESS_H
+
+#include "CNF.h"
+
+// What the preprocessor did to a formula
+struct PreprocessStats {
+  int varsBefore;
+  int clausesBefore;
+  int varsAfter;
+  int clausesAfter;
+  // Variables fixed by unit propagation
+  int units;
+  // Variables replaced by an equivalent literal
+  int equivalences;
+  // Clauses removed because another clause subsumes them
+  int subsumed;
+  // Literals removed by self-subsuming resolution
+  int strengthened;
+  // Non-projection variables removed by bounded variable elimination
+  int eliminated;
+  // If the formula has no models
+  bool unsat;
+};
+
+// Simplify a formula in place, renumbering the remaining variables.
+//
+// Unit propagation, equivalent literal substitution and subsumption keep
+// the number of models of the formula. Bounded variable elimination is
+// only applied to variables outside the projection (when there is one)
+// and keeps the number of models over the projection. Since every other
+// variable of a path's CNF is defined by the input bits (Tseitin
+// encoding), both counts are the same. With a projection, variables
+// outside it that occur in no clause are dropped, and if every projection
+// variable is fixed a new variable fixed by a unit clause is the projection.
+//
+// An unsatisfiable formula is replaced by (x1) and (-x1)
+PreprocessStats Preprocess(CNF *cnf);
+
+#endif
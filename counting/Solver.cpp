@@ -0,0 +1,483 @@
+// Solver.cpp
+// Small incremental CDCL SAT solver used by the counting tools
+
+#include "Solver.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+// Value of a literal (0 false, 1 true, 2 unassigned)
+static const int Unassigned = 2;
+
+// Luby sequence (1 1 2 1 1 2 4 ...) for the restart intervals
+static double Luby(int i) {
+  int size = 1, seq = 0;
+  while (size < i + 1) {
+    seq++;
+    size = 2 * size + 1;
+  }
+  while (size - 1 != i) {
+    size = (size - 1) >> 1;
+    seq--;
+    i = i % size;
+  }
+  double result = 1;
+  for (int k = 0; k < seq; k++) {
+    result *= 2;
+  }
+  return result;
+}
+
+Solver::Solver(const CNF &cnf)
+    : qhead(0), ok(true), varInc(1), clauseInc(1), numLearnts(0) {
+  for (int var = 0; var < cnf.numVars; var++) {
+    NewVar();
+  }
+  for (int c = 0; c < cnf.clauses.size(); c++) {
+    AddClause(cnf.clauses[c]);
+  }
+  maxLearnts = std::max(5000, (int)clauses.size() / 3);
+}
+
+int Solver::NewVar() {
+  int var = value.size();
+  value.push_back(Unassigned);
+  level.push_back(0);
+  reason.push_back(-1);
+  activity.push_back(0);
+  polarity.push_back(false);
+  seen.push_back(0);
+  heapPos.push_back(-1);
+  watches.push_back(std::vector<int>());
+  watches.push_back(std::vector<int>());
+  HeapInsert(var);
+  return var + 1;
+}
+
+bool Solver::AddClause(const std::vector<int> &dimacs) {
+  if (!ok) {
+    return false;
+  }
+  CancelUntil(0);
+
+  std::vector<int> lits;
+  for (int i = 0; i < dimacs.size(); i++) {
+    while (abs(dimacs[i]) > NumVars()) {
+      NewVar();
+    }
+    lits.push_back(2 * (abs(dimacs[i]) - 1) + (dimacs[i] < 0));
+  }
+  std::sort(lits.begin(), lits.end());
+  lits.erase(std::unique(lits.begin(), lits.end()), lits.end());
+
+  // Drop false literals, skip satisfied clauses and tautologies
+  std::vector<int> kept;
+  for (int i = 0; i < lits.size(); i++) {
+    if (LitValue(lits[i]) == 1 ||
+        (i > 0 && lits[i] == (lits[i - 1] ^ 1))) {
+      return true;
+    }
+    if (LitValue(lits[i]) == Unassigned) {
+      kept.push_back(lits[i]);
+    }
+  }
+
+  if (kept.empty()) {
+    ok = false;
+  } else if (kept.size() == 1) {
+    Enqueue(kept[0], -1);
+    ok = Propagate() == -1;
+  } else {
+    Clause clause;
+    clause.lits = kept;
+    clause.learnt = false;
+    clause.deleted = false;
+    clause.activity = 0;
+    clauses.push_back(clause);
+    AttachClause(clauses.size() - 1);
+  }
+  return ok;
+}
+
+bool Solver::AddXor(const std::vector<int> &xorVars, bool parity,
+                    int activation) {
+
+  // x ^ x = 0, so variables appearing twice cancel out
+  std::vector<int> vars(xorVars);
+  std::sort(vars.begin(), vars.end());
+  std::vector<int> unique;
+  for (int i = 0; i < vars.size(); i++) {
+    if (i + 1 < vars.size() && vars[i] == vars[i + 1]) {
+      i++;
+    } else {
+      unique.push_back(vars[i]);
+    }
+  }
+  vars = unique;
+
+  // Cut into XORs of at most 4 variables: x1 ^ x2 ^ x3 = t, t ^ rest
+  while (vars.size() > 4) {
+    int link = NewVar();
+    std::vector<int> chunk(vars.begin(), vars.begin() + 3);
+    chunk.push_back(link);
+    AddXor(chunk, false, activation);
+    std::vector<int> rest(1, link);
+    rest.insert(rest.end(), vars.begin() + 3, vars.end());
+    vars = rest;
+  }
+
+  // Forbid every assignment with the wrong parity
+  for (int assignment = 0; assignment < (1 << vars.size()); assignment++) {
+    bool odd = false;
+    for (int i = 0; i < vars.size(); i++) {
+      odd ^= (assignment >> i) & 1;
+    }
+    if (odd == parity) {
+      continue;
+    }
+    std::vector<int> clause;
+    for (int i = 0; i < vars.size(); i++) {
+      clause.push_back((assignment >> i) & 1 ? -vars[i] : vars[i]);
+    }
+    if (activation != 0) {
+      clause.push_back(-activation);
+    }
+    if (!AddClause(clause)) {
+      return false;
+    }
+  }
+  return ok;
+}
+
+bool Solver::Solve(const std::vector<int> &assumptions) {
+  model.clear();
+  if (!ok) {
+    return false;
+  }
+  CancelUntil(0);
+
+  int restarts = 0;
+  int conflictsLeft = 100 * Luby(restarts);
+
+  while (true) {
+    int conflict = Propagate();
+    if (conflict != -1) {
+      if (DecisionLevel() == 0) {
+        ok = false;
+        return false;
+      }
+
+      std::vector<int> learnt;
+      int backtrackLevel;
+      Analyze(conflict, &learnt, &backtrackLevel);
+      CancelUntil(backtrackLevel);
+      if (learnt.size() == 1) {
+        Enqueue(learnt[0], -1);
+      } else {
+        Clause clause;
+        clause.lits = learnt;
+        clause.learnt = true;
+        clause.deleted = false;
+        clause.activity = 0;
+        clauses.push_back(clause);
+        AttachClause(clauses.size() - 1);
+        BumpClause(clauses.size() - 1);
+        Enqueue(learnt[0], clauses.size() - 1);
+        numLearnts++;
+      }
+      varInc /= 0.95;
+      clauseInc /= 0.999;
+
+      if (--conflictsLeft <= 0) {
+        restarts++;
+        conflictsLeft = 100 * Luby(restarts);
+        CancelUntil(0);
+      }
+      continue;
+    }
+
+    if (numLearnts >= maxLearnts + (int)trail.size()) {
+      ReduceLearnts();
+    }
+
+    // Decide the assumptions first, one level each
+    int next = -1;
+    while (DecisionLevel() < assumptions.size()) {
+      int a = assumptions[DecisionLevel()];
+      int lit = 2 * (abs(a) - 1) + (a < 0);
+      if (LitValue(lit) == 1) {
+        trailLim.push_back(trail.size());
+      } else if (LitValue(lit) == 0) {
+        CancelUntil(0);
+        return false;
+      } else {
+        next = lit;
+        break;
+      }
+    }
+
+    if (next == -1) {
+      next = PickBranchLit();
+      if (next == -1) {
+        model.resize(value.size());
+        for (int var = 0; var < value.size(); var++) {
+          model[var] = value[var] == 1;
+        }
+        CancelUntil(0);
+        return true;
+      }
+    }
+    trailLim.push_back(trail.size());
+    Enqueue(next, -1);
+  }
+}
+
+int Solver::LitValue(int lit) const {
+  uint8_t val = value[lit >> 1];
+  if (val == Unassigned) {
+    return Unassigned;
+  }
+  return val ^ (lit & 1);
+}
+
+void Solver::Enqueue(int lit, int from) {
+  int var = lit >> 1;
+  value[var] = (lit & 1) ? 0 : 1;
+  level[var] = DecisionLevel();
+  reason[var] = from;
+  trail.push_back(lit);
+}
+
+// Watch the first two literals of a clause
+void Solver::AttachClause(int c) {
+  watches[clauses[c].lits[0]].push_back(c);
+  watches[clauses[c].lits[1]].push_back(c);
+}
+
+// Propagate the assignments on the trail. Returns the conflicting
+// clause or -1
+int Solver::Propagate() {
+  while (qhead < trail.size()) {
+    int falseLit = trail[qhead++] ^ 1;
+    std::vector<int> &ws = watches[falseLit];
+    int i = 0, j = 0;
+    while (i < ws.size()) {
+      int c = ws[i++];
+      Clause &clause = clauses[c];
+      if (clause.deleted) {
+        continue;
+      }
+      std::vector<int> &lits = clause.lits;
+      if (lits[0] == falseLit) {
+        std::swap(lits[0], lits[1]);
+      }
+      if (LitValue(lits[0]) == 1) {
+        ws[j++] = c;
+        continue;
+      }
+
+      // Look for a new literal to watch
+      bool found = false;
+      for (int k = 2; k < lits.size(); k++) {
+        if (LitValue(lits[k]) != 0) {
+          std::swap(lits[1], lits[k]);
+          watches[lits[1]].push_back(c);
+          found = true;
+          break;
+        }
+      }
+      if (found) {
+        continue;
+      }
+
+      ws[j++] = c;
+      if (LitValue(lits[0]) == 0) {
+        while (i < ws.size()) {
+          ws[j++] = ws[i++];
+        }
+        ws.resize(j);
+        qhead = trail.size();
+        return c;
+      }
+      Enqueue(lits[0], c);
+    }
+    ws.resize(j);
+  }
+  return -1;
+}
+
+// Derive the first UIP clause of a conflict
+void Solver::Analyze(int conflict, std::vector<int> *learnt,
+                     int *backtrackLevel) {
+  int pathCt = 0;
+  int p = -1;
+  int index = trail.size() - 1;
+  learnt->push_back(-1);
+
+  do {
+    Clause &clause = clauses[conflict];
+    if (clause.learnt) {
+      BumpClause(conflict);
+    }
+    for (int j = (p == -1 ? 0 : 1); j < clause.lits.size(); j++) {
+      int q = clause.lits[j];
+      int var = q >> 1;
+      if (!seen[var] && level[var] > 0) {
+        BumpVar(var);
+        seen[var] = 1;
+        if (level[var] >= DecisionLevel()) {
+          pathCt++;
+        } else {
+          learnt->push_back(q);
+        }
+      }
+    }
+    while (!seen[trail[index--] >> 1]) {
+    }
+    p = trail[index + 1];
+    conflict = reason[p >> 1];
+    seen[p >> 1] = 0;
+    pathCt--;
+  } while (pathCt > 0);
+  (*learnt)[0] = p ^ 1;
+
+  // Backtrack to the second highest level in the clause, and
+  // watch a literal of that level
+  *backtrackLevel = 0;
+  int maxIdx = 1;
+  for (int i = 1; i < learnt->size(); i++) {
+    seen[(*learnt)[i] >> 1] = 0;
+    if (level[(*learnt)[i] >> 1] > *backtrackLevel) {
+      *backtrackLevel = level[(*learnt)[i] >> 1];
+      maxIdx = i;
+    }
+  }
+  if (learnt->size() > 1) {
+    std::swap((*learnt)[1], (*learnt)[maxIdx]);
+  }
+}
+
+void Solver::CancelUntil(int lvl) {
+  if (DecisionLevel() <= lvl) {
+    return;
+  }
+  for (int i = trail.size() - 1; i >= trailLim[lvl]; i--) {
+    int var = trail[i] >> 1;
+    polarity[var] = value[var] == 1;
+    value[var] = Unassigned;
+    reason[var] = -1;
+    if (heapPos[var] == -1) {
+      HeapInsert(var);
+    }
+  }
+  trail.resize(trailLim[lvl]);
+  trailLim.resize(lvl);
+  qhead = trail.size();
+}
+
+int Solver::PickBranchLit() {
+  while (!heap.empty()) {
+    int var = HeapPop();
+    if (value[var] == Unassigned) {
+      return 2 * var + (polarity[var] ? 0 : 1);
+    }
+  }
+  return -1;
+}
+
+// Delete the less active half of the learnt clauses that
+// are not the reason of an assignment
+void Solver::ReduceLearnts() {
+  std::vector<int> candidates;
+  for (int c = 0; c < clauses.size(); c++) {
+    Clause &clause = clauses[c];
+    if (!clause.learnt || clause.deleted || clause.lits.size() <= 2) {
+      continue;
+    }
+    int var = clause.lits[0] >> 1;
+    if (reason[var] == c && LitValue(clause.lits[0]) == 1) {
+      continue;
+    }
+    candidates.push_back(c);
+  }
+  std::sort(candidates.begin(), candidates.end(), [this](int a, int b) {
+    return clauses[a].activity < clauses[b].activity;
+  });
+  for (int i = 0; i < candidates.size() / 2; i++) {
+    clauses[candidates[i]].deleted = true;
+    clauses[candidates[i]].lits.clear();
+    numLearnts--;
+  }
+  maxLearnts = maxLearnts * 11 / 10;
+}
+
+void Solver::BumpVar(int var) {
+  activity[var] += varInc;
+  if (activity[var] > 1e100) {
+    for (int v = 0; v < activity.size(); v++) {
+      activity[v] *= 1e-100;
+    }
+    varInc *= 1e-100;
+  }
+  if (heapPos[var] != -1) {
+    HeapUp(heapPos[var]);
+  }
+}
+
+void Solver::BumpClause(int c) {
+  clauses[c].activity += clauseInc;
+  if (clauses[c].activity > 1e20) {
+    for (int i = 0; i < clauses.size(); i++) {
+      clauses[i].activity *= 1e-20;
+    }
+    clauseInc *= 1e-20;
+  }
+}
+
+void Solver::HeapUp(int pos) {
+  int var = heap[pos];
+  while (pos > 0 && activity[heap[(pos - 1) / 2]] < activity[var]) {
+    heap[pos] = heap[(pos - 1) / 2];
+    heapPos[heap[pos]] = pos;
+    pos = (pos - 1) / 2;
+  }
+  heap[pos] = var;
+  heapPos[var] = pos;
+}
+
+void Solver::HeapDown(int pos) {
+  int var = heap[pos];
+  while (2 * pos + 1 < heap.size()) {
+    int child = 2 * pos + 1;
+    if (child + 1 < heap.size() &&
+        activity[heap[child + 1]] > activity[heap[child]]) {
+      child++;
+    }
+    if (activity[heap[child]] <= activity[var]) {
+      break;
+    }
+    heap[pos] = heap[child];
+    heapPos[heap[pos]] = pos;
+    pos = child;
+  }
+  heap[pos] = var;
+  heapPos[var] = pos;
+}
+
+void Solver::HeapInsert(int var) {
+  heap.push_back(var);
+  heapPos[var] = heap.size() - 1;
+  HeapUp(heap.size() - 1);
+}
+
+int Solver::HeapPop() {
+  int var = heap[0];
+  heapPos[var] = -1;
+  heap[0] = heap.back();
+  heap.pop_back();
+  if (!heap.empty()) {
+    heapPos[heap[0]] = 0;
+    HeapDown(0);
+  }
+  return var;
+}
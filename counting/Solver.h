@@ -0,0 +1,85 @@
+// Solver.h
+// Small incremental CDCL SAT solver used by the counting tools
+// (two watched literals, VSIDS, 1UIP learning, restarts)
+
+#ifndef CFCOUNT_SOLVER_H
+#define CFCOUNT_SOLVER_H
+
+#include "CNF.h"
+
+#include <cstdint>
+#include <vector>
+
+class Solver {
+public:
+  // Create a solver with the variables and clauses of a formula
+  Solver(const CNF &cnf);
+
+  // Add a variable, returns its (DIMACS) number
+  int NewVar();
+  int NumVars() const { return value.size(); }
+
+  // Add a clause of DIMACS literals. Returns false if the
+  // formula became unsatisfiable
+  bool AddClause(const std::vector<int> &lits);
+  // Add the constraint that the XOR of the variables equals parity.
+  // Long XORs are cut into chunks linked by new variables. With an
+  // activation variable the XOR only holds when it is true
+  bool AddXor(const std::vector<int> &vars, bool parity, int activation = 0);
+
+  // Search for a model that satisfies the assumptions (DIMACS literals)
+  bool Solve(const std::vector<int> &assumptions = std::vector<int>());
+  // Value of a variable in the last model found
+  bool ModelValue(int var) const { return model[var - 1]; }
+
+private:
+  struct Clause {
+    std::vector<int> lits;
+    bool learnt;
+    bool deleted;
+    double activity;
+  };
+
+  // Literals are 2 * var + sign, variables are 0 based
+  std::vector<Clause> clauses;
+  std::vector<std::vector<int> > watches;
+  // Value of each variable (0 false, 1 true, 2 unassigned)
+  std::vector<uint8_t> value;
+  std::vector<int> level;
+  std::vector<int> reason;
+  std::vector<int> trail;
+  std::vector<int> trailLim;
+  int qhead;
+  bool ok;
+
+  // VSIDS order: binary heap of variables by activity
+  std::vector<double> activity;
+  std::vector<int> heap;
+  std::vector<int> heapPos;
+  double varInc;
+  double clauseInc;
+  std::vector<bool> polarity;
+  std::vector<char> seen;
+  int numLearnts;
+  int maxLearnts;
+
+  std::vector<bool> model;
+
+  int LitValue(int lit) const;
+  int DecisionLevel() const { return trailLim.size(); }
+  void Enqueue(int lit, int from);
+  int Propagate();
+  void Analyze(int conflict, std::vector<int> *learnt, int *backtrackLevel);
+  void CancelUntil(int lvl);
+  int PickBranchLit();
+  void AttachClause(int c);
+  void ReduceLearnts();
+  void BumpVar(int var);
+  void BumpClause(int c);
+  void HeapUp(int pos);
+  void HeapDown(int pos);
+  void HeapInsert(int var);
+  int HeapPop();
+};
+
+#endif
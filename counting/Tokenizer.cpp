@@ -0,0 +1,169 @@
+// Tokenizer.cpp
+// Scans for delimiters, vectorized where the CPU allows
+
+#include "Tokenizer.h"
+
+#include <cstdint>
+#include <cstdlib>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define CFCOUNT_X86_SCAN 1
+#include <immintrin.h>
+#endif
+
+// Whitespace as isspace has it in the C locale: ' ' and \t \n \v \f \r
+static inline bool IsSpace(unsigned char c) {
+  return c == ' ' || (unsigned char)(c - '\t') <= '\r' - '\t';
+}
+
+static inline bool IsDelimiter(unsigned char c, bool parens) {
+  return IsSpace(c) || (parens && (c == '(' || c == ')'));
+}
+
+static const char *FindDelimiterScalar(const char *p, const char *end,
+                                       bool parens) {
+  while (p < end && !IsDelimiter(*p, parens)) {
+    p++;
+  }
+  return p;
+}
+
+static const char *SkipSpaceScalar(const char *p, const char *end) {
+  while (p < end && IsSpace(*p)) {
+    p++;
+  }
+  return p;
+}
+
+#ifdef CFCOUNT_X86_SCAN
+
+// One bit per byte of the 16 at p: set for whitespace (and parentheses)
+static inline uint32_t DelimiterMaskSSE2(const char *p, bool parens) {
+  __m128i bytes = _mm_loadu_si128((const __m128i *)p);
+  __m128i control = _mm_sub_epi8(bytes, _mm_set1_epi8('\t'));
+  __m128i mask = _mm_or_si128(
+      _mm_cmpeq_epi8(bytes, _mm_set1_epi8(' ')),
+      _mm_cmpeq_epi8(_mm_min_epu8(control, _mm_set1_epi8('\r' - '\t')),
+                     control));
+  if (parens) {
+    mask = _mm_or_si128(mask, _mm_cmpeq_epi8(bytes, _mm_set1_epi8('(')));
+    mask = _mm_or_si128(mask, _mm_cmpeq_epi8(bytes, _mm_set1_epi8(')')));
+  }
+  return _mm_movemask_epi8(mask);
+}
+
+static const char *FindDelimiterSSE2(const char *p, const char *end,
+                                     bool parens) {
+  for (; end - p >= 16; p += 16) {
+    uint32_t mask = DelimiterMaskSSE2(p, parens);
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+  }
+  return FindDelimiterScalar(p, end, parens);
+}
+
+static const char *SkipSpaceSSE2(const char *p, const char *end) {
+  for (; end - p >= 16; p += 16) {
+    uint32_t mask = ~DelimiterMaskSSE2(p, false) & 0xffff;
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+  }
+  return SkipSpaceScalar(p, end);
+}
+
+__attribute__((target("avx2"))) static inline uint32_t
+DelimiterMaskAVX2(const char *p, bool parens) {
+  __m256i bytes = _mm256_loadu_si256((const __m256i *)p);
+  __m256i control = _mm256_sub_epi8(bytes, _mm256_set1_epi8('\t'));
+  __m256i mask = _mm256_or_si256(
+      _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' ')),
+      _mm256_cmpeq_epi8(_mm256_min_epu8(control, _mm256_set1_epi8('\r' - '\t')),
+                        control));
+  if (parens) {
+    mask = _mm256_or_si256(mask,
+                           _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('(')));
+    mask = _mm256_or_si256(mask,
+                           _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(')')));
+  }
+  return _mm256_movemask_epi8(mask);
+}
+
+// 64 bytes per step while far from a delimiter (long names), 32 at the end
+__attribute__((target("avx2"))) static const char *
+FindDelimiterAVX2(const char *p, const char *end, bool parens) {
+  for (; end - p >= 64; p += 64) {
+    uint64_t mask = DelimiterMaskAVX2(p, parens) |
+                    (uint64_t)DelimiterMaskAVX2(p + 32, parens) << 32;
+    if (mask != 0) {
+      return p + __builtin_ctzll(mask);
+    }
+  }
+  for (; end - p >= 32; p += 32) {
+    uint32_t mask = DelimiterMaskAVX2(p, parens);
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+  }
+  return FindDelimiterScalar(p, end, parens);
+}
+
+__attribute__((target("avx2"))) static const char *
+SkipSpaceAVX2(const char *p, const char *end) {
+  for (; end - p >= 32; p += 32) {
+    uint32_t mask = ~DelimiterMaskAVX2(p, false);
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+  }
+  return SkipSpaceScalar(p, end);
+}
+
+#endif
+
+namespace {
+
+// The scan picked for this CPU, once
+struct Scan {
+  const char *name;
+  const char *(*findDelimiter)(const char *, const char *, bool);
+  const char *(*skipSpace)(const char *, const char *);
+
+  Scan()
+      : name("scalar"), findDelimiter(FindDelimiterScalar),
+        skipSpace(SkipSpaceScalar) {
+    const char *noSimd = getenv("CFCOUNT_NO_SIMD");
+    if (noSimd != nullptr && *noSimd != '\0' && *noSimd != '0') {
+      return;
+    }
+#ifdef CFCOUNT_X86_SCAN
+    if (__builtin_cpu_supports("avx2")) {
+      name = "avx2";
+      findDelimiter = FindDelimiterAVX2;
+      skipSpace = SkipSpaceAVX2;
+    } else {
+      name = "sse2";
+      findDelimiter = FindDelimiterSSE2;
+      skipSpace = SkipSpaceSSE2;
+    }
+#endif
+  }
+};
+
+const Scan &GetScan() {
+  static const Scan scan;
+  return scan;
+}
+
+}
+
+const char *FindDelimiter(const char *p, const char *end, bool parens) {
+  return GetScan().findDelimiter(p, end, parens);
+}
+
+const char *SkipSpace(const char *p, const char *end) {
+  return GetScan().skipSpace(p, end);
+}
+
+const char *TokenizerScan() { return GetScan().name; }
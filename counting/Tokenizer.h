@@ -0,0 +1,55 @@
+// Tokenizer.h
+// Splits text traces and Z3 goals into tokens. The delimiters
+// (whitespace, and parentheses in goals) are found 32 or 64 bytes at a
+// time with AVX2, 16 with SSE2, or byte by byte otherwise; the widest the
+// CPU has is picked at run time (CFCOUNT_NO_SIMD=1 forces the scalar scan)
+
+#ifndef CFCOUNT_TOKENIZER_H
+#define CFCOUNT_TOKENIZER_H
+
+#include <cstddef>
+
+// First byte of [p, end) that is whitespace (or a parenthesis, with
+// parens), or end if there is none
+const char *FindDelimiter(const char *p, const char *end, bool parens);
+
+// First byte of [p, end) that is not whitespace, or end
+const char *SkipSpace(const char *p, const char *end);
+
+// Name of the scan in use: "avx2", "sse2" or "scalar"
+const char *TokenizerScan();
+
+// Tokens of a buffer (usually a mapped file): runs of bytes between
+// whitespace and, with parens, each parenthesis on its own
+class Tokenizer {
+public:
+  Tokenizer(const char *begin, const char *end, bool parens)
+      : p(begin), end(end), parens(parens) {}
+
+  // Next token, false at the end of the buffer
+  bool Next(const char **token, size_t *size) {
+    p = SkipSpace(p, end);
+    if (p == end) {
+      return false;
+    }
+    const char *start = p;
+    if (parens && (*p == '(' || *p == ')')) {
+      p++;
+    } else {
+      p = FindDelimiter(p, end, parens);
+    }
+    *token = start;
+    *size = p - start;
+    return true;
+  }
+
+  // Where the next token is looked for
+  const char *Position() const { return p; }
+
+private:
+  const char *p;
+  const char *end;
+  bool parens;
+};
+
+#endif
@@ -0,0 +1,200 @@
+// WorkQueue.cpp
+// Queue of cubes in a directory shared by the driver and the workers
+
+#include "WorkQueue.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+// Names of the files in a directory
+static std::vector<std::string> ListDir(const std::string &path) {
+  std::vector<std::string> names;
+  DIR *d = opendir(path.c_str());
+  if (d == NULL) {
+    return names;
+  }
+  while (struct dirent *entry = readdir(d)) {
+    std::string name = entry->d_name;
+    if (name != "." && name != "..") {
+      names.push_back(name);
+    }
+  }
+  closedir(d);
+  return names;
+}
+
+static bool ReadFile(const std::string &path, std::string *contents) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    return false;
+  }
+  std::stringstream ss;
+  ss << file.rdbuf();
+  *contents = ss.str();
+  return true;
+}
+
+static void ClearDir(const std::string &path) {
+  std::vector<std::string> names = ListDir(path);
+  for (int i = 0; i < names.size(); i++) {
+    unlink((path + "/" + names[i]).c_str());
+  }
+}
+
+bool WorkQueue::WriteFile(const std::string &path,
+                          const std::string &contents) {
+  char host[256] = "";
+  gethostname(host, sizeof(host) - 1);
+  static std::atomic<unsigned> written(0);
+  std::string tmp = dir + "/tmp/" + host + "." + std::to_string(getpid()) +
+                    "." + std::to_string(written++);
+  std::ofstream file(tmp);
+  file << contents;
+  file.close();
+  if (!file || rename(tmp.c_str(), path.c_str()) != 0) {
+    unlink(tmp.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool WorkQueue::Create(const CNF &cnf) {
+  mkdir(dir.c_str(), 0777);
+  unlink((dir + "/formula.cnf").c_str());
+  const char *subdirs[] = {"tmp", "todo", "claimed", "done"};
+  for (int i = 0; i < 4; i++) {
+    std::string path = dir + "/" + subdirs[i];
+    mkdir(path.c_str(), 0777);
+    ClearDir(path);
+  }
+  unlink((dir + "/finished").c_str());
+
+  std::string tmp = dir + "/tmp/formula.cnf";
+  return WriteDIMACS(tmp, cnf) &&
+         rename(tmp.c_str(), (dir + "/formula.cnf").c_str()) == 0;
+}
+
+bool WorkQueue::Push(const std::string &id, const std::vector<int> &cube) {
+  std::string contents;
+  for (int i = 0; i < cube.size(); i++) {
+    contents += std::to_string(cube[i]) + " ";
+  }
+  return WriteFile(dir + "/todo/" + id, contents + "\n");
+}
+
+void WorkQueue::ReadResults(std::map<std::string, std::string> *results) {
+  std::vector<std::string> names = ListDir(dir + "/done");
+  for (int i = 0; i < names.size(); i++) {
+    std::string result;
+    // A cube counted twice (after its worker was thought lost) keeps
+    // its first result
+    if (results->find(names[i]) == results->end() &&
+        ReadFile(dir + "/done/" + names[i], &result)) {
+      (*results)[names[i]] = result.substr(0, result.find("\n"));
+    }
+  }
+}
+
+int WorkQueue::RequeueStale(unsigned lease,
+                            const std::map<std::string, std::string> &results) {
+  int requeued = 0;
+  std::vector<std::string> names = ListDir(dir + "/claimed");
+  time_t now = time(NULL);
+  for (int i = 0; i < names.size(); i++) {
+    std::string path = dir + "/claimed/" + names[i];
+    struct stat st;
+    if (results.find(names[i]) != results.end() ||
+        stat(path.c_str(), &st) != 0 || now - st.st_mtime < (time_t)lease) {
+      continue;
+    }
+    if (rename(path.c_str(), (dir + "/todo/" + names[i]).c_str()) == 0) {
+      requeued++;
+    }
+  }
+  return requeued;
+}
+
+void WorkQueue::Finish() { WriteFile(dir + "/finished", "\n"); }
+
+void WorkQueue::Remove() {
+  const char *subdirs[] = {"tmp", "todo", "claimed", "done"};
+  for (int i = 0; i < 4; i++) {
+    std::string path = dir + "/" + subdirs[i];
+    ClearDir(path);
+    rmdir(path.c_str());
+  }
+  unlink((dir + "/formula.cnf").c_str());
+  unlink((dir + "/finished").c_str());
+  rmdir(dir.c_str());
+}
+
+bool WorkQueue::LoadFormula(CNF *cnf) {
+  while (!Finished()) {
+    if (ReadDIMACS(dir + "/formula.cnf", cnf)) {
+      return true;
+    }
+    usleep(100000);
+  }
+  return false;
+}
+
+bool WorkQueue::Claim(std::string *id, std::vector<int> *cube) {
+  std::vector<std::string> names = ListDir(dir + "/todo");
+  if (names.empty()) {
+    return false;
+  }
+  // Start at a random cube so workers rarely race for the same one
+  int start = rand() % names.size();
+  for (int i = 0; i < names.size(); i++) {
+    const std::string &name = names[(start + i) % names.size()];
+    std::string path = dir + "/claimed/" + name;
+    if (rename((dir + "/todo/" + name).c_str(), path.c_str()) != 0) {
+      continue;
+    }
+    std::string contents;
+    if (!ReadFile(path, &contents)) {
+      continue;
+    }
+    // Touch it: the driver's lease starts now
+    utime(path.c_str(), NULL);
+    std::istringstream ss(contents);
+    int lit;
+    cube->clear();
+    while (ss >> lit) {
+      cube->push_back(lit);
+    }
+    *id = name;
+    std::lock_guard<std::mutex> lock(claimedMutex);
+    claimed.insert(name);
+    return true;
+  }
+  return false;
+}
+
+void WorkQueue::Complete(const std::string &id, const std::string &result) {
+  WriteFile(dir + "/done/" + id, result + "\n");
+  unlink((dir + "/claimed/" + id).c_str());
+  std::lock_guard<std::mutex> lock(claimedMutex);
+  claimed.erase(id);
+}
+
+bool WorkQueue::Finished() const {
+  struct stat st;
+  return stat((dir + "/finished").c_str(), &st) == 0;
+}
+
+void WorkQueue::Heartbeat() {
+  std::lock_guard<std::mutex> lock(claimedMutex);
+  for (auto it = claimed.begin(); it != claimed.end(); ++it) {
+    utime((dir + "/claimed/" + *it).c_str(), NULL);
+  }
+}
@@ -0,0 +1,76 @@
+// WorkQueue.h
+// Queue of cubes in a directory shared by the driver and by workers on
+// any host that can see it (e.g. over NFS). Everything is moved into
+// place with rename, so no one sees partial files:
+//
+//   <dir>/formula.cnf    the formula being counted
+//   <dir>/todo/<id>      cubes waiting for a worker (their literals)
+//   <dir>/claimed/<id>   cubes being counted, touched by their worker
+//   <dir>/done/<id>      "count <n>", "split <var>" or "failed"
+//   <dir>/finished       created by the driver when the count is done
+//
+// A worker claims a cube by renaming it from todo/ to claimed/, so only
+// one worker gets it. A cube split in two is replaced by the cubes
+// <id>-0 and <id>-1 (with -var and var added). Cubes whose worker stops
+// touching them are put back in todo/ by the driver
+
+#ifndef CFCOUNT_WORKQUEUE_H
+#define CFCOUNT_WORKQUEUE_H
+
+#include "CNF.h"
+
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+// Seconds between two touches of the claimed cubes of a worker
+static const unsigned HeartbeatSeconds = 5;
+
+class WorkQueue {
+public:
+  WorkQueue(const std::string &dir) : dir(dir) {}
+
+  const std::string &Dir() const { return dir; }
+
+  /** Driver **/
+
+  // Start counting a formula in the directory, removing what is left of
+  // an earlier count
+  bool Create(const CNF &cnf);
+  bool Push(const std::string &id, const std::vector<int> &cube);
+  // Results of the cubes done so far, by id
+  void ReadResults(std::map<std::string, std::string> *results);
+  // Put the cubes claimed by workers that have not touched them for
+  // lease seconds back in the queue. Returns how many
+  int RequeueStale(unsigned lease,
+                   const std::map<std::string, std::string> &results);
+  // Tell the workers to stop
+  void Finish();
+  // Remove the directory and everything in it
+  void Remove();
+
+  /** Workers **/
+
+  // Read the formula, waiting for the driver to create it. Returns false
+  // if the count finished first
+  bool LoadFormula(CNF *cnf);
+  // Claim a cube. Returns false if there is none waiting
+  bool Claim(std::string *id, std::vector<int> *cube);
+  // Record the result of a claimed cube and release it
+  void Complete(const std::string &id, const std::string &result);
+  bool Finished() const;
+  // Touch the cubes this process has claimed
+  void Heartbeat();
+
+private:
+  std::string dir;
+  std::mutex claimedMutex;
+  std::set<std::string> claimed;
+
+  // Write a file by renaming a complete temporary file into place
+  bool WriteFile(const std::string &path, const std::string &contents);
+};
+
+#endif
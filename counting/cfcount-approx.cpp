@@ -0,0 +1,55 @@
+// cfcount-approx.cpp
+// Approximate model counter for paths too large to count exactly.
+// Prints the estimate in sharpSAT's format
+
+#include "BigNum.h"
+#include "CNF.h"
+#include "Hashing.h"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <thread>
+
+using namespace llvm;
+
+// CNF of the path, with a "c ind" line for the input bits if known
+cl::opt<std::string> InputFilename(cl::Positional, cl::Required,
+                                   cl::desc("<input cnf>"));
+// The estimate is within a factor of (1 + epsilon) of the count...
+cl::opt<double> Epsilon("epsilon", cl::init(0.8),
+                        cl::desc("Tolerance of the estimate"));
+// ... with probability at least 1 - delta
+cl::opt<double> Delta("delta", cl::init(0.2),
+                      cl::desc("Probability the estimate is out of tolerance"));
+// Number of hashing trials run at the same time
+cl::opt<unsigned> Jobs("j", cl::init(std::thread::hardware_concurrency()),
+                       cl::desc("Number of trials run in parallel"));
+cl::opt<unsigned> Seed("seed", cl::init(1),
+                       cl::desc("Seed of the random hash functions"));
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv, "approximate model counter\n");
+
+  if (Epsilon <= 0 || Delta <= 0 || Delta >= 1) {
+    errs() << "Need epsilon > 0 and 0 < delta < 1!\n";
+    return 1;
+  }
+
+  CNF cnf;
+  if (!ReadDIMACS(InputFilename, &cnf)) {
+    errs() << "Cannot open input cnf file!\n";
+    return 1;
+  }
+
+  BigNum estimate;
+  if (!ApproxCount(cnf, Epsilon, Delta, Jobs, Seed, &estimate)) {
+    errs() << "No estimate: every hashing trial failed\n";
+    return 2;
+  }
+
+  errs() << "approximate count (epsilon " << Epsilon << ", delta " << Delta
+         << ") over " << CountedVars(cnf).size() << " variables\n";
+  outs() << "# solutions \n" << estimate.ToString() << "\n# END\n";
+  return 0;
+}
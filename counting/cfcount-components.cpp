@@ -0,0 +1,94 @@
+// cfcount-components.cpp
+// Counts the CNF of a path by splitting it into independent components
+// and counting them in parallel. Prints the count in sharpSAT's format
+
+#include "BigNum.h"
+#include "CNF.h"
+#include "Components.h"
+#include "Counter.h"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <atomic>
+#include <thread>
+
+using namespace llvm;
+
+// CNF of the path
+cl::opt<std::string> InputFilename(cl::Positional, cl::Required,
+                                   cl::desc("<input cnf>"));
+// Model counter run on each component, as "<counter> <cnf file>"
+cl::opt<std::string> CounterCommand("counter", cl::init("sharpSAT"),
+                                    cl::desc("Model counter command"));
+// Number of components counted at the same time
+cl::opt<unsigned> Jobs("j", cl::init(std::thread::hardware_concurrency()),
+                       cl::desc("Number of components counted in parallel"));
+// Components this small are counted in process instead of
+// starting the counter
+cl::opt<unsigned> EnumerateVars(
+    "enumerate-vars", cl::init(12),
+    cl::desc("Enumerate the models of components with at most this many "
+             "variables (at most 20)"));
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv,
+                              "parallel model counting of CNF components\n");
+
+  CNF cnf;
+  if (!ReadDIMACS(InputFilename, &cnf)) {
+    errs() << "Cannot open input cnf file!\n";
+    return 1;
+  }
+
+  std::vector<CNF> components;
+  std::vector<std::vector<int> > varMaps;
+  int freeVars = SplitComponents(cnf, &components, &varMaps);
+
+  int largest = 0;
+  for (int i = 0; i < components.size(); i++) {
+    largest = std::max(largest, components[i].numVars);
+  }
+  errs() << "components: " << components.size() << " (largest has " << largest
+         << " variables), free variables: " << freeVars << "\n";
+
+  // Count the components on a pool of workers
+  std::vector<BigNum> counts(components.size());
+  std::vector<char> counted(components.size(), false);
+  std::atomic<int> next(0);
+  std::vector<std::thread> workers;
+  for (unsigned w = 0; w < std::max(1u, (unsigned)Jobs); w++) {
+    workers.push_back(std::thread([&]() {
+      for (int i = next++; i < components.size(); i = next++) {
+        if (components[i].numVars <=
+            std::min((int)EnumerateVars, MaxEnumerateVars)) {
+          counts[i] = EnumerateModels(components[i]);
+          counted[i] = true;
+        } else {
+          counted[i] = RunCounter(CounterCommand, components[i], &counts[i]);
+        }
+        // Without projection variables only satisfiability matters
+        if (cnf.hasProjection && components[i].projection.empty() &&
+            !counts[i].IsZero()) {
+          counts[i] = BigNum(1);
+        }
+      }
+    }));
+  }
+  for (int w = 0; w < workers.size(); w++) {
+    workers[w].join();
+  }
+
+  // Free counted variables can take either value
+  BigNum total = BigNum::Pow2(freeVars);
+  for (int i = 0; i < components.size(); i++) {
+    if (!counted[i]) {
+      errs() << "Counter failed on component " << i << "!\n";
+      return 1;
+    }
+    total *= counts[i];
+  }
+
+  outs() << "# solutions \n" << total.ToString() << "\n# END\n";
+  return 0;
+}
@@ -0,0 +1,307 @@
+// cfcount-convert.cpp
+// Converts the bit-blasted goal of a path (the output of its Z3Py script)
+// to DIMACS CNF, as scripts/convert.py does, for goals too big for it. The
+// goal is mapped and split into tokens by the vectorized Tokenizer; each
+// variable (k!<n> or a Bool of the bool file) is numbered in the order it
+// first appears. With the inputs file, the "c ind" and "c input" lines of
+// the input bits are written too, input bits in no clause getting new
+// variables
+
+#include "Tokenizer.h"
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+// cfcount-convert <z3 output> <bool file> [<inputs file>] > <cnf>
+cl::opt<std::string> GoalFilename(cl::Positional, cl::Required,
+                                  cl::desc("<z3 output>"));
+cl::opt<std::string> BoolFilename(cl::Positional, cl::Required,
+                                  cl::desc("<bool file>"));
+// Bools of the input bits (-cfcount-inputs-file)
+cl::opt<std::string> InputsFilename(cl::Positional, cl::init(""),
+                                    cl::desc("[<inputs file>]"));
+
+static bool ReadLines(const std::string &filename,
+                      std::vector<std::string> *lines) {
+  std::ifstream file(filename);
+  if (!file.is_open()) {
+    return false;
+  }
+  std::string line;
+  while (std::getline(file, line)) {
+    lines->push_back(line);
+  }
+  return true;
+}
+
+namespace {
+
+// Clauses of a goal, in DIMACS
+struct GoalCNF {
+  // Variables of the Bools by name, and of k!<n> by n (0 until seen)
+  StringMap<int> vars;
+  std::vector<int> kVars;
+  int numVars = 0;
+  std::string clauses;
+  int numClauses = 0;
+
+  int Var(StringRef name) {
+    unsigned n;
+    if (name.startswith("k!") && !name.substr(2).getAsInteger(10, n) &&
+        n < (1u << 30)) {
+      if (n >= kVars.size()) {
+        kVars.resize(n + 1, 0);
+      }
+      if (kVars[n] == 0) {
+        kVars[n] = ++numVars;
+      }
+      return kVars[n];
+    }
+    auto inserted = vars.insert(std::make_pair(name, numVars + 1));
+    if (inserted.second) {
+      numVars++;
+    }
+    return inserted.first->second;
+  }
+
+  void AddLiteral(StringRef name, bool negated) {
+    if (negated) {
+      clauses += '-';
+    }
+    clauses += std::to_string(Var(name));
+    clauses += ' ';
+  }
+
+  void EndClause() {
+    clauses += "0\n";
+    numClauses++;
+  }
+};
+
+// Reads the expressions of a goal one token at a time
+class GoalParser {
+public:
+  GoalParser(StringRef text, GoalCNF *cnf)
+      : tokens(text.begin(), text.end(), true), cnf(cnf) {}
+
+  // Every clause of the goal, false (with error set) on anything but
+  // literals, (not ...) and (or ...)
+  bool Parse() {
+    if (!Next()) {
+      return true;
+    }
+    // Z3 prints "(goal <clauses> :precision precise :depth <n>)"
+    bool inGoal = false;
+    if (token == "(") {
+      if (!Next() || token != "goal") {
+        return Fail("expected (goal");
+      }
+      inGoal = true;
+      if (!Next()) {
+        return Fail("unterminated goal");
+      }
+    }
+    while (true) {
+      if (token == ")") {
+        return inGoal || Fail("unbalanced )");
+      }
+      if (token.startswith(":")) {
+        // A keyword and its value
+        if (!Next() || !Next()) {
+          return Fail("unterminated goal");
+        }
+        continue;
+      }
+      if (!ParseClause()) {
+        return false;
+      }
+      if (!Next()) {
+        return !inGoal || Fail("unterminated goal");
+      }
+    }
+  }
+
+  std::string error;
+
+private:
+  Tokenizer tokens;
+  GoalCNF *cnf;
+  StringRef token;
+
+  bool Next() {
+    const char *start;
+    size_t size;
+    if (!tokens.Next(&start, &size)) {
+      return false;
+    }
+    token = StringRef(start, size);
+    return true;
+  }
+
+  bool Fail(const std::string &message) {
+    error = message + (token.empty() ? "" : " at " + token.str());
+    return false;
+  }
+
+  // A literal starting at the current token: a name or (not <name>),
+  // consumed up to its last token
+  bool ParseLiteral(StringRef *name, bool *negated) {
+    *negated = false;
+    if (token == "(") {
+      if (!Next() || token != "not" || !Next()) {
+        return Fail("expected (not");
+      }
+      *negated = true;
+      *name = token;
+      if (*name == "(" || *name == ")" || !Next() || token != ")") {
+        return Fail("expected a variable in (not");
+      }
+      return true;
+    }
+    if (token == ")") {
+      return Fail("expected a literal");
+    }
+    *name = token;
+    return true;
+  }
+
+  bool ParseClause() {
+    StringRef name;
+    bool negated;
+    if (token == "true") {
+      return true;
+    }
+    if (token == "false") {
+      cnf->EndClause();
+      return true;
+    }
+    if (token != "(") {
+      cnf->AddLiteral(token, false);
+      cnf->EndClause();
+      return true;
+    }
+    if (!Next()) {
+      return Fail("unterminated clause");
+    }
+    if (token == "not") {
+      if (!Next() || token == "(" || token == ")") {
+        return Fail("expected a variable in (not");
+      }
+      name = token;
+      if (!Next() || token != ")") {
+        return Fail("expected ) after (not");
+      }
+      cnf->AddLiteral(name, true);
+      cnf->EndClause();
+      return true;
+    }
+    if (token != "or") {
+      return Fail("unsupported expression");
+    }
+    while (Next() && token != ")") {
+      if (!ParseLiteral(&name, &negated)) {
+        return false;
+      }
+      cnf->AddLiteral(name, negated);
+    }
+    if (token != ")") {
+      return Fail("unterminated (or");
+    }
+    cnf->EndClause();
+    return true;
+  }
+};
+
+}
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv, "Z3 goal to DIMACS converter\n");
+
+  ErrorOr<std::unique_ptr<MemoryBuffer> > goal =
+      MemoryBuffer::getFile(GoalFilename);
+  if (!goal) {
+    errs() << "Cannot open z3 output file!\n";
+    return 1;
+  }
+  std::vector<std::string> bools;
+  if (!ReadLines(BoolFilename, &bools)) {
+    errs() << "Cannot open bool file!\n";
+    return 1;
+  }
+
+  GoalCNF cnf;
+  GoalParser parser((*goal)->getBuffer(), &cnf);
+  if (!parser.Parse()) {
+    errs() << "Cannot parse goal: " << parser.error << "\n";
+    return 1;
+  }
+
+  // Mark the input bits as the projection of the count ("c ind" line)
+  if (InputsFilename != "") {
+    std::vector<std::string> inputs;
+    if (!ReadLines(InputsFilename, &inputs)) {
+      errs() << "Cannot open inputs file!\n";
+      return 1;
+    }
+    StringSet<> boolNames;
+    for (int b = 0; b < bools.size(); b++) {
+      boolNames.insert(bools[b]);
+    }
+    // Input bits in no clause get a variable of their own: they are
+    // free, each one doubles the count. Without input bits the line is
+    // "c ind 0" (an empty projection, not an unknown one)
+    StringMap<int> inputVars;
+    outs() << "c ind ";
+    for (int i = 0; i < inputs.size(); i++) {
+      if (inputVars.count(inputs[i])) {
+        continue;
+      }
+      int var = 0;
+      if (boolNames.count(inputs[i])) {
+        auto known = cnf.vars.find(inputs[i]);
+        var = known == cnf.vars.end() ? 0 : known->second;
+      }
+      if (var == 0) {
+        var = ++cnf.numVars;
+      }
+      inputVars[inputs[i]] = var;
+      outs() << var << " ";
+    }
+    outs() << "0\n";
+
+    // The variable of each bit of each input, least significant bit first
+    std::map<int, std::map<int, int> > inputBits;
+    for (int i = 0; i < inputs.size(); i++) {
+      SmallVector<StringRef, 4> fields;
+      StringRef(inputs[i]).split(fields, "_");
+      int k, bit;
+      if (fields.size() == 4 && fields[0] == "input" && fields[2] == "bit" &&
+          !fields[1].getAsInteger(10, k) && !fields[3].getAsInteger(10, bit)) {
+        inputBits[k][bit] = inputVars[inputs[i]];
+      }
+    }
+    for (auto input = inputBits.begin(); input != inputBits.end(); ++input) {
+      outs() << "c input " << input->first << " " << input->second.size()
+             << " ";
+      for (auto bit = input->second.begin(); bit != input->second.end();
+           ++bit) {
+        outs() << (bit != input->second.begin() ? " " : "") << bit->second;
+      }
+      outs() << "\n";
+    }
+  }
+
+  outs() << "p cnf " << cnf.numVars << " " << cnf.numClauses << "\n";
+  outs() << cnf.clauses << "\n";
+  return 0;
+}
@@ -0,0 +1,249 @@
+// cfcount-cubes.cpp
+// Cube-and-conquer counting of the CNF of a path: the formula is split
+// into cubes on its highest-impact input bits, the cubes are counted in
+// parallel (by threads here and by workers on any host that shares the
+// queue directory) and their counts are summed. Cubes that take too long
+// are split again. Prints the count in sharpSAT's format
+
+#include "BigNum.h"
+#include "CNF.h"
+#include "Counter.h"
+#include "Cubes.h"
+#include "WorkQueue.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdlib>
+#include <thread>
+
+#include <unistd.h>
+
+using namespace llvm;
+
+// cfcount-cubes [options] <input cnf>
+// cfcount-cubes -worker [options] <queue dir>
+cl::opt<std::string> InputFilename(cl::Positional, cl::Required,
+                                   cl::desc("<input cnf> | <queue dir>"));
+cl::opt<bool> Worker("worker", cl::init(false),
+                     cl::desc("Count the cubes of the queue directory of a "
+                              "running cfcount-cubes"));
+// Model counter run on each cube, as "<counter> <cnf file>"
+cl::opt<std::string> CounterCommand("counter", cl::init("sharpSAT"),
+                                    cl::desc("Model counter command"));
+// Number of cubes counted at the same time by this process
+cl::opt<unsigned> Jobs("j", cl::init(std::thread::hardware_concurrency()),
+                       cl::desc("Number of cubes counted in parallel"));
+// The formula is first split into 2^k cubes
+cl::opt<unsigned> SplitBits("split-bits", cl::init(6),
+                            cl::desc("Number of input bits of the first "
+                                     "split"));
+// Cubes still counting after this long are split in two
+cl::opt<unsigned> CubeTimeout(
+    "cube-timeout", cl::init(60),
+    cl::desc("Seconds before a cube is split again (0 never splits)"));
+// Shared directory of the queue (a temporary directory if not given)
+cl::opt<std::string> QueueDir("queue-dir", cl::init(""),
+                              cl::desc("Directory of the cube queue, shared "
+                                       "with -worker processes"));
+// Cubes whose worker has not been heard of for this long are counted again
+cl::opt<unsigned> Lease("lease", cl::init(120),
+                        cl::desc("Seconds before the cube of a silent "
+                                 "worker is given to another one"));
+// Cubes this small (after the split) are counted in process
+cl::opt<unsigned> EnumerateVars(
+    "enumerate-vars", cl::init(12),
+    cl::desc("Enumerate the models of cubes with at most this many "
+             "variables left (at most 20)"));
+
+// Count cubes of the queue until the driver is done
+static void RunWorker(WorkQueue &queue, const CNF &cnf,
+                      const std::vector<int> &candidates,
+                      const std::vector<int> &counted) {
+  Propagator prop(cnf);
+  while (!queue.Finished()) {
+    std::string id;
+    std::vector<int> cube;
+    if (!queue.Claim(&id, &cube)) {
+      usleep(100000);
+      continue;
+    }
+
+    CubeCount result =
+        CountCube(cnf, prop, cube, CounterCommand, EnumerateVars, CubeTimeout);
+    if (result.status == CubeCount::TimedOut) {
+      // Split on the input bit that decides the most of the cube, or on
+      // any counted variable left when every candidate is set
+      std::vector<int> vars = PickSplitVars(prop, candidates, cube, 1);
+      for (int i = 0; i < counted.size() && vars.empty(); i++) {
+        if (prop.Value(counted[i]) == 2) {
+          vars.push_back(counted[i]);
+        }
+      }
+      if (!vars.empty()) {
+        cube.push_back(-vars[0]);
+        queue.Push(id + "-0", cube);
+        cube.back() = vars[0];
+        queue.Push(id + "-1", cube);
+        queue.Complete(id, "split " + std::to_string(vars[0]));
+        continue;
+      }
+      result = CountCube(cnf, prop, cube, CounterCommand, EnumerateVars, 0);
+    }
+
+    if (result.status == CubeCount::Counted) {
+      queue.Complete(id, "count " + result.count.ToString());
+    } else {
+      queue.Complete(id, "failed");
+    }
+  }
+}
+
+// Run Jobs workers, and a thread that keeps their cubes claimed, until
+// the driver is done
+static void RunWorkers(WorkQueue &queue, const CNF &cnf,
+                       std::vector<std::thread> *threads) {
+  std::vector<int> candidates = SplitCandidates(cnf);
+  std::vector<int> counted = SplitCandidates(cnf, cnf.numVars);
+  for (unsigned w = 0; w < Jobs; w++) {
+    threads->push_back(std::thread([&queue, &cnf, candidates, counted]() {
+      RunWorker(queue, cnf, candidates, counted);
+    }));
+  }
+  threads->push_back(std::thread([&queue]() {
+    while (!queue.Finished()) {
+      for (unsigned t = 0; t < 10 * HeartbeatSeconds && !queue.Finished();
+           t++) {
+        usleep(100000);
+      }
+      queue.Heartbeat();
+    }
+  }));
+}
+
+// Add up the count of a cube, or of the cubes it was split into. Returns
+// false if some count is missing (or failed)
+static bool SumCube(const std::string &id,
+                    const std::map<std::string, std::string> &results,
+                    BigNum *total, int *cubes, int *splits, bool *failed) {
+  std::map<std::string, std::string>::const_iterator it = results.find(id);
+  if (it == results.end()) {
+    return false;
+  }
+  const std::string &result = it->second;
+  if (result.compare(0, 6, "split ") == 0) {
+    (*splits)++;
+    bool first = SumCube(id + "-0", results, total, cubes, splits, failed);
+    bool second = SumCube(id + "-1", results, total, cubes, splits, failed);
+    return first && second;
+  }
+  BigNum count;
+  if (result.compare(0, 6, "count ") != 0 ||
+      !BigNum::Parse(result.substr(6), &count)) {
+    *failed = true;
+    return false;
+  }
+  *total += count;
+  (*cubes)++;
+  return true;
+}
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv,
+                              "cube-and-conquer model counting\n");
+
+  if (Worker) {
+    WorkQueue queue(InputFilename);
+    CNF cnf;
+    if (!queue.LoadFormula(&cnf)) {
+      return 0;
+    }
+    std::vector<std::thread> threads;
+    RunWorkers(queue, cnf, &threads);
+    for (int t = 0; t < threads.size(); t++) {
+      threads[t].join();
+    }
+    return 0;
+  }
+
+  CNF cnf;
+  if (!ReadDIMACS(InputFilename, &cnf)) {
+    errs() << "Cannot open input cnf file!\n";
+    return 1;
+  }
+
+  // The first split fixes the input bits that decide the most
+  Propagator prop(cnf);
+  std::vector<int> splitVars =
+      PickSplitVars(prop, SplitCandidates(cnf), std::vector<int>(),
+                    std::min((unsigned)SplitBits, 30u));
+
+  std::string dir = QueueDir;
+  if (dir == "") {
+    SmallString<128> path;
+    if (sys::fs::createUniqueDirectory("cfcount-cubes", path)) {
+      errs() << "Cannot create the queue directory!\n";
+      return 1;
+    }
+    dir = path.str().str();
+  }
+  WorkQueue queue(dir);
+  if (!queue.Create(cnf)) {
+    errs() << "Cannot write to the queue directory " << dir << "!\n";
+    return 1;
+  }
+  int numCubes = 1 << splitVars.size();
+  for (int c = 0; c < numCubes; c++) {
+    std::vector<int> cube;
+    for (int b = 0; b < splitVars.size(); b++) {
+      cube.push_back((c >> b) & 1 ? splitVars[b] : -splitVars[b]);
+    }
+    queue.Push(std::to_string(c), cube);
+  }
+  errs() << "split on " << splitVars.size() << " input bits into " << numCubes
+         << " cubes, queued in " << dir << "\n";
+
+  std::vector<std::thread> threads;
+  RunWorkers(queue, cnf, &threads);
+
+  // Wait for every cube, and for the cubes it was split into
+  std::map<std::string, std::string> results;
+  BigNum total;
+  int cubes, splits, requeued = 0;
+  bool failed = false;
+  while (true) {
+    queue.ReadResults(&results);
+    total = BigNum(0);
+    cubes = 0;
+    splits = 0;
+    bool complete = true;
+    for (int c = 0; c < numCubes && !failed; c++) {
+      complete &= SumCube(std::to_string(c), results, &total, &cubes, &splits,
+                          &failed);
+    }
+    if (complete || failed) {
+      break;
+    }
+    requeued += queue.RequeueStale(Lease, results);
+    usleep(100000);
+  }
+
+  queue.Finish();
+  for (int t = 0; t < threads.size(); t++) {
+    threads[t].join();
+  }
+  if (QueueDir == "") {
+    queue.Remove();
+  }
+
+  if (failed) {
+    errs() << "Counter failed on a cube!\n";
+    return 1;
+  }
+  errs() << "cubes: " << cubes << " counted, " << splits << " split again, "
+         << requeued << " given to another worker\n";
+  outs() << "# solutions \n" << total.ToString() << "\n# END\n";
+  return 0;
+}
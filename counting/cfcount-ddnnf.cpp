@@ -0,0 +1,95 @@
+// cfcount-ddnnf.cpp
+// Compiles the CNF of a path into a d-DNNF over its input bits once, then
+// counts the path under any number of bounds files without a model
+// counter. Prints each count in sharpSAT's format
+
+#include "BigNum.h"
+#include "CNF.h"
+#include "DDNNF.h"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+// cfcount-ddnnf -compile <input cnf> <output nnf>
+// cfcount-ddnnf <nnf> [<bounds file>...]
+cl::list<std::string> Files(cl::Positional, cl::OneOrMore,
+                            cl::desc("<input cnf> <output nnf> | "
+                                     "<nnf> [<bounds file>...]"));
+cl::opt<bool> Compile("compile", cl::init(false),
+                      cl::desc("Compile a CNF (from convert.py with the "
+                               "inputs file) into a d-DNNF"));
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv,
+                              "d-DNNF compilation and counting of paths\n");
+
+  if (Compile) {
+    if (Files.size() != 2) {
+      errs() << "Need an input cnf and an output nnf file!\n";
+      return 1;
+    }
+    CNF cnf;
+    if (!ReadDIMACS(Files[0], &cnf)) {
+      errs() << "Cannot open input cnf file!\n";
+      return 1;
+    }
+    if (cnf.inputs.empty()) {
+      errs() << "Warning: no input bits in the cnf, it can only be counted "
+                "without bounds\n";
+    }
+
+    DDNNF ddnnf;
+    CompileStats stats = CompileDDNNF(cnf, &ddnnf);
+    if (!WriteDDNNF(Files[1], ddnnf)) {
+      errs() << "Cannot write output nnf file!\n";
+      return 1;
+    }
+    errs() << "d-DNNF: " << ddnnf.nodes.size() << " nodes over "
+           << CountedVars(cnf).size() << " variables (" << stats.decisions
+           << " decisions, " << stats.cacheHits << " cache hits, "
+           << stats.satChecks << " SAT checks)\n";
+    return 0;
+  }
+
+  DDNNF ddnnf;
+  if (!ReadDDNNF(Files[0], &ddnnf)) {
+    errs() << "Cannot read nnf file!\n";
+    return 1;
+  }
+
+  // Without bounds every value of the input bits counts, including
+  // those of bits that are in no clause
+  if (Files.size() == 1) {
+    unsigned freeBits = 0;
+    for (int i = 0; i < ddnnf.inputs.size(); i++) {
+      for (int bit = 0; bit < ddnnf.inputs[i].size(); bit++) {
+        freeBits += ddnnf.inputs[i][bit] == 0;
+      }
+    }
+    BigNum count =
+        CountDDNNF(ddnnf, std::vector<int>()) * BigNum::Pow2(freeBits);
+    outs() << "# solutions \n" << count.ToString() << "\n# END\n";
+    return 0;
+  }
+
+  for (int i = 1; i < Files.size(); i++) {
+    std::vector<std::pair<int64_t, int64_t> > bounds;
+    if (!ReadBounds(Files[i], &bounds)) {
+      errs() << "Cannot open bounds file " << Files[i] << "!\n";
+      return 1;
+    }
+    BigNum count;
+    if (!CountDDNNFInBounds(ddnnf, bounds, &count)) {
+      errs() << "The nnf has no input bits or " << Files[i]
+             << " has too few bounds!\n";
+      return 1;
+    }
+    if (Files.size() > 2) {
+      outs() << "c bounds " << Files[i] << "\n";
+    }
+    outs() << "# solutions \n" << count.ToString() << "\n# END\n";
+  }
+  return 0;
+}
@@ -0,0 +1,51 @@
+// cfcount-preprocess.cpp
+// Shrinks the CNF of a path (from scripts/convert.py) before it is given
+// to a model counter, without changing the number of models
+
+#include "CNF.h"
+#include "Preprocess.h"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+// CNF of the path, with a "c ind" line for the input bits if known
+cl::opt<std::string> InputFilename(cl::Positional, cl::Required,
+                                   cl::desc("<input cnf>"));
+// Where to write the simplified CNF
+cl::opt<std::string> OutputFilename(cl::Positional, cl::Required,
+                                    cl::desc("<output cnf>"));
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv,
+                              "count preserving CNF preprocessor\n");
+
+  CNF cnf;
+  if (!ReadDIMACS(InputFilename, &cnf)) {
+    errs() << "Cannot open input cnf file!\n";
+    return 1;
+  }
+
+  PreprocessStats stats = Preprocess(&cnf);
+
+  if (!WriteDIMACS(OutputFilename, cnf)) {
+    errs() << "Cannot open output cnf file!\n";
+    return 1;
+  }
+
+  // Report the reduction
+  errs() << "variables: " << stats.varsBefore << " -> " << stats.varsAfter
+         << "\n";
+  errs() << "clauses: " << stats.clausesBefore << " -> " << stats.clausesAfter
+         << "\n";
+  errs() << "units: " << stats.units << ", equivalences: " << stats.equivalences
+         << ", subsumed: " << stats.subsumed
+         << ", strengthened: " << stats.strengthened
+         << ", eliminated: " << stats.eliminated << "\n";
+  if (stats.unsat) {
+    errs() << "formula is unsatisfiable\n";
+  }
+
+  return 0;
+}
@@ -0,0 +1,99 @@
+// cfcount-sample.cpp
+// Draws inputs that drive a path, uniformly at random among all of them
+// (within the bounds). The CNF of the path is compiled into a d-DNNF over
+// its input bits (or a compiled nnf is read), which is then sampled by
+// its counts. Prints one sample per line: the value of each input in the
+// order of the bounds file, as the program reads them
+
+#include "BigNum.h"
+#include "CNF.h"
+#include "DDNNF.h"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <fstream>
+#include <thread>
+
+using namespace llvm;
+
+// cfcount-sample [options] <input cnf> [<bounds file>]
+// cfcount-sample -nnf [options] <nnf> [<bounds file>]
+cl::opt<std::string> InputFilename(cl::Positional, cl::Required,
+                                   cl::desc("<input cnf> | <nnf>"));
+// Bounds of the inputs, for paths generated with -cfcount-no-bounds
+cl::opt<std::string> BoundsFilename(cl::Positional, cl::init(""),
+                                    cl::desc("[<bounds file>]"));
+cl::opt<bool> Nnf("nnf", cl::init(false),
+                  cl::desc("The input is a d-DNNF from cfcount-ddnnf "
+                           "-compile"));
+cl::opt<unsigned> NumSamples("n", cl::init(1000),
+                             cl::desc("Number of samples"));
+// Number of workers counting the circuit and drawing samples
+cl::opt<unsigned> Jobs("j", cl::init(std::thread::hardware_concurrency()),
+                       cl::desc("Number of samples drawn in parallel"));
+cl::opt<unsigned> Seed("seed", cl::init(1),
+                       cl::desc("Seed of the samples"));
+// Write each sample to <dir>/input_<k>, one value per line (the format
+// of example/input), instead of printing them
+cl::opt<std::string> OutputDir("out-dir", cl::init(""),
+                               cl::desc("Directory to write each sample to"));
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv,
+                              "uniform sampling of the inputs of a path\n");
+
+  DDNNF ddnnf;
+  if (Nnf) {
+    if (!ReadDDNNF(InputFilename, &ddnnf)) {
+      errs() << "Cannot read nnf file!\n";
+      return 1;
+    }
+  } else {
+    CNF cnf;
+    if (!ReadDIMACS(InputFilename, &cnf)) {
+      errs() << "Cannot open input cnf file!\n";
+      return 1;
+    }
+    CompileStats stats = CompileDDNNF(cnf, &ddnnf);
+    errs() << "d-DNNF: " << ddnnf.nodes.size() << " nodes over "
+           << CountedVars(cnf).size() << " variables (" << stats.decisions
+           << " decisions)\n";
+  }
+
+  std::vector<std::pair<int64_t, int64_t> > bounds;
+  if (BoundsFilename != "" && !ReadBounds(BoundsFilename, &bounds)) {
+    errs() << "Cannot open bounds file!\n";
+    return 1;
+  }
+
+  std::vector<std::vector<int64_t> > samples;
+  if (!SampleDDNNFInBounds(ddnnf, bounds, NumSamples, Jobs, Seed, &samples)) {
+    errs() << "The input bits are unknown (convert the path with the "
+              "inputs file) or the bounds file has too few bounds!\n";
+    return 1;
+  }
+  if (samples.empty()) {
+    errs() << "No input drives the path!\n";
+    return 1;
+  }
+
+  for (int s = 0; s < samples.size(); s++) {
+    if (OutputDir != "") {
+      std::ofstream input_file(OutputDir + "/input_" + std::to_string(s));
+      for (int i = 0; i < samples[s].size(); i++) {
+        input_file << samples[s][i] << "\n";
+      }
+      if (!input_file) {
+        errs() << "Cannot write to " << OutputDir << "!\n";
+        return 1;
+      }
+      continue;
+    }
+    for (int i = 0; i < samples[s].size(); i++) {
+      outs() << (i > 0 ? " " : "") << samples[s][i];
+    }
+    outs() << "\n";
+  }
+  return 0;
+}
@@ -0,0 +1,112 @@
+// cfcount_trace_rt.c
+// Runtime of programs instrumented with CFCountTracer: records the ids of
+// blocks, calls and returns in a buffer per thread and writes the buffer
+// to the trace in one write when it fills up or the thread exits. The
+// trace goes to $CFCOUNT_TRACE, or to cfcount.trace if it is not set.
+//
+//   clang traced.bc cfcount_trace_rt.c -lpthread -o traced
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Emitted by CFCountTracer
+extern const char __cfcount_trace_header[];
+extern const int __cfcount_trace_header_size;
+
+// Same tags as CFCount's reader
+#define TRACE_CALL_TAG (1u << 30)
+#define TRACE_RETURN_TAG (2u << 30)
+
+#define TRACE_BUFFER_RECORDS 65536
+
+// A chunk of the trace: the thread's index, the number of records and the
+// records, written as is (the trace is little-endian)
+struct trace_buffer {
+  uint32_t thread;
+  uint32_t count;
+  uint32_t records[TRACE_BUFFER_RECORDS];
+};
+
+static int trace_fd = -1;
+static pthread_once_t trace_once = PTHREAD_ONCE_INIT;
+static pthread_key_t trace_key;
+static uint32_t next_thread;
+static __thread struct trace_buffer *buffer;
+
+static void write_all(const char *data, size_t size) {
+  while (size > 0) {
+    ssize_t written = write(trace_fd, data, size);
+    if (written <= 0) {
+      return;
+    }
+    data += written;
+    size -= written;
+  }
+}
+
+// Chunks of threads are appended whole, so they never interleave
+static void flush_buffer(struct trace_buffer *b) {
+  if (b->count == 0 || trace_fd < 0) {
+    return;
+  }
+  write_all((const char *)b, (2 + (size_t)b->count) * sizeof(uint32_t));
+  b->count = 0;
+}
+
+static void flush_thread(void *b) {
+  flush_buffer((struct trace_buffer *)b);
+  free(b);
+}
+
+static void flush_main_thread(void) {
+  if (buffer != NULL) {
+    flush_buffer(buffer);
+  }
+}
+
+static void open_trace(void) {
+  const char *path = getenv("CFCOUNT_TRACE");
+  trace_fd = open(path != NULL ? path : "cfcount.trace",
+                  O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+  if (trace_fd < 0) {
+    perror("cfcount trace");
+    return;
+  }
+  write_all(__cfcount_trace_header, __cfcount_trace_header_size);
+  pthread_key_create(&trace_key, flush_thread);
+  atexit(flush_main_thread);
+}
+
+static struct trace_buffer *get_buffer(void) {
+  pthread_once(&trace_once, open_trace);
+  buffer = (struct trace_buffer *)malloc(sizeof(struct trace_buffer));
+  buffer->thread = __atomic_fetch_add(&next_thread, 1, __ATOMIC_RELAXED);
+  buffer->count = 0;
+  // The first thread's buffer is flushed at exit, it may not return
+  // through pthread_exit
+  if (buffer->thread != 0) {
+    pthread_setspecific(trace_key, buffer);
+  }
+  return buffer;
+}
+
+static inline void record(uint32_t r) {
+  struct trace_buffer *b = buffer != NULL ? buffer : get_buffer();
+  b->records[b->count++] = r;
+  if (b->count == TRACE_BUFFER_RECORDS) {
+    flush_buffer(b);
+  }
+}
+
+void __cfcount_trace_block(uint32_t id) { record(id); }
+
+void __cfcount_trace_call(uint32_t function) {
+  record(TRACE_CALL_TAG | function);
+}
+
+void __cfcount_trace_return(void) { record(TRACE_RETURN_TAG); }
@@ -7,6 +7,8 @@ clause_num = 0
 
 toConvert = sys.argv[1]
 boolFile = sys.argv[2]
+# Optional file with the Bools of the input bits (-cfcount-inputs-file)
+inputsFile = sys.argv[3] if len(sys.argv) > 3 else None
 
 with open(toConvert) as f:
         lines = f.read().splitlines()
@@ -43,6 +45,7 @@ bools = []
 with open(boolFile) as f:
         bools = f.read().splitlines()
 
+bool_vars = {}
 for b in bools:
     line_ct = 0
     replaced = False
@@ -51,6 +54,7 @@ for b in bools:
         line_ct += 1
         replaced = True
     if replaced:
+        bool_vars[b] = str(largestVarNum)
         largestVarNum += 1
 
 line_ct = 0
@@ -228,5 +232,36 @@ for line in lines:
         print "UNKNOWN"
         print line
 
+# Mark the input bits as the projection of the count ("c ind" line)
+if inputsFile != None:
+    with open(inputsFile) as f:
+        inputs = f.read().splitlines()
+    # Input bits in no clause get a variable of their own: they are free,
+    # each one doubles the count. Without input bits the line is "c ind 0"
+    # (an empty projection, not an unknown one)
+    input_vars = {}
+    ind = ""
+    for i in inputs:
+        if i in input_vars:
+            continue
+        if i in bool_vars and bool_vars[i] in var_map:
+            input_vars[i] = var_map[bool_vars[i]]
+        else:
+            input_vars[i] = var_num
+            var_num += 1
+        ind += str(input_vars[i]) + " "
+    print ("c ind " + ind + "0")
+    # The variable of each bit of each input, least significant bit first
+    input_bits = {}
+    for i in inputs:
+        fields = i.split("_")
+        if len(fields) == 4 and fields[0] == "input" and fields[2] == "bit":
+            var = input_vars[i]
+            input_bits.setdefault(int(fields[1]), {})[int(fields[3])] = var
+    for k in sorted(input_bits):
+        bits = input_bits[k]
+        print ("c input " + str(k) + " " + str(len(bits)) + " " +
+               " ".join([str(bits[b]) for b in sorted(bits)]))
+
 print ("p cnf " + str((var_num - 1)) + " " +  str(clause_num))
 print clauses                        
@@ -0,0 +1,46 @@
+#!/bin/sh
+# Count the inputs that take a path from the files generated by CFCount:
+#   count_path.sh <z3 file> <bool file> [<inputs file>]
+# Runs the Z3Py script, converts its output to CNF and runs the model
+# counter ($COUNTER, default sharpSAT) on it. The conversion is done by
+# $CONVERT (e.g. counting/cfcount-convert) if it is set, by convert.py
+# otherwise. If $PREPROCESS is set (e.g. counting/cfcount-preprocess), it
+# is run as "$PREPROCESS <cnf> <reduced cnf>" and the counter counts the
+# reduced CNF. Intermediate files are written next to the z3 file. If
+# $CFCOUNT_TIMES is set, a "<stage> <seconds>" line is appended to it for
+# each stage
+set -e
+
+z3_file=$1
+bool_file=$2
+inputs_file=$3
+scripts=$(dirname "$0")
+
+start=$(date +%s.%N)
+stage_done() {
+    now=$(date +%s.%N)
+    if [ -n "$CFCOUNT_TIMES" ]; then
+        echo "$1 $(echo "$start $now" | awk '{ print $2 - $1 }')" \
+            >> "$CFCOUNT_TIMES"
+    fi
+    start=$now
+}
+
+${PYTHON:-python} "$z3_file" > "$z3_file.out"
+stage_done z3
+if [ -n "$CONVERT" ]; then
+    $CONVERT "$z3_file.out" "$bool_file" ${inputs_file:+"$inputs_file"} \
+        > "$z3_file.cnf"
+else
+    ${PYTHON:-python} "$scripts/convert.py" "$z3_file.out" "$bool_file" \
+        ${inputs_file:+"$inputs_file"} > "$z3_file.cnf"
+fi
+stage_done convert
+cnf_file=$z3_file.cnf
+if [ -n "$PREPROCESS" ]; then
+    $PREPROCESS "$z3_file.cnf" "$z3_file.pre.cnf"
+    cnf_file=$z3_file.pre.cnf
+    stage_done preprocess
+fi
+${COUNTER:-sharpSAT} "$cnf_file"
+stage_done counter
@@ -0,0 +1,71 @@
+from __future__ import print_function
+import os
+import sys
+
+from z3 import *
+
+# Keeps an incremental Z3 solver alive while CFCount generates the
+# constraints of a path. CFCount writes the Z3Py statements it generates
+# to stdin, separated by command lines:
+#
+#   %%exec                run the statements sent since the last command
+#   %%branch <desc>       same as %%exec, the statements encode a branch
+#   %%check               reply "sat" or "unsat <desc>" on stdout, where
+#                         <desc> is the first branch that contradicts the
+#                         constraints before it
+#
+# Usage: python incremental_check.py <models.py>
+
+models_dir, models_file = os.path.split(os.path.abspath(sys.argv[1]))
+sys.path.insert(0, models_dir)
+ar = __import__(os.path.splitext(models_file)[0])
+
+
+# Stands in for the Z3 Goal of the generated script so every
+# constraint goes straight into the solver
+class SolverGoal:
+    def __init__(self, solver):
+        self.solver = solver
+
+    def add(self, *constraints):
+        self.solver.add(*constraints)
+
+
+s = Solver()
+env = {"ar": ar, "g": SolverGoal(s)}
+exec("from z3 import *", env)
+
+# Statements run since the last satisfiable check, paired with the
+# description of the branch they encode (None if not a branch)
+pending = []
+chunk = []
+
+s.push()
+for line in iter(sys.stdin.readline, ""):
+    if line.startswith("%%exec") or line.startswith("%%branch"):
+        code = "".join(chunk)
+        chunk = []
+        exec(code, env)
+        desc = line[len("%%branch "):].strip() if line.startswith("%%branch") else None
+        pending.append((code, desc))
+    elif line.startswith("%%check"):
+        if s.check() != unsat:
+            # Keep everything checked so far below a new scope
+            s.push()
+            pending = []
+            print("sat")
+        else:
+            # Replay the statements since the last satisfiable check
+            # one by one to find the first contradicting branch
+            s.pop()
+            s.push()
+            culprit = "unknown branch"
+            for code, desc in pending:
+                exec(code, env)
+                if desc is not None and s.check() == unsat:
+                    culprit = desc
+                    break
+            print("unsat " + culprit)
+        sys.stdout.flush()
+    else:
+        chunk.append(line)